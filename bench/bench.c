@@ -0,0 +1,248 @@
+/*
+    Times pittari on a set of synthetic screenshots of known original
+    resolution (see synthesize.h), from 256x224 up to 8K, and checks that
+    it gets every one of them right. The screenshots are generated into
+    build/bench-screenshots/ the first time around and reused after that.
+
+    For each one, the time taken to decode it, to scan it, and to determine
+    the dimensions from the contrasts is reported in milliseconds per
+    megapixel of the scaled screenshot – the best of a few runs each.
+    Exits with -1 if any result is wrong.
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <argp.h>
+#include "algorithm/compare.h"
+#include "algorithm/contrast.h"
+#include "algorithm/dimensions.h"
+#include "algorithm/pool.h"
+#include "algorithm/simd.h"
+#include "input/reader.h"
+#include "synthesize.h"
+
+#define BENCH_DIRECTORY "build/bench-screenshots"
+
+struct bench_case {
+    const char* name;
+    size_t width;
+    size_t height;
+    size_t scaled_width;
+    size_t scaled_height;
+    enum source_kind source;
+    enum scaling_origin origin;
+    // Scanned with --inexact and a --leeway of twice this.
+    int noise;
+    const char* extension;
+};
+
+static const struct bench_case bench_cases[] = {
+    {"snes",             256,  224,  731,  560,  SOURCE_RANDOM, ORIGIN_CENTER,       0, "png"},
+    {"nes-paint.net",    256,  240,  878,  720,  SOURCE_TILES,  ORIGIN_BOTTOM_RIGHT, 0, "png"},
+    {"gba",              240,  160,  1000, 667,  SOURCE_TILES,  ORIGIN_CENTER,       0, "png"},
+    {"ps1-noisy",        368,  240,  1138, 720,  SOURCE_RANDOM, ORIGIN_CENTER,       3, "png"},
+    {"vga-paint.net",    640,  480,  1920, 1080, SOURCE_TILES,  ORIGIN_BOTTOM_RIGHT, 0, "png"},
+    {"720p-to-4k",       1280, 720,  3840, 2160, SOURCE_RANDOM, ORIGIN_CENTER,       0, "ppm"},
+    {"1080p-to-4k",      1920, 1080, 3840, 2160, SOURCE_TILES,  ORIGIN_CENTER,       0, "png"},
+    {"1080p-to-8k",      1920, 1080, 7680, 4320, SOURCE_TILES,  ORIGIN_CENTER,       0, "png"},
+    {"1536p-to-8k",      2732, 1536, 7680, 4320, SOURCE_RANDOM, ORIGIN_BOTTOM_RIGHT, 0, "ppm"},
+    {"1080p-to-8k-noisy", 1920, 1080, 7680, 4320, SOURCE_TILES, ORIGIN_CENTER,       4, "png"},
+};
+
+static char doc[] = "\nTimes pittari on synthetic screenshots and checks its results.";
+static char args_doc[] = "[CASE NAME...]";
+static struct argp_option options[] = {
+    {"runs", 'r', "[1...]", 0, "How many times to run each case, keeping the best times. 3 by default."},
+    {"threads", 't', "[1...]", 0, "How many threads to scan with. Defaults to the number of CPU cores."},
+    {"sample", 0x86, 0, 0, "Scan progressively, like pittari --sample."},
+    {0}
+};
+
+struct options {
+    int runs;
+    int threads;
+    bool sample;
+    size_t num_case_names;
+    char** case_names;
+};
+
+struct timings {
+    double decode;
+    double scan;
+    double determine;
+};
+
+static int parse_options(int key, char *arg, struct argp_state *state) {
+    struct options* options = state->input;
+    switch (key) {
+        case 'r':
+            options->runs = atoi(arg);
+            if (options->runs < 1) {argp_error(state, "Invalid --runs argument: \"%s\"", arg);}
+            break;
+        case 't':
+            options->threads = atoi(arg);
+            if (options->threads < 1) {argp_error(state, "Invalid --threads argument: \"%s\"", arg);}
+            break;
+        case 0x86: options->sample = true; break;
+        case ARGP_KEY_ARGS:
+            options->num_case_names = state->argc - state->next;
+            options->case_names = state->argv + state->next;
+            break;
+        default: return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = {options, parse_options, args_doc, doc, 0, 0, 0};
+
+static bool case_selected(const struct options* options, const struct bench_case* bench_case);
+static bool prepare_case(const struct bench_case* bench_case, char* path);
+static bool run_case(
+    const struct bench_case* bench_case, const char* path, struct worker_pool* pool,
+    unsigned char* pixels, struct timings* timings, size_t* determined_width, size_t* determined_height
+);
+static double now(void);
+
+int main(int argc, char **argv)
+{
+    struct options options;
+    memset(&options, 0, sizeof(options));
+    options.runs = 3;
+    argp_parse(&argp, argc, argv, 0, 0, &options);
+
+    select_simd_kernels();
+    scan_progressively = options.sample;
+    struct worker_pool* pool = create_worker_pool(options.threads ? (size_t) options.threads : count_cpu_cores());
+
+    printf("%-18s %11s %7s  %10s %10s %10s  %s\n", "case", "scaled", "MP", "decode", "scan", "determine", "result");
+    printf("%-18s %11s %7s  %10s %10s %10s\n", "", "", "", "(ms/MP)", "(ms/MP)", "(ms/MP)");
+    int exit_code = 0;
+    for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+        const struct bench_case* bench_case = &bench_cases[i];
+        if (!case_selected(&options, bench_case)) {continue;}
+
+        char path[256];
+        unsigned char* pixels = (unsigned char*) malloc(3 * bench_case->scaled_width * bench_case->scaled_height * sizeof(unsigned char));
+        if (pixels == NULL || !prepare_case(bench_case, path)) {
+            fprintf(stderr, "ERROR: Could not set up \"%s\".\n", bench_case->name);
+            return -1;
+        }
+
+        if (bench_case->noise > 0) {
+            pixel_comparison = COMPARE_FUZZY;
+            compare_pixel_fuzzy_fuzziness = 2 * bench_case->noise;
+        } else {
+            pixel_comparison = COMPARE_EXACT;
+        }
+
+        struct timings best = {0};
+        size_t determined_width = 0;
+        size_t determined_height = 0;
+        for (int run = 0; run < options.runs; run++) {
+            struct timings timings;
+            if (!run_case(bench_case, path, pool, pixels, &timings, &determined_width, &determined_height)) {
+                fprintf(stderr, "ERROR: Could not scan \"%s\".\n", path);
+                return -1;
+            }
+            if (run == 0 || timings.decode < best.decode) {best.decode = timings.decode;}
+            if (run == 0 || timings.scan < best.scan) {best.scan = timings.scan;}
+            if (run == 0 || timings.determine < best.determine) {best.determine = timings.determine;}
+        }
+        free(pixels);
+
+        double megapixels = bench_case->scaled_width * bench_case->scaled_height / 1e6;
+        bool correct = determined_width == bench_case->width && determined_height == bench_case->height;
+        if (!correct) {exit_code = -1;}
+        char scaled[32];
+        snprintf(scaled, sizeof(scaled), "%zux%zu", bench_case->scaled_width, bench_case->scaled_height);
+        printf(
+            "%-18s %11s %7.2f  %10.3f %10.3f %10.3f  %zux%zu %s\n",
+            bench_case->name, scaled, megapixels,
+            1000 * best.decode / megapixels, 1000 * best.scan / megapixels, 1000 * best.determine / megapixels,
+            determined_width, determined_height, correct ? "OK" : "WRONG"
+        );
+        fflush(stdout);
+    }
+
+    destroy_worker_pool(pool);
+    finish_image_readers();
+    return exit_code;
+}
+
+static bool case_selected(const struct options* options, const struct bench_case* bench_case)
+{
+    if (options->num_case_names == 0) {return true;}
+    for (size_t i = 0; i < options->num_case_names; i++) {
+        if (strcmp(options->case_names[i], bench_case->name) == 0) {return true;}
+    }
+    return false;
+}
+
+// Generates the case's screenshot, unless it's already there.
+static bool prepare_case(const struct bench_case* bench_case, char* path)
+{
+    snprintf(path, 256, "%s/%s.%s", BENCH_DIRECTORY, bench_case->name, bench_case->extension);
+    struct stat file_stat;
+    if (stat(path, &file_stat) == 0) {return true;}
+
+    mkdir("build", 0777);
+    mkdir(BENCH_DIRECTORY, 0777);
+    fprintf(stderr, "Generating \"%s\"…\n", path);
+    unsigned char* source = synthesize_source(bench_case->width, bench_case->height, bench_case->source, 1);
+    unsigned char* scaled = source == NULL ? NULL : scale_nearest_neighbor(
+        source, bench_case->width, bench_case->height,
+        bench_case->scaled_width, bench_case->scaled_height, bench_case->origin
+    );
+    free(source);
+    if (scaled == NULL) {return false;}
+    add_noise(scaled, 3 * bench_case->scaled_width * bench_case->scaled_height, bench_case->noise, 2);
+    int error = write_image(path, scaled, bench_case->scaled_width, bench_case->scaled_height);
+    free(scaled);
+    return !error;
+}
+
+static bool run_case(
+    const struct bench_case* bench_case, const char* path, struct worker_pool* pool,
+    unsigned char* pixels, struct timings* timings, size_t* determined_width, size_t* determined_height
+)
+{
+    double start = now();
+    char error_description[READER_ERROR_SIZE];
+    struct image_reader* reader = open_image(path, error_description);
+    if (reader == NULL) {return false;}
+    bool read =
+        next_frame(reader) &&
+        reader->width == bench_case->scaled_width && reader->height == bench_case->scaled_height &&
+        !read_rows(reader, 0, reader->height, pixels);
+    close_image(reader);
+    if (!read) {return false;}
+
+    double decoded = now();
+    struct contrasts* contrasts = create_contrasts(bench_case->scaled_width, bench_case->scaled_height);
+    if (contrasts == NULL) {return false;}
+    contrasts->pool = pool;
+    update_contrasts_from_whole_image(contrasts, pixels);
+
+    double scanned = now();
+    *determined_width = determine_dimension(contrasts->columns, contrasts->nearest_neighbor_max_variation, NULL);
+    *determined_height = determine_dimension(contrasts->rows, contrasts->nearest_neighbor_max_variation, NULL);
+    double determined = now();
+    destroy_contrasts(contrasts);
+
+    timings->decode = decoded - start;
+    timings->scan = scanned - decoded;
+    timings->determine = determined - scanned;
+    return true;
+}
+
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
@@ -0,0 +1,129 @@
+/*
+    Writes a synthetic nearest-neighbor-scaled screenshot – see
+    synthesize.h. For example:
+
+        generate 256x224 731x560 --origin bottom-right --noise 3 out.png
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <argp.h>
+#include "synthesize.h"
+
+static char doc[] = "\nWrites a screenshot of the given original resolution, scaled up with nearest neighbor to the given scaled resolution, for testing and benchmarking pittari. Writes a PNG unless the output path ends in \".ppm\".";
+static char args_doc[] = "<WIDTHxHEIGHT> <SCALED WIDTHxSCALED HEIGHT> <OUTPUT>";
+static struct argp_option options[] = {
+    {"source", 's', "kind", 0, "What the original image looks like: \"random\" (every pixel a random color) or \"tiles\" (flat-shaded tiles). \"random\" by default."},
+    {"origin", 'o', "origin", 0, "Where in each pixel nearest neighbor samples: \"center\" (like ImageMagick) or \"bottom-right\" (like Paint.net). \"center\" by default."},
+    {"noise", 'n', "[0..255]", 0, "Nudge every channel of every pixel by up to this much either way after scaling. Scan with --inexact --leeway of twice this. 0 by default."},
+    {"seed", 'r', "number", 0, "Seed for the random numbers. 1 by default."},
+    {0}
+};
+
+struct options {
+    enum source_kind source;
+    enum scaling_origin origin;
+    int noise;
+    uint64_t seed;
+    size_t width;
+    size_t height;
+    size_t scaled_width;
+    size_t scaled_height;
+    char* output_path;
+};
+
+static bool parse_resolution(const char* string, size_t* width, size_t* height)
+{
+    char* end;
+    *width = strtoul(string, &end, 10);
+    if (end == string || (*end != 'x' && *end != 'X')) {return false;}
+    const char* height_string = end + 1;
+    *height = strtoul(height_string, &end, 10);
+    return end != height_string && *end == 0 && *width > 0 && *height > 0;
+}
+
+static int parse_options(int key, char *arg, struct argp_state *state) {
+    struct options* options = state->input;
+    switch (key) {
+        case 's':
+            if (strcmp(arg, "random") == 0) {
+                options->source = SOURCE_RANDOM;
+            } else if (strcmp(arg, "tiles") == 0) {
+                options->source = SOURCE_TILES;
+            } else {
+                argp_error(state, "Invalid --source argument: \"%s\"", arg);
+            }
+            break;
+        case 'o':
+            if (strcmp(arg, "center") == 0) {
+                options->origin = ORIGIN_CENTER;
+            } else if (strcmp(arg, "bottom-right") == 0) {
+                options->origin = ORIGIN_BOTTOM_RIGHT;
+            } else {
+                argp_error(state, "Invalid --origin argument: \"%s\"", arg);
+            }
+            break;
+        case 'n':
+            options->noise = atoi(arg);
+            if (options->noise < 0 || options->noise > 255) {argp_error(state, "Invalid --noise argument: \"%s\"", arg);}
+            break;
+        case 'r': options->seed = strtoull(arg, NULL, 10); break;
+
+        case ARGP_KEY_ARG:
+            if (state->arg_num == 0) {
+                if (!parse_resolution(arg, &options->width, &options->height)) {argp_error(state, "Invalid resolution: \"%s\"", arg);}
+            } else if (state->arg_num == 1) {
+                if (!parse_resolution(arg, &options->scaled_width, &options->scaled_height)) {argp_error(state, "Invalid resolution: \"%s\"", arg);}
+            } else if (state->arg_num == 2) {
+                options->output_path = arg;
+            } else {
+                argp_usage(state);
+            }
+            break;
+        case ARGP_KEY_END:
+            if (state->arg_num < 3) {argp_usage(state);}
+            break;
+
+        default: return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = {options, parse_options, args_doc, doc, 0, 0, 0};
+
+int main(int argc, char **argv)
+{
+    struct options options;
+    memset(&options, 0, sizeof(options));
+    options.source = SOURCE_RANDOM;
+    options.origin = ORIGIN_CENTER;
+    options.seed = 1;
+    argp_parse(&argp, argc, argv, 0, 0, &options);
+
+    if (options.scaled_width < options.width || options.scaled_height < options.height) {
+        fprintf(stderr, "ERROR: The scaled resolution has to be at least as large as the original.\n");
+        return -1;
+    }
+
+    unsigned char* source = synthesize_source(options.width, options.height, options.source, options.seed);
+    unsigned char* scaled = source == NULL ? NULL : scale_nearest_neighbor(
+        source, options.width, options.height,
+        options.scaled_width, options.scaled_height, options.origin
+    );
+    if (scaled == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        return -1;
+    }
+    add_noise(scaled, 3 * options.scaled_width * options.scaled_height, options.noise, options.seed + 1);
+
+    if (write_image(options.output_path, scaled, options.scaled_width, options.scaled_height)) {
+        fprintf(stderr, "ERROR: Could not write \"%s\".\n", options.output_path);
+        return -1;
+    }
+    free(source);
+    free(scaled);
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include "synthesize.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+
+// How big each flat-shaded tile is in SOURCE_TILES images, and how many
+// colors there are to choose from.
+#define TILE_SIZE 8
+#define NUM_TILE_COLORS 16
+
+static size_t scaled_to_source(size_t scaled_i, size_t size, size_t scaled_size, enum scaling_origin origin);
+static uint64_t next_random(uint64_t* state);
+static int write_ppm(const char* path, const unsigned char* pixels, size_t width, size_t height);
+static int write_png(const char* path, const unsigned char* pixels, size_t width, size_t height);
+
+/*
+    Returns NULL if there isn't enough memory.
+*/
+unsigned char* synthesize_source(size_t width, size_t height, enum source_kind kind, uint64_t seed)
+{
+    unsigned char* pixels = (unsigned char*) malloc(3 * width * height * sizeof(unsigned char));
+    if (pixels == NULL) {return NULL;}
+    uint64_t state = seed;
+
+    if (kind == SOURCE_RANDOM) {
+        for (size_t i = 0; i < 3 * width * height; i++) {
+            pixels[i] = (unsigned char) next_random(&state);
+        }
+        return pixels;
+    }
+
+    unsigned char palette[NUM_TILE_COLORS][3];
+    for (size_t i = 0; i < NUM_TILE_COLORS; i++) {
+        for (int channel = 0; channel < 3; channel++) {
+            palette[i][channel] = (unsigned char) next_random(&state);
+        }
+    }
+    size_t tiles_across = (width + TILE_SIZE - 1) / TILE_SIZE;
+    size_t tiles_down = (height + TILE_SIZE - 1) / TILE_SIZE;
+    unsigned char* tiles = (unsigned char*) malloc(tiles_across * tiles_down * sizeof(unsigned char));
+    if (tiles == NULL) {
+        free(pixels);
+        return NULL;
+    }
+    for (size_t i = 0; i < tiles_across * tiles_down; i++) {
+        tiles[i] = (unsigned char) (next_random(&state) % NUM_TILE_COLORS);
+    }
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            const unsigned char* color = palette[tiles[(y / TILE_SIZE) * tiles_across + x / TILE_SIZE]];
+            memcpy(pixels + 3 * (y * width + x), color, 3);
+        }
+    }
+    free(tiles);
+
+    // Each channel of each pixel in the random row and column is 64 to 191
+    // away from the one before it, so that neighbors differ by more than
+    // any sensible --leeway.
+    size_t middle_row = height / 2;
+    size_t middle_column = width / 2;
+    unsigned char last[3] = {0, 0, 0};
+    for (size_t x = 0; x < width; x++) {
+        unsigned char* pixel = pixels + 3 * (middle_row * width + x);
+        for (int channel = 0; channel < 3; channel++) {
+            last[channel] += 64 + next_random(&state) % 128;
+            pixel[channel] = last[channel];
+        }
+    }
+    for (size_t y = 0; y < height; y++) {
+        unsigned char* pixel = pixels + 3 * (y * width + middle_column);
+        for (int channel = 0; channel < 3; channel++) {
+            last[channel] += 64 + next_random(&state) % 128;
+            pixel[channel] = last[channel];
+        }
+    }
+    return pixels;
+}
+
+/*
+    Returns NULL if there isn't enough memory. Only meant for scaling up.
+*/
+unsigned char* scale_nearest_neighbor(
+    const unsigned char* source, size_t width, size_t height,
+    size_t scaled_width, size_t scaled_height, enum scaling_origin origin
+)
+{
+    unsigned char* scaled = (unsigned char*) malloc(3 * scaled_width * scaled_height * sizeof(unsigned char));
+    size_t* source_columns = (size_t*) malloc(scaled_width * sizeof(size_t));
+    if (scaled == NULL || source_columns == NULL) {
+        free(scaled);
+        free(source_columns);
+        return NULL;
+    }
+    for (size_t x = 0; x < scaled_width; x++) {
+        source_columns[x] = scaled_to_source(x, width, scaled_width, origin);
+    }
+    for (size_t y = 0; y < scaled_height; y++) {
+        const unsigned char* source_row = source + 3 * width * scaled_to_source(y, height, scaled_height, origin);
+        unsigned char* scaled_row = scaled + 3 * scaled_width * y;
+        for (size_t x = 0; x < scaled_width; x++) {
+            memcpy(scaled_row + 3 * x, source_row + 3 * source_columns[x], 3);
+        }
+    }
+    free(source_columns);
+    return scaled;
+}
+
+/*
+    Nudges every channel of every pixel by up to amount either way, like
+    lossy compression or a capture card might.
+*/
+void add_noise(unsigned char* pixels, size_t size, int amount, uint64_t seed)
+{
+    if (amount <= 0) {return;}
+    uint64_t state = seed;
+    for (size_t i = 0; i < size; i++) {
+        int value = pixels[i] + (int) (next_random(&state) % (2 * amount + 1)) - amount;
+        pixels[i] = (unsigned char) (value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+}
+
+/*
+    Writes a PNG, or a PPM if the path ends in ".ppm". Returns nonzero if
+    the file couldn't be written.
+*/
+int write_image(const char* path, const unsigned char* pixels, size_t width, size_t height)
+{
+    size_t path_length = strlen(path);
+    if (path_length >= 4 && strcmp(path + path_length - 4, ".ppm") == 0) {
+        return write_ppm(path, pixels, width, height);
+    }
+    return write_png(path, pixels, width, height);
+}
+
+static size_t scaled_to_source(size_t scaled_i, size_t size, size_t scaled_size, enum scaling_origin origin)
+{
+    size_t i;
+    if (origin == ORIGIN_CENTER) {
+        i = ((2 * scaled_i + 1) * size) / (2 * scaled_size);
+    } else {
+        i = ((scaled_i + 1) * size) / scaled_size;
+    }
+    return i < size ? i : size - 1;
+}
+
+// xorshift64*, which is plenty random for this and the same everywhere.
+static uint64_t next_random(uint64_t* state)
+{
+    if (*state == 0) {*state = UINT64_C(0x9E3779B97F4A7C15);}
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (*state * UINT64_C(0x2545F4914F6CDD1D)) >> 32;
+}
+
+static int write_ppm(const char* path, const unsigned char* pixels, size_t width, size_t height)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {return 1;}
+    fprintf(file, "P6\n%zu %zu\n255\n", width, height);
+    fwrite(pixels, 1, 3 * width * height, file);
+    int error = ferror(file);
+    return (fclose(file) != 0) | error;
+}
+
+static int write_png(const char* path, const unsigned char* pixels, size_t width, size_t height)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = (png_uint_32) width;
+    image.height = (png_uint_32) height;
+    image.format = PNG_FORMAT_RGB;
+    return !png_image_write_to_file(&image, path, 0, pixels, 0, NULL);
+}
@@ -0,0 +1,38 @@
+/*
+    Making up screenshots with a known original resolution: a source image,
+    either random or made of flat-shaded tiles, scaled up with nearest
+    neighbor the way ImageMagick or Paint.net would (see "tests/Notes on
+    nearest-neighbor scaling"), and optionally with noise on top.
+*/
+#ifndef SYNTHESIZE_H
+#define SYNTHESIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum source_kind {
+    // Every pixel a random color.
+    SOURCE_RANDOM,
+    // Flat-shaded tiles, with one row and one column of random pixels
+    // running through them so that every column and row is still told
+    // apart from its neighbors, like a HUD over a tiled background.
+    SOURCE_TILES
+};
+
+enum scaling_origin {
+    // Sampling the center of each destination pixel, rounding up.
+    ORIGIN_CENTER,
+    // Sampling the bottom right corner of each destination pixel.
+    ORIGIN_BOTTOM_RIGHT
+};
+
+unsigned char* synthesize_source(size_t width, size_t height, enum source_kind kind, uint64_t seed);
+unsigned char* scale_nearest_neighbor(
+    const unsigned char* source, size_t width, size_t height,
+    size_t scaled_width, size_t scaled_height, enum scaling_origin origin
+);
+void add_noise(unsigned char* pixels, size_t size, int amount, uint64_t seed);
+
+int write_image(const char* path, const unsigned char* pixels, size_t width, size_t height);
+
+#endif
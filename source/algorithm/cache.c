@@ -0,0 +1,157 @@
+#include "algorithm/cache.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "algorithm/contrast_set.h"
+#include "algorithm/hash.h"
+#include "input/reader.h"
+
+// The first bytes of every entry. Bump the last one whenever the format
+// changes, so that older entries are simply missed rather than misread.
+static const char entry_signature[8] = {'p', 'i', 't', 't', 'a', 'r', 'i', 1};
+
+#define MAX_ENTRY_PATH_LENGTH 4096
+
+// If set, the directory screenshots' contrasts are cached in.
+const char* cache_directory = NULL;
+
+static bool make_entry_path(const struct cache_key* key, char path[MAX_ENTRY_PATH_LENGTH]);
+static bool read_contrast_set(FILE* entry, struct contrast_set* set);
+
+/*
+    Creates the directory if it doesn't exist yet. Returns false if it
+    can't be created.
+*/
+bool create_cache_directory(const char* directory)
+{
+#ifdef WIN64
+    int result = mkdir(directory);
+#else
+    int result = mkdir(directory, 0777);
+#endif
+    return result == 0 || errno == EEXIST;
+}
+
+/*
+    Hashes the image file, for scanning with the given leeway. Returns false
+    if it can't be read, or if the options in use can't be cached (in which
+    case there's no point in hashing it) – which goes for skimming frames,
+    since an entry is meant to hold everything in the file.
+*/
+bool make_cache_key(const char* image_path, unsigned char leeway, struct cache_key* key)
+{
+    if (max_frames > 0 || frame_stride > 1) {return false;}
+    key->leeway = leeway;
+    FILE* file = fopen(image_path, "rb");
+    if (file == NULL) {return false;}
+    bool hashed = hash_file(file, &key->hash, &key->size);
+    fclose(file);
+    return hashed;
+}
+
+bool make_cache_key_for_blob(const void* data, size_t size, unsigned char leeway, struct cache_key* key)
+{
+    if (max_frames > 0 || frame_stride > 1) {return false;}
+    key->leeway = leeway;
+    key->hash = hash_bytes(data, size);
+    key->size = size;
+    return true;
+}
+
+/*
+    Looks up an entry, reading the resolution of the screenshot it's for.
+    Returns NULL if there's no such entry. Otherwise, the contrasts have to
+    be read with read_cache_entry next, into sets of that size.
+*/
+FILE* open_cache_entry(const struct cache_key* key, size_t* width, size_t* height)
+{
+    char path[MAX_ENTRY_PATH_LENGTH];
+    if (!make_entry_path(key, path)) {return NULL;}
+    FILE* entry = fopen(path, "rb");
+    if (entry == NULL) {return NULL;}
+
+    char signature[sizeof(entry_signature)];
+    uint64_t dimensions[2];
+    if (
+        fread(signature, 1, sizeof(signature), entry) != sizeof(signature) ||
+        memcmp(signature, entry_signature, sizeof(signature)) != 0 ||
+        fread(dimensions, sizeof(uint64_t), 2, entry) != 2
+    ) {
+        fclose(entry);
+        return NULL;
+    }
+    *width = dimensions[0];
+    *height = dimensions[1];
+    return entry;
+}
+
+/*
+    Reads the contrasts from an entry opened with open_cache_entry, and
+    closes it. Returns false if the entry turns out to be broken.
+*/
+bool read_cache_entry(FILE* entry, struct contrast_set* columns, struct contrast_set* rows)
+{
+    bool read = read_contrast_set(entry, columns) && read_contrast_set(entry, rows) && fgetc(entry) == EOF;
+    fclose(entry);
+    return read;
+}
+
+/*
+    Stores the contrasts found in a screenshot. The cache is only ever an
+    optimization, so if the entry can't be written, it's silently skipped.
+*/
+void write_cache_entry(const struct cache_key* key, const struct contrast_set* columns, const struct contrast_set* rows)
+{
+    char path[MAX_ENTRY_PATH_LENGTH];
+    char temporary_path[MAX_ENTRY_PATH_LENGTH];
+    static size_t num_entries_written = 0;
+    size_t entry_number = __atomic_fetch_add(&num_entries_written, 1, __ATOMIC_RELAXED);
+    if (
+        !make_entry_path(key, path) ||
+        snprintf(temporary_path, MAX_ENTRY_PATH_LENGTH, "%s.%ld.%zu.tmp", path, (long) getpid(), entry_number) >= MAX_ENTRY_PATH_LENGTH
+    ) {
+        return;
+    }
+
+    FILE* entry = fopen(temporary_path, "wb");
+    if (entry == NULL) {return;}
+    uint64_t dimensions[2] = {columns->size, rows->size};
+    fwrite(entry_signature, 1, sizeof(entry_signature), entry);
+    fwrite(dimensions, sizeof(uint64_t), 2, entry);
+    fwrite(columns->words, sizeof(uint64_t), columns->num_words, entry);
+    fwrite(rows->words, sizeof(uint64_t), rows->num_words, entry);
+    bool written = !ferror(entry);
+    written = fclose(entry) == 0 && written;
+
+    // Renaming is atomic, so other processes either see the whole entry or
+    // none of it.
+    if (!written || rename(temporary_path, path) != 0) {
+        remove(temporary_path);
+    }
+}
+
+static bool make_entry_path(const struct cache_key* key, char path[MAX_ENTRY_PATH_LENGTH])
+{
+    int length = snprintf(
+        path, MAX_ENTRY_PATH_LENGTH, "%s/%016llx-%llx-%u",
+        cache_directory, (unsigned long long) key->hash, (unsigned long long) key->size, key->leeway
+    );
+    return length >= 0 && length < MAX_ENTRY_PATH_LENGTH;
+}
+
+static bool read_contrast_set(FILE* entry, struct contrast_set* set)
+{
+    if (fread(set->words, sizeof(uint64_t), set->num_words, entry) != set->num_words) {return false;}
+    // Keep the promise that the bits past the end are 0, whatever's in
+    // the file.
+    if (set->size % CONTRAST_WORD_BITS != 0) {
+        set->words[set->num_words - 1] &= ((uint64_t) 1 << (set->size % CONTRAST_WORD_BITS)) - 1;
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+/*
+    An on-disk cache of the contrasts found in each screenshot, so that one
+    that's been scanned before only has to be hashed, not decoded and
+    scanned all over again. Entries are keyed by a hash of the file's
+    contents plus the comparison options, and hold the screenshot's
+    resolution and its column and row contrast sets – from which the
+    dimensions (under any --nearest-neighbor-variation), as well as those of
+    any set of screenshots merged together, can be worked out without
+    touching the pixels.
+
+    Entries are written to a temporary file and renamed into place, so any
+    number of processes can share a cache directory. They're stored in the
+    machine's own byte order, so a cache can't be shared between machines
+    of different endianness.
+*/
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "algorithm/contrast_set.h"
+
+struct cache_key {
+    uint64_t hash;
+    uint64_t size;
+    unsigned char leeway;
+};
+
+extern const char* cache_directory;
+
+bool create_cache_directory(const char* directory);
+bool make_cache_key(const char* image_path, unsigned char leeway, struct cache_key* key);
+bool make_cache_key_for_blob(const void* data, size_t size, unsigned char leeway, struct cache_key* key);
+FILE* open_cache_entry(const struct cache_key* key, size_t* width, size_t* height);
+bool read_cache_entry(FILE* entry, struct contrast_set* columns, struct contrast_set* rows);
+void write_cache_entry(const struct cache_key* key, const struct contrast_set* columns, const struct contrast_set* rows);
+
+#endif
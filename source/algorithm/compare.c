@@ -1,43 +1,26 @@
 #include "algorithm/compare.h"
 
 #include <stdbool.h>
-#include <stdlib.h>
+
+// Setting these determines the pixel comparison used in contrast.c.
+enum pixel_comparison pixel_comparison = COMPARE_EXACT;
+int compare_pixel_fuzzy_fuzziness;
 
 /*
-    No fuzziness. Works for images that have been scaled with a nearest
-    neighbor algorithm.
+    The most any channel can differ by without the pixels differing: 0 for
+    exact comparisons. This is what lets the vectorized kernels in simd.c
+    stand in for comparing pixel by pixel.
 */
-bool compare_pixel_exact(unsigned char** pixel_1, unsigned char** pixel_2)
+unsigned char pixel_comparison_leeway(void)
 {
-    for (int channel = 0; channel < 3; channel++) {
-        if (*(*pixel_1)++ != *(*pixel_2)++) {
-            *pixel_1 += 3 - channel - 1;
-            *pixel_2 += 3 - channel - 1;
-            return true;
-        }
-    }
-    return false;
+    return comparison_leeway(pixel_comparison, compare_pixel_fuzzy_fuzziness);
 }
 
-/*
-    Allow some leeway in the R, G, and B values of each pixel. This is strictly
-    a per-channel affair – nothing along the lines of color distance – so its
-    fanciness is limited. Useful for images that appear to have been scaled
-    with a nearest neighbor algorithm, but apparently haven't – such as
-    "tests/254x231 fuzzy.png".
-*/
-int compare_pixel_fuzzy_fuzziness;
-bool compare_pixel_fuzzy(unsigned char** pixel_1, unsigned char** pixel_2)
+// The same as pixel_comparison_leeway, for any comparison and fuzziness.
+unsigned char comparison_leeway(enum pixel_comparison comparison, int fuzziness)
 {
-    for (int channel = 0; channel < 3; channel++) {
-        if (abs((int) *(*pixel_1)++ - (int) *(*pixel_2)++) > compare_pixel_fuzzy_fuzziness) {
-            *pixel_1 += 3 - channel - 1;
-            *pixel_2 += 3 - channel - 1;
-            return true;
-        }
-    }
-    return false;
+    if (comparison == COMPARE_EXACT || fuzziness < 0) {return 0;}
+    // No two bytes differ by more than 255, so anything above that is the
+    // same as 255.
+    return fuzziness > 255 ? 255 : (unsigned char) fuzziness;
 }
-
-// Setting this determines the pixel comparison algorithm used in contrast.c.
-bool (*compare_pixel)(unsigned char**, unsigned char**) = compare_pixel_exact;
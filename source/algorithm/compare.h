@@ -1,16 +1,51 @@
 /*
-    Functions for comparing two pixels to determine whether the second pixel
-    should be deemed to start a new row/column in the image at 1:1 scale.
+    How two pixels are compared to determine whether the second pixel should
+    be deemed to start a new row/column in the image at 1:1 scale.
+
+    Rather than a function that's called for every pair of pixels, each
+    comparison is inlined into scan loops of its own (see contrast.c), so
+    choosing one only picks which loops a scan goes through.
 */
 #ifndef COMPARE_H
 #define COMPARE_H
 
 #include <stdbool.h>
 
-bool compare_pixel_exact(unsigned char** pixel_1, unsigned char** pixel_2);
-bool compare_pixel_fuzzy(unsigned char** pixel_1, unsigned char** pixel_2);
-extern bool (*compare_pixel)(unsigned char**, unsigned char**);
+enum pixel_comparison {
+    /*
+        No fuzziness. Works for images that have been scaled with a nearest
+        neighbor algorithm.
+    */
+    COMPARE_EXACT,
+    /*
+        Allow some leeway (compare_pixel_fuzzy_fuzziness) in the R, G, and
+        B values of each pixel. This is strictly a per-channel affair –
+        nothing along the lines of color distance – so its fanciness is
+        limited. Useful for images that appear to have been scaled with a
+        nearest neighbor algorithm, but apparently haven't – such as
+        "tests/254x231 fuzzy.png".
+    */
+    COMPARE_FUZZY
+};
 
+extern enum pixel_comparison pixel_comparison;
 extern int compare_pixel_fuzzy_fuzziness;
 
+unsigned char pixel_comparison_leeway(void);
+unsigned char comparison_leeway(enum pixel_comparison comparison, int fuzziness);
+
+static inline bool pixels_differ_exact(const unsigned char* pixel_1, const unsigned char* pixel_2)
+{
+    return pixel_1[0] != pixel_2[0] || pixel_1[1] != pixel_2[1] || pixel_1[2] != pixel_2[2];
+}
+
+static inline bool pixels_differ_fuzzy(const unsigned char* pixel_1, const unsigned char* pixel_2, unsigned char leeway)
+{
+    for (int channel = 0; channel < 3; channel++) {
+        int difference = pixel_1[channel] - pixel_2[channel];
+        if (difference > leeway || -difference > leeway) {return true;}
+    }
+    return false;
+}
+
 #endif
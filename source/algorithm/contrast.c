@@ -2,80 +2,1134 @@
 
 #include <stdbool.h>
 #include <stddef.h>
-#ifdef IMAGEMAGICK_7
-#include <MagickWand/MagickWand.h>
-#endif
-#ifdef IMAGEMAGICK_6
-#include <wand/MagickWand.h>
-#endif
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "algorithm/compare.h"
+#include "algorithm/contrast_set.h"
+#include "algorithm/dimensions.h"
+#include "algorithm/hash.h"
+#include "algorithm/pool.h"
+#include "algorithm/simd.h"
+#include "input/reader.h"
+#include "stats/stats.h"
 
-int update_contrasts_from_wand(size_t width, bool column_contrasts[], size_t height, bool row_contrasts[], unsigned char pixels[], MagickWand* wand)
+// How many rows the vectorized column scan goes through between each time
+// it checks which columns have been decided.
+#define COLUMN_BLOCK_ROWS 16
+// The vectorized column scan compares every column, decided or not, so once
+// fewer than 1 in this many are left undecided, it's quicker to just
+// compare those one by one.
+#define SPARSE_COLUMNS_RATIO 8
+// Rows are scanned in tiles of about this many bytes – small enough that a
+// tile's still in cache (L2, on most CPUs) by the time its rows have been
+// compared to each other as well as each pixel to the one left of it.
+#define SCAN_TILE_SIZE (256 * 1024)
+// Splitting an image into bands any thinner than this isn't worth the
+// overhead of spreading them out over threads.
+#define MIN_BAND_ROWS 64
+// Fingerprinting rows takes about as long as scanning them, so once fewer
+// than 1 in this many rows of a frame turn out unchanged, it's put off for
+// this many frames.
+#define MIN_UNCHANGED_RATIO 8
+#define FINGERPRINTING_RETRY_FRAMES 16
+// When scanning progressively, rows are sampled in bands of this many, and
+// columns in slabs of this many – contiguous, so that they're scanned the
+// same way (and as quickly) as whole images are. The first round looks at
+// every this-many-th band and slab, and each round after that halves the
+// gap – until it's down to this, at which point it's quicker to just scan
+// the rest.
+#define SAMPLE_BAND_ROWS COLUMN_BLOCK_ROWS
+#define SAMPLE_SLAB_COLUMNS 32
+#define FIRST_SAMPLE_STEP 64
+#define LAST_SAMPLE_STEP 8
+
+struct band_scan {
+    struct contrasts** bands;
+    size_t band_height;
+    size_t first_row;
+    size_t height;
+    unsigned char* pixels;
+};
+
+// If nonzero, images are exported and scanned this many rows at a time.
+size_t scan_strip_height = 0;
+// If set, whole images are scanned a sample of rows and columns at a time,
+// stopping as soon as the dimensions settle.
+bool scan_progressively = false;
+// If set, only this region of each image is scanned. Failing that, if
+// trim_borders is set, the first image's uniform borders are left out.
+struct scan_region scan_region = {0, 0, 0, 0};
+bool trim_borders = false;
+
+static int scan_frame(struct contrasts* contrasts, unsigned char pixels[], struct image_reader* reader);
+static int settle_scan_region(struct contrasts* contrasts, const unsigned char* pixels);
+static void find_uniform_borders(const unsigned char* pixels, size_t width, size_t height, size_t pixel_size, unsigned char leeway, struct scan_region* region);
+static bool row_is_uniform(const unsigned char* row, size_t width, const unsigned char* color, size_t pixel_size, unsigned char leeway);
+static bool column_is_uniform(const unsigned char* column, size_t row_stride, size_t height, const unsigned char* color, size_t pixel_size, unsigned char leeway);
+static inline bool pixel_differs_from_color(const unsigned char* pixel, const unsigned char* color, size_t pixel_size, unsigned char leeway);
+static void update_contrasts_progressively(struct contrasts* contrasts, unsigned char* pixels);
+static size_t update_row_contrasts_from_sampled_slabs(struct contrasts* contrasts, unsigned char* pixels, size_t first_slab, size_t slab_step);
+static bool update_contrasts_from_pixels_in_bands(struct contrasts* contrasts, size_t first_row, size_t height, unsigned char* pixels);
+static bool dimension_settled(const struct contrast_set* set, int max_variation, size_t* last_size);
+static bool rows_left_to_scan(const struct contrasts* contrasts, size_t first_row);
+static bool can_scan_while_reading(const struct contrasts* contrasts);
+static int read_and_scan_in_tiles(struct contrasts* contrasts, unsigned char* pixels, struct image_reader* reader);
+static void update_contrasts_from_pixels_in_tiles(struct contrasts* contrasts, size_t first_row, size_t height, unsigned char* pixels);
+static size_t scan_tile_rows(const struct contrasts* contrasts);
+static size_t update_column_contrasts_from_rows(struct contrasts* contrasts, size_t height, unsigned char* pixels, unsigned char* differences);
+static unsigned char* create_column_differences(const struct contrasts* contrasts);
+static void scan_band(void* band_scan_pointer, size_t index);
+static struct contrasts* create_band_contrasts(const struct contrasts* contrasts, size_t first_row, size_t height);
+static size_t update_row_contrasts_from_pixels_simd(struct contrasts* contrasts, size_t first_row, size_t* undecided, size_t num_undecided, unsigned char* pixels);
+static size_t find_first_undecided(const size_t* undecided, size_t num_undecided, size_t index);
+static void start_frame(struct contrasts* contrasts);
+static void destroy_band_contrasts(struct contrasts* band);
+static void find_unchanged_rows(struct contrasts* contrasts, size_t first_row, size_t height, const unsigned char* pixels, bool* unchanged, bool record);
+static inline uint64_t fingerprint_row(const unsigned char* row, size_t size);
+static void mark_differing_columns_exact(struct contrasts* contrasts, const unsigned char* row);
+static void mark_differing_columns_fuzzy(struct contrasts* contrasts, const unsigned char* row);
+static void mark_differing_columns_indexed(struct contrasts* contrasts, const unsigned char* row);
+
+/*
+    The loops that go pixel by pixel, rather than through runs of bytes
+    (see simd.h), have an instance for each pixel comparison – and one for
+    palette indices – so that the comparison is inlined into them. A scan
+    looks up the instances once, and from then on, nothing's decided per
+    pixel.
+*/
+struct pixel_loops {
+    // Compares the undecided columns in a row to the ones left of them.
+    void (*mark_differing_columns)(struct contrasts* contrasts, const unsigned char* row);
+};
+
+static const struct pixel_loops pixel_loops[] = {
+    [COMPARE_EXACT] = {mark_differing_columns_exact},
+    [COMPARE_FUZZY] = {mark_differing_columns_fuzzy}
+};
+
+static const struct pixel_loops indexed_pixel_loops = {mark_differing_columns_indexed};
+
+static inline const struct pixel_loops* select_pixel_loops(const struct contrasts* contrasts)
 {
-    MagickResetIterator(wand);
-    while (MagickNextImage(wand) != MagickFalse) {
-        int error = update_contrasts_from_image(width, column_contrasts, height, row_contrasts, pixels, wand);
+    return contrasts->pixel_size == 1 ? &indexed_pixel_loops : &pixel_loops[contrasts->comparison];
+}
+
+/*
+    Returns NULL if there isn't enough memory.
+*/
+struct contrasts* create_contrasts(size_t width, size_t height)
+{
+    struct contrasts* contrasts = (struct contrasts*) calloc(1, sizeof(struct contrasts));
+    if (contrasts == NULL) {return NULL;}
+    contrasts->columns = create_contrast_set(width);
+    contrasts->rows = create_contrast_set(height);
+    contrasts->frame_width = width;
+    contrasts->frame_height = height;
+    contrasts->pixel_size = 3;
+    contrasts->undecided_columns = (size_t*) malloc((width ? width : 1) * sizeof(size_t));
+    contrasts->undecided_rows = (size_t*) malloc((height ? height : 1) * sizeof(size_t));
+    if (
+        contrasts->columns == NULL || contrasts->rows == NULL ||
+        contrasts->undecided_columns == NULL || contrasts->undecided_rows == NULL
+    ) {
+        destroy_contrasts(contrasts);
+        return NULL;
+    }
+
+    // Since the leftmost / top pixel in a scaled image always starts
+    // a new pixel in the source image.
+    mark_contrast(contrasts->columns, 0);
+    mark_contrast(contrasts->rows, 0);
+    refresh_undecided(contrasts);
+    // Not the first frame – see start_frame.
+    contrasts->frames_until_fingerprinting = 1;
+    use_global_settings(contrasts);
+    return contrasts;
+}
+
+/*
+    Forget everything that's been scanned so far – the region scanned
+    included – so that the same contrasts can be reused for another image of
+    the same size. Their settings are left as they are.
+*/
+void reset_contrasts(struct contrasts* contrasts)
+{
+    resize_contrast_set(contrasts->columns, contrasts->frame_width);
+    resize_contrast_set(contrasts->rows, contrasts->frame_height);
+    contrasts->region_x = 0;
+    contrasts->region_y = 0;
+    contrasts->region_settled = false;
+    mark_contrast(contrasts->columns, 0);
+    mark_contrast(contrasts->rows, 0);
+    refresh_undecided(contrasts);
+    contrasts->fingerprinting = false;
+    contrasts->num_fingerprinted_frames = 0;
+    contrasts->frames_until_fingerprinting = 1;
+    contrasts->num_pixels = 0;
+    contrasts->num_pixels_touched = 0;
+}
+
+void destroy_contrasts(struct contrasts* contrasts)
+{
+    if (contrasts == NULL) {return;}
+    destroy_contrast_set(contrasts->columns);
+    destroy_contrast_set(contrasts->rows);
+    free(contrasts->undecided_columns);
+    free(contrasts->undecided_rows);
+    free(contrasts->row_fingerprints);
+    free(contrasts->last_row_fingerprints);
+    free(contrasts);
+}
+
+/*
+    Take the settings from pixel_comparison (and
+    compare_pixel_fuzzy_fuzziness), nearest_neighbor_max_variation,
+    scan_progressively, scan_region and trim_borders.
+*/
+void use_global_settings(struct contrasts* contrasts)
+{
+    contrasts->comparison = pixel_comparison;
+    contrasts->leeway = pixel_comparison_leeway();
+    contrasts->nearest_neighbor_max_variation = nearest_neighbor_max_variation;
+    contrasts->progressive = scan_progressively;
+    contrasts->region = scan_region;
+    contrasts->trim_borders = trim_borders;
+}
+
+/*
+    Rebuild the lists of undecided columns and rows from the contrast sets.
+    Needed whenever the sets have been changed by something other than the
+    functions in this file – merging in another set, for example.
+*/
+void refresh_undecided(struct contrasts* contrasts)
+{
+    contrasts->num_undecided_columns = 0;
+    for (size_t x = 0; x < contrasts->columns->size; x++) {
+        if (!has_contrast(contrasts->columns, x)) {
+            contrasts->undecided_columns[contrasts->num_undecided_columns++] = x;
+        }
+    }
+    contrasts->num_undecided_rows = 0;
+    for (size_t y = 0; y < contrasts->rows->size; y++) {
+        if (!has_contrast(contrasts->rows, y)) {
+            contrasts->undecided_rows[contrasts->num_undecided_rows++] = y;
+        }
+    }
+}
+
+/*
+    How many bytes of pixels update_contrasts_from_image needs to work with
+    for an image of the given size – the whole image, or one strip plus the
+    row above it if scan_strip_height is set.
+*/
+size_t scan_buffer_size(size_t width, size_t height)
+{
+    size_t num_rows = height;
+    if (scan_strip_height > 0 && scan_strip_height < height) {
+        num_rows = scan_strip_height + 1;
+    }
+    return 3 * width * num_rows;
+}
+
+/*
+    Whether every column and row has been marked, meaning that scanning any
+    more pixels can't possibly change anything.
+*/
+bool contrasts_saturated(const struct contrasts* contrasts)
+{
+    return contrasts->num_undecided_columns == 0 && contrasts->num_undecided_rows == 0;
+}
+
+/*
+    Whether contrasts are to be scanned progressively: when asked to, unless
+    there's leeway. Noise turns up contrasts wherever it's looked for, so a
+    sample that's settled can still be missing some that change the
+    dimensions.
+*/
+bool scans_progressively(const struct contrasts* contrasts)
+{
+    return contrasts->progressive && contrasts->leeway == 0;
+}
+
+/*
+    Scan the reader's current frame and every frame after it – one at a
+    time, stopping as soon as there's nothing more they could tell. When
+    scanning progressively, that's as soon as a frame doesn't change the
+    dimensions, the same as with a frame's rows and columns. Returns
+    SCAN_WRONG_SIZE, SCAN_READ_FAILED, SCAN_REGION_OUTSIDE or
+    SCAN_OUT_OF_MEMORY if something goes wrong.
+*/
+int update_contrasts_from_reader(struct contrasts* contrasts, unsigned char pixels[], struct image_reader* reader)
+{
+    size_t last_width = 0;
+    size_t last_height = 0;
+    do {
+        if (contrasts_saturated(contrasts)) {return 0;}
+        if (scans_progressively(contrasts) && dimensions_settled(contrasts, &last_width, &last_height)) {return 0;}
+        int error = update_contrasts_from_image(contrasts, pixels, reader);
         if (error) {return error;}
+    } while (next_frame(reader));
+    return reader->error_description[0] ? SCAN_READ_FAILED : 0;
+}
+
+/*
+    Scans the reader's current frame. Exact comparisons only go by whether
+    two pixels are the same color, which palette indices tell just as well
+    as RGB does – in a third of the bytes – so frames with a palette are
+    read and scanned as indices instead.
+*/
+int update_contrasts_from_image(struct contrasts* contrasts, unsigned char pixels[], struct image_reader* reader)
+{
+    if (reader->width != contrasts->frame_width || reader->height != contrasts->frame_height) {return SCAN_WRONG_SIZE;}
+
+    bool indexed = reader->frame_pixels == NULL && contrasts->comparison == COMPARE_EXACT && use_palette_indices(reader);
+    contrasts->pixel_size = indexed ? 1 : 3;
+    int error = scan_frame(contrasts, pixels, reader);
+    contrasts->pixel_size = 3;
+    return error;
+}
+
+static int scan_frame(struct contrasts* contrasts, unsigned char pixels[], struct image_reader* reader)
+{
+    // A frame that's in memory as it is gets scanned right there – all of
+    // it at once, strips or not, since that doesn't take any memory of its
+    // own. It's only ever read from.
+    if (reader->frame_pixels != NULL) {
+        return update_contrasts_from_whole_image(contrasts, (unsigned char*) reader->frame_pixels);
+    }
+
+    if (scan_strip_height == 0 || scan_strip_height >= reader->height) {
+        if (can_scan_while_reading(contrasts)) {return read_and_scan_in_tiles(contrasts, pixels, reader);}
+        if (read_rows(reader, 0, reader->height, pixels)) {return SCAN_READ_FAILED;}
+        return update_contrasts_from_whole_image(contrasts, pixels);
+    }
+
+    // Strips only ever hold part of the image, so there are no borders to
+    // trim – just a region to keep to, if there's one.
+    int error = settle_scan_region(contrasts, NULL);
+    if (error) {return error;}
+    size_t width = contrasts->columns->size;
+    size_t height = contrasts->rows->size;
+
+    // Each strip goes right after the last row of the previous one, so that
+    // the first row of the strip can be compared to the one above it.
+    start_frame(contrasts);
+    size_t row_size = contrasts->pixel_size * contrasts->frame_width;
+    unsigned char* strip = pixels + row_size;
+    // Rows can only be read in order, so the ones above the region are read
+    // a strip at a time too, and thrown away.
+    for (size_t first_row = 0; first_row < contrasts->region_y; first_row += scan_strip_height) {
+        size_t rows_left = contrasts->region_y - first_row;
+        if (read_rows(reader, first_row, rows_left < scan_strip_height ? rows_left : scan_strip_height, strip)) {return SCAN_READ_FAILED;}
     }
+    for (size_t first_row = 0; first_row < height && rows_left_to_scan(contrasts, first_row); first_row += scan_strip_height) {
+        size_t strip_height = height - first_row < scan_strip_height ? height - first_row : scan_strip_height;
+        if (read_rows(reader, contrasts->region_y + first_row, strip_height, strip)) {return SCAN_READ_FAILED;}
+        enter_stats_phase(STATS_SCAN);
+        update_contrasts_from_pixels(contrasts, first_row, strip_height, strip + contrasts->pixel_size * contrasts->region_x);
+        memcpy(pixels, strip + row_size * (strip_height - 1), row_size);
+        leave_stats_phase();
+        contrasts->num_pixels_touched += width * strip_height;
+    }
+    contrasts->num_pixels += width * height;
+
+    return 0;
+}
+
+/*
+    Scan a whole image, which pixels holds all of – progressively, if
+    scans_progressively says to. Returns SCAN_REGION_OUTSIDE or
+    SCAN_OUT_OF_MEMORY if the region to scan can't be settled on.
+*/
+int update_contrasts_from_whole_image(struct contrasts* contrasts, unsigned char* pixels)
+{
+    int error = settle_scan_region(contrasts, pixels);
+    if (error) {return error;}
+    pixels += contrasts->pixel_size * (contrasts->frame_width * contrasts->region_y + contrasts->region_x);
+    size_t width = contrasts->columns->size;
+    size_t height = contrasts->rows->size;
+    start_frame(contrasts);
+    enter_stats_phase(STATS_SCAN);
+    contrasts->num_pixels += width * height;
+    if (scans_progressively(contrasts)) {
+        update_contrasts_progressively(contrasts, pixels);
+    } else {
+        update_contrasts_from_pixels(contrasts, 0, height, pixels);
+        contrasts->num_pixels_touched += width * height;
+    }
+    leave_stats_phase();
     return 0;
 }
 
-int update_contrasts_from_image(size_t width, bool column_contrasts[], size_t height, bool row_contrasts[], unsigned char pixels[], MagickWand* wand)
+/*
+    Whether update_contrasts_from_image can scan a frame tile by tile as it
+    reads it, rather than reading all of it first. That's the same as
+    scanning it all at once, except when the rows are to be split up over a
+    pool or sampled, or when the first frame's borders are yet to be
+    trimmed – all of which need the whole frame at hand.
+*/
+static bool can_scan_while_reading(const struct contrasts* contrasts)
 {
-    size_t cur_width = MagickGetImageWidth(wand);
-    size_t cur_height = MagickGetImageHeight(wand);
-    if (cur_width != width || cur_height != height) {return 1;}
+    return
+        contrasts->pool == NULL && !scans_progressively(contrasts) &&
+        (contrasts->region_settled || !contrasts->trim_borders);
+}
 
-    MagickExportImagePixels(wand, 0, 0, width, height, "RGB", CharPixel, pixels);
+/*
+    Reads the reader's whole frame into pixels, scanning each tile of rows
+    right after it's read, while it's still in cache. Every row is read
+    even once there's nothing left to scan, so that pixels ends up holding
+    the frame all the same.
+*/
+static int read_and_scan_in_tiles(struct contrasts* contrasts, unsigned char* pixels, struct image_reader* reader)
+{
+    int error = settle_scan_region(contrasts, NULL);
+    if (error) {return error;}
+    size_t width = contrasts->columns->size;
+    size_t height = contrasts->rows->size;
+    size_t row_size = contrasts->pixel_size * contrasts->frame_width;
+    size_t tile_rows = scan_tile_rows(contrasts);
+    unsigned char* region_pixels = pixels + row_size * contrasts->region_y;
 
-    update_column_contrasts_from_pixels(width, column_contrasts, height, pixels);
-    update_row_contrasts_from_pixels(width, height, row_contrasts, pixels);
+    start_frame(contrasts);
+    if (read_rows(reader, 0, contrasts->region_y, pixels)) {return SCAN_READ_FAILED;}
+    for (size_t first_row = 0; first_row < height; first_row += tile_rows) {
+        size_t num_rows = height - first_row < tile_rows ? height - first_row : tile_rows;
+        unsigned char* tile = region_pixels + row_size * first_row;
+        if (read_rows(reader, contrasts->region_y + first_row, num_rows, tile)) {return SCAN_READ_FAILED;}
+        if (rows_left_to_scan(contrasts, first_row)) {
+            enter_stats_phase(STATS_SCAN);
+            update_contrasts_from_pixels_in_tiles(contrasts, first_row, num_rows, tile + contrasts->pixel_size * contrasts->region_x);
+            leave_stats_phase();
+        }
+    }
+    size_t rows_below = contrasts->frame_height - contrasts->region_y - height;
+    if (read_rows(reader, contrasts->region_y + height, rows_below, region_pixels + row_size * height)) {return SCAN_READ_FAILED;}
 
+    contrasts->num_pixels += width * height;
+    contrasts->num_pixels_touched += width * height;
     return 0;
 }
 
-void update_column_contrasts_from_pixels(size_t width, bool column_contrasts[], size_t height, unsigned char* pixels)
+/*
+    Before the first frame's scanned, narrows the contrasts down to the
+    region of it that's to be scanned: the one asked for, or – given the
+    frame's pixels, and if asked to – what's left once its uniform borders
+    have been trimmed off. Returns SCAN_REGION_OUTSIDE if the region asked
+    for doesn't fit in the frame.
+*/
+static int settle_scan_region(struct contrasts* contrasts, const unsigned char* pixels)
+{
+    if (contrasts->region_settled) {return 0;}
+    contrasts->region_settled = true;
+
+    struct scan_region region = contrasts->region;
+    if (region.width > 0) {
+        if (
+            region.x > contrasts->frame_width || region.width > contrasts->frame_width - region.x ||
+            region.y > contrasts->frame_height || region.height > contrasts->frame_height - region.y
+        ) {
+            return SCAN_REGION_OUTSIDE;
+        }
+    } else if (contrasts->trim_borders && pixels != NULL) {
+        find_uniform_borders(pixels, contrasts->frame_width, contrasts->frame_height, contrasts->pixel_size, contrasts->leeway, &region);
+    } else {
+        return 0;
+    }
+    if (region.width == contrasts->frame_width && region.height == contrasts->frame_height) {return 0;}
+
+    contrasts->region_x = region.x;
+    contrasts->region_y = region.y;
+    resize_contrast_set(contrasts->columns, region.width);
+    resize_contrast_set(contrasts->rows, region.height);
+    mark_contrast(contrasts->columns, 0);
+    mark_contrast(contrasts->rows, 0);
+    refresh_undecided(contrasts);
+    return 0;
+}
+
+/*
+    Finds what's left of an image once its borders – any number of rows or
+    columns, from each edge inward, that are all the same color – are left
+    out. That's letterboxing, overscan, or the backdrop around an emulator's
+    screen. The borders always end where a new source pixel starts, so
+    leaving them out never moves a contrast. If the whole image is one
+    color, none of it is left out.
+
+    Each edge only goes as far as its first row or column with anything
+    else in it, so this touches little more than the borders themselves.
+*/
+static void find_uniform_borders(const unsigned char* pixels, size_t width, size_t height, size_t pixel_size, unsigned char leeway, struct scan_region* region)
+{
+    region->x = 0;
+    region->y = 0;
+    region->width = width;
+    region->height = height;
+    if (width == 0 || height == 0) {return;}
+    size_t row_size = pixel_size * width;
+
+    size_t top = 0;
+    while (top < height && row_is_uniform(pixels + row_size * top, width, pixels, pixel_size, leeway)) {top++;}
+    if (top == height) {return;}
+    size_t bottom = height;
+    const unsigned char* bottom_color = pixels + row_size * (height - 1);
+    while (bottom > top && row_is_uniform(pixels + row_size * (bottom - 1), width, bottom_color, pixel_size, leeway)) {bottom--;}
+
+    const unsigned char* first_row = pixels + row_size * top;
+    size_t left = 0;
+    while (left < width && column_is_uniform(first_row + pixel_size * left, row_size, bottom - top, first_row, pixel_size, leeway)) {left++;}
+    size_t right = width;
+    const unsigned char* right_color = first_row + pixel_size * (width - 1);
+    while (right > left && column_is_uniform(first_row + pixel_size * (right - 1), row_size, bottom - top, right_color, pixel_size, leeway)) {right--;}
+
+    region->x = left;
+    region->y = top;
+    region->width = right - left;
+    region->height = bottom - top;
+}
+
+static bool row_is_uniform(const unsigned char* row, size_t width, const unsigned char* color, size_t pixel_size, unsigned char leeway)
+{
+    for (size_t x = 0; x < width; x++) {
+        if (pixel_differs_from_color(row + pixel_size * x, color, pixel_size, leeway)) {return false;}
+    }
+    return true;
+}
+
+static bool column_is_uniform(const unsigned char* column, size_t row_stride, size_t height, const unsigned char* color, size_t pixel_size, unsigned char leeway)
 {
-    unsigned char* left_pixel = pixels;
-    unsigned char* cur_pixel = pixels + 3;
     for (size_t y = 0; y < height; y++) {
-        for (size_t x = 1; x < width; x++) {
-            if (column_contrasts[x]) {
-                left_pixel += 3;
-                cur_pixel += 3;
+        if (pixel_differs_from_color(column + row_stride * y, color, pixel_size, leeway)) {return false;}
+    }
+    return true;
+}
+
+// Palette indices only ever come with exact comparisons, so there's no
+// leeway for them.
+static inline bool pixel_differs_from_color(const unsigned char* pixel, const unsigned char* color, size_t pixel_size, unsigned char leeway)
+{
+    return pixel_size == 1 ? *pixel != *color : pixels_differ_fuzzy(pixel, color, leeway);
+}
+
+/*
+    Scan an evenly spaced sample of the image's rows (for column contrasts)
+    and columns (for row contrasts), and keep filling in the gaps between
+    them, halving them each round, until the dimensions settle: that is,
+    when two rounds in a row come up with the same size, with every run
+    being within nearest_neighbor_max_variation of each other (i.e. no
+    contrasts look to be missing). If they don't settle before the gaps get
+    small, the rows that haven't been scanned yet are scanned after all.
+
+    Rows are sampled a band at a time, each of which is scanned the same way
+    as a whole image (see update_contrasts_from_pixels), so they're no waste
+    if it comes to scanning the rest. That's done until the width settles,
+    and only then are columns sampled – a slab at a time, for the row
+    contrasts between the bands – until the height does too.
+*/
+static void update_contrasts_progressively(struct contrasts* contrasts, unsigned char* pixels)
+{
+    size_t width = contrasts->columns->size;
+    size_t height = contrasts->rows->size;
+    size_t row_size = contrasts->pixel_size * contrasts->frame_width;
+    size_t num_bands = (height + SAMPLE_BAND_ROWS - 1) / SAMPLE_BAND_ROWS;
+    int max_variation = contrasts->nearest_neighbor_max_variation;
+    size_t last_width = 0;
+    size_t last_height = 0;
+    size_t num_rows_touched = 0;
+    size_t num_columns_touched = 0;
+
+    // The first round starts from the first band (or slab). Each one after
+    // that goes through the ones halfway between those already scanned.
+    size_t step = FIRST_SAMPLE_STEP;
+    bool settled;
+    while (true) {
+        size_t first = step == FIRST_SAMPLE_STEP ? 0 : step;
+        size_t stride = step == FIRST_SAMPLE_STEP ? step : 2 * step;
+        for (size_t band = first; band < num_bands; band += stride) {
+            size_t y = band * SAMPLE_BAND_ROWS;
+            size_t band_height = height - y < SAMPLE_BAND_ROWS ? height - y : SAMPLE_BAND_ROWS;
+            update_contrasts_from_pixels(contrasts, y, band_height, pixels + row_size * y);
+            num_rows_touched += band_height;
+        }
+        settled = dimension_settled(contrasts->columns, max_variation, &last_width);
+        if (settled || contrasts_saturated(contrasts) || step == LAST_SAMPLE_STEP) {break;}
+        step /= 2;
+    }
+
+    if (settled && !contrasts_saturated(contrasts)) {
+        settled = false;
+        for (size_t slab_step = FIRST_SAMPLE_STEP; !settled; slab_step /= 2) {
+            size_t first = slab_step == FIRST_SAMPLE_STEP ? 0 : slab_step;
+            size_t stride = slab_step == FIRST_SAMPLE_STEP ? slab_step : 2 * slab_step;
+            num_columns_touched += update_row_contrasts_from_sampled_slabs(contrasts, pixels, first, stride);
+            settled = dimension_settled(contrasts->rows, max_variation, &last_height);
+            if (slab_step == LAST_SAMPLE_STEP) {break;}
+        }
+    }
+
+    if (settled || contrasts_saturated(contrasts)) {
+        contrasts->num_pixels_touched +=
+            num_rows_touched * width + num_columns_touched * height -
+            num_rows_touched * num_columns_touched;
+        return;
+    }
+
+    // By now, every step-th band has been scanned, so it's the runs of bands
+    // between those that are left.
+    for (size_t band = 0; band < num_bands && rows_left_to_scan(contrasts, 0); band += step) {
+        size_t first_row = (band + 1) * SAMPLE_BAND_ROWS;
+        size_t end_row = (band + step) * SAMPLE_BAND_ROWS < height ? (band + step) * SAMPLE_BAND_ROWS : height;
+        if (first_row >= end_row) {continue;}
+        update_contrasts_from_pixels(contrasts, first_row, end_row - first_row, pixels + row_size * first_row);
+    }
+    contrasts->num_pixels_touched += width * height;
+}
+
+/*
+    Compares the undecided rows to the rows above them, but only within the
+    slabs of columns from first_slab on, slab_step apart. Returns how many
+    columns that is.
+*/
+static size_t update_row_contrasts_from_sampled_slabs(struct contrasts* contrasts, unsigned char* pixels, size_t first_slab, size_t slab_step)
+{
+    size_t width = contrasts->columns->size;
+    size_t num_slabs = (width + SAMPLE_SLAB_COLUMNS - 1) / SAMPLE_SLAB_COLUMNS;
+    if (first_slab >= num_slabs || contrasts->num_undecided_rows == 0) {return 0;}
+    size_t pixel_size = contrasts->pixel_size;
+    size_t row_size = pixel_size * contrasts->frame_width;
+    unsigned char leeway = contrasts->leeway;
+
+    size_t num_columns = 0;
+    for (size_t slab = first_slab; slab < num_slabs; slab += slab_step) {
+        size_t x = slab * SAMPLE_SLAB_COLUMNS;
+        num_columns += width - x < SAMPLE_SLAB_COLUMNS ? width - x : SAMPLE_SLAB_COLUMNS;
+    }
+    count_stats(STATS_PIXELS_COMPARED, contrasts->num_undecided_rows * num_columns);
+
+    size_t* undecided = contrasts->undecided_rows;
+    size_t num_still_undecided = 0;
+    for (size_t i = 0; i < contrasts->num_undecided_rows; i++) {
+        size_t y = undecided[i];
+        const unsigned char* cur_row = pixels + row_size * y;
+        bool differs = false;
+        for (size_t slab = first_slab; slab < num_slabs && !differs; slab += slab_step) {
+            size_t x = slab * SAMPLE_SLAB_COLUMNS;
+            size_t slab_width = width - x < SAMPLE_SLAB_COLUMNS ? width - x : SAMPLE_SLAB_COLUMNS;
+            differs = any_difference(cur_row - row_size + pixel_size * x, cur_row + pixel_size * x, pixel_size * slab_width, leeway);
+        }
+        if (differs) {
+            mark_contrast(contrasts->rows, y);
+        } else {
+            undecided[num_still_undecided++] = y;
+        }
+    }
+    contrasts->num_undecided_rows = num_still_undecided;
+    return num_columns;
+}
+
+/*
+    Whether the contrasts found so far give the same dimensions as last
+    time (which are then updated), with no runs that look like they're
+    hiding a missed contrast.
+*/
+bool dimensions_settled(const struct contrasts* contrasts, size_t* last_width, size_t* last_height)
+{
+    int max_variation = contrasts->nearest_neighbor_max_variation;
+    bool width_settled = dimension_settled(contrasts->columns, max_variation, last_width);
+    bool height_settled = dimension_settled(contrasts->rows, max_variation, last_height);
+    return width_settled && height_settled;
+}
+
+/*
+    dimensions_settled, for one dimension.
+*/
+static bool dimension_settled(const struct contrast_set* set, int max_variation, size_t* last_size)
+{
+    struct run_analysis runs;
+    if (analyze_runs(set, max_variation, &runs)) {
+        *last_size = 0;
+        return false;
+    }
+    // When no contrasts are missing, determine_dimension is just the
+    // number of runs. A missed one leaves a run twice as thick as the rest,
+    // which only stands out if the runs are thicker than max_variation – so
+    // when they're any thinner (images scaled up by less than 2×, say), it
+    // can't be told whether any are missing.
+    bool complete =
+        runs.thinnest > (size_t) max_variation &&
+        runs.thickest - runs.thinnest <= (size_t) max_variation;
+    size_t size = complete ? runs.num_runs : 0;
+    bool settled = complete && size == *last_size;
+    *last_size = size;
+    return settled;
+}
+
+/*
+    Whether scanning the rows from first_row and on could still change
+    anything.
+*/
+static bool rows_left_to_scan(const struct contrasts* contrasts, size_t first_row)
+{
+    if (contrasts->num_undecided_columns > 0) {return true;}
+    size_t num_rows = contrasts->num_undecided_rows;
+    return num_rows > 0 && contrasts->undecided_rows[num_rows - 1] >= first_row;
+}
+
+/*
+    Scan the height rows of pixels starting at first_row, under the same
+    conditions as update_row_contrasts_from_pixels. If contrasts has a worker
+    pool, the rows are split into horizontal bands scanned in parallel.
+*/
+void update_contrasts_from_pixels(struct contrasts* contrasts, size_t first_row, size_t height, unsigned char* pixels)
+{
+    if (update_contrasts_from_pixels_in_bands(contrasts, first_row, height, pixels)) {return;}
+    update_contrasts_from_pixels_in_tiles(contrasts, first_row, height, pixels);
+}
+
+/*
+    Each band gets contrasts of its own – starting out as a copy of the
+    shared ones, so that already-decided columns and rows are still skipped –
+    and once every band is done, they're all ORed back together. A band's
+    first row is compared to the last row of the band above it, so no
+    contrasts are missed at the edges.
+
+    Returns false if the image wasn't split up, which happens when there's
+    no pool, the image is too small to bother, or there isn't enough memory.
+*/
+static bool update_contrasts_from_pixels_in_bands(struct contrasts* contrasts, size_t first_row, size_t height, unsigned char* pixels)
+{
+    if (contrasts->pool == NULL) {return false;}
+    size_t num_bands = worker_pool_size(contrasts->pool);
+    if (height / num_bands < MIN_BAND_ROWS) {num_bands = height / MIN_BAND_ROWS;}
+    if (num_bands < 2) {return false;}
+    size_t band_height = (height + num_bands - 1) / num_bands;
+    num_bands = (height + band_height - 1) / band_height;
+
+    struct contrasts** bands = (struct contrasts**) calloc(num_bands, sizeof(struct contrasts*));
+    if (bands == NULL) {return false;}
+    for (size_t i = 0; i < num_bands; i++) {
+        size_t rows_before = i * band_height;
+        size_t cur_band_height = height - rows_before < band_height ? height - rows_before : band_height;
+        bands[i] = create_band_contrasts(contrasts, first_row + rows_before, cur_band_height);
+        if (bands[i] == NULL) {
+            for (size_t j = 0; j < i; j++) {destroy_contrasts(bands[j]);}
+            free(bands);
+            return false;
+        }
+    }
+
+    // The bands share the fingerprints, each only ever writing to those
+    // of its own rows.
+    for (size_t i = 0; i < num_bands; i++) {
+        bands[i]->row_fingerprints = contrasts->row_fingerprints;
+        bands[i]->last_row_fingerprints = contrasts->last_row_fingerprints;
+        bands[i]->fingerprinting = contrasts->fingerprinting;
+    }
+    struct band_scan band_scan = {bands, band_height, first_row, height, pixels};
+    run_on_worker_pool(contrasts->pool, scan_band, &band_scan, num_bands);
+
+    for (size_t i = 0; i < num_bands; i++) {
+        merge_contrast_sets(contrasts->columns, bands[i]->columns);
+        merge_contrast_sets(contrasts->rows, bands[i]->rows);
+        contrasts->num_rows_fingerprinted += bands[i]->num_rows_fingerprinted;
+        contrasts->num_rows_unchanged += bands[i]->num_rows_unchanged;
+        destroy_band_contrasts(bands[i]);
+    }
+    free(bands);
+    refresh_undecided(contrasts);
+    return true;
+}
+
+static void scan_band(void* band_scan_pointer, size_t index)
+{
+    struct band_scan* band_scan = (struct band_scan*) band_scan_pointer;
+    struct contrasts* band = band_scan->bands[index];
+    size_t rows_before = index * band_scan->band_height;
+    size_t rows_left = band_scan->height - rows_before;
+    size_t height = rows_left < band_scan->band_height ? rows_left : band_scan->band_height;
+    unsigned char* band_pixels = band_scan->pixels + band->pixel_size * band->frame_width * rows_before;
+
+    enter_stats_phase(STATS_SCAN);
+    update_contrasts_from_pixels_in_tiles(band, band_scan->first_row + rows_before, height, band_pixels);
+    leave_stats_phase();
+}
+
+// Leaves the fingerprints it shares with the contrasts it was made from.
+static void destroy_band_contrasts(struct contrasts* band)
+{
+    band->row_fingerprints = NULL;
+    band->last_row_fingerprints = NULL;
+    destroy_contrasts(band);
+}
+
+/*
+    A copy of contrasts, except that only the undecided rows within the band
+    are left undecided.
+*/
+static struct contrasts* create_band_contrasts(const struct contrasts* contrasts, size_t first_row, size_t height)
+{
+    struct contrasts* band = create_contrasts(contrasts->columns->size, contrasts->rows->size);
+    if (band == NULL) {return NULL;}
+    band->frame_width = contrasts->frame_width;
+    band->pixel_size = contrasts->pixel_size;
+    band->comparison = contrasts->comparison;
+    band->leeway = contrasts->leeway;
+    band->nearest_neighbor_max_variation = contrasts->nearest_neighbor_max_variation;
+    merge_contrast_sets(band->columns, contrasts->columns);
+    merge_contrast_sets(band->rows, contrasts->rows);
+
+    memcpy(band->undecided_columns, contrasts->undecided_columns, contrasts->num_undecided_columns * sizeof(size_t));
+    band->num_undecided_columns = contrasts->num_undecided_columns;
+    size_t start = find_first_undecided(contrasts->undecided_rows, contrasts->num_undecided_rows, first_row);
+    size_t end = find_first_undecided(contrasts->undecided_rows, contrasts->num_undecided_rows, first_row + height);
+    memcpy(band->undecided_rows, contrasts->undecided_rows + start, (end - start) * sizeof(size_t));
+    band->num_undecided_rows = end - start;
+    return band;
+}
+
+/*
+    Scans the rows one tile at a time, and each tile in full – each pixel
+    compared to the one left of it and, in undecided rows, the one above it
+    – before going on to the next. Going through the whole lot for the
+    columns and then again for the rows would have the rows fetched from
+    memory twice over, once they no longer all fit in cache. Stops early if
+    nothing in the rows left could change anything.
+
+    When fingerprinting, rows that haven't changed since the last frame are
+    left out of the column scan, and rows are only compared to the one
+    above them if either has changed.
+*/
+static void update_contrasts_from_pixels_in_tiles(struct contrasts* contrasts, size_t first_row, size_t height, unsigned char* pixels)
+{
+    size_t width = contrasts->columns->size;
+    size_t row_size = contrasts->pixel_size * contrasts->frame_width;
+    size_t compared_size = contrasts->pixel_size * width;
+    size_t tile_rows = scan_tile_rows(contrasts);
+    unsigned char leeway = contrasts->leeway;
+    unsigned char* differences = create_column_differences(contrasts);
+    // Whether each row from the one above first_row on is unchanged – all
+    // but that first one filled in a tile at a time.
+    bool* unchanged = NULL;
+    if (contrasts->fingerprinting) {
+        unchanged = (bool*) calloc(height + 1, sizeof(bool));
+        if (unchanged != NULL && first_row > 0) {
+            find_unchanged_rows(contrasts, first_row - 1, 1, pixels - row_size, unchanged, false);
+        }
+    }
+
+    // The undecided rows are gone through in order, tile by tile, with the
+    // ones that are still undecided moved up as they go. The gap that the
+    // marked ones leave is closed at the end.
+    size_t* undecided = contrasts->undecided_rows;
+    size_t next_row = find_first_undecided(undecided, contrasts->num_undecided_rows, first_row);
+    size_t end = find_first_undecided(undecided, contrasts->num_undecided_rows, first_row + height);
+    size_t num_kept = next_row;
+
+    size_t num_pixels_compared = 0;
+    for (size_t y = 0; y < height && (contrasts->num_undecided_columns > 0 || next_row < end); y += tile_rows) {
+        size_t num_rows = height - y < tile_rows ? height - y : tile_rows;
+        unsigned char* tile = pixels + row_size * y;
+        if (unchanged == NULL) {
+            num_pixels_compared += update_column_contrasts_from_rows(contrasts, num_rows, tile, differences);
+        } else {
+            bool* tile_unchanged = unchanged + 1 + y;
+            find_unchanged_rows(contrasts, first_row + y, num_rows, tile, tile_unchanged, true);
+            // Only runs of changed rows are scanned for columns.
+            size_t run_start = 0;
+            while (run_start < num_rows && contrasts->num_undecided_columns > 0) {
+                if (tile_unchanged[run_start]) {
+                    run_start++;
+                    continue;
+                }
+                size_t run_end = run_start + 1;
+                while (run_end < num_rows && !tile_unchanged[run_end]) {run_end++;}
+                num_pixels_compared += update_column_contrasts_from_rows(contrasts, run_end - run_start, tile + row_size * run_start, differences);
+                run_start = run_end;
+            }
+        }
+
+        for (; next_row < end && undecided[next_row] < first_row + y + num_rows; next_row++) {
+            size_t row = undecided[next_row];
+            if (unchanged != NULL && unchanged[row - first_row] && unchanged[row - first_row + 1]) {
+                undecided[num_kept++] = row;
                 continue;
             }
+            unsigned char* cur_row = pixels + row_size * (row - first_row);
+            num_pixels_compared += width;
+            if (any_difference(cur_row - row_size, cur_row, compared_size, leeway)) {
+                mark_contrast(contrasts->rows, row);
+            } else {
+                undecided[num_kept++] = row;
+            }
+        }
+    }
+    count_stats(STATS_PIXELS_COMPARED, num_pixels_compared);
 
-            if (compare_pixel(&left_pixel, &cur_pixel)) {
-                column_contrasts[x] = true;
+    memmove(undecided + num_kept, undecided + next_row, (contrasts->num_undecided_rows - next_row) * sizeof(size_t));
+    contrasts->num_undecided_rows -= next_row - num_kept;
+    free(differences);
+    free(unchanged);
+}
+
+// How many rows go in a tile: a whole number of column blocks, and at least
+// one.
+static size_t scan_tile_rows(const struct contrasts* contrasts)
+{
+    size_t num_blocks = SCAN_TILE_SIZE / (contrasts->pixel_size * contrasts->frame_width * COLUMN_BLOCK_ROWS);
+    return (num_blocks > 0 ? num_blocks : 1) * COLUMN_BLOCK_ROWS;
+}
+
+/*
+    Compares the undecided rows among the height rows starting at first_row
+    to the row above them. pixels points to first_row, and unless first_row
+    is 0, the row above it needs to be right before it in memory – rows
+    being a frame's width apart, even when only a region of it is scanned.
+*/
+void update_row_contrasts_from_pixels(struct contrasts* contrasts, size_t first_row, size_t height, unsigned char* pixels)
+{
+    size_t* undecided = contrasts->undecided_rows;
+    size_t start = find_first_undecided(undecided, contrasts->num_undecided_rows, first_row);
+    size_t end = find_first_undecided(undecided, contrasts->num_undecided_rows, first_row + height);
+
+    count_stats(STATS_PIXELS_COMPARED, (end - start) * contrasts->columns->size);
+    size_t num_still_undecided = update_row_contrasts_from_pixels_simd(contrasts, first_row, undecided + start, end - start, pixels);
+
+    // Close the gap left by the rows that were marked.
+    memmove(
+        undecided + start + num_still_undecided, undecided + end,
+        (contrasts->num_undecided_rows - end) * sizeof(size_t)
+    );
+    contrasts->num_undecided_rows -= end - start - num_still_undecided;
+}
+
+void update_column_contrasts_from_pixels(struct contrasts* contrasts, size_t height, unsigned char* pixels)
+{
+    unsigned char* differences = create_column_differences(contrasts);
+    count_stats(STATS_PIXELS_COMPARED, update_column_contrasts_from_rows(contrasts, height, pixels, differences));
+    free(differences);
+}
+
+/*
+    Goes through height rows of pixels, comparing only the columns that are
+    still undecided, and stops early if none are left. While many columns are
+    undecided, each row is compared to itself shifted one pixel to the left,
+    channel by channel, and the results are ORed together over a block of
+    rows in differences. Only then are the channels folded back into columns
+    – so the inner loop never has to care where one pixel ends and the next
+    begins. Once few enough columns are left (or if differences is NULL),
+    it's back to comparing just those. Returns how many pixels were
+    compared.
+*/
+static size_t update_column_contrasts_from_rows(struct contrasts* contrasts, size_t height, unsigned char* pixels, unsigned char* differences)
+{
+    size_t width = contrasts->columns->size;
+    if (width < 2) {return 0;}
+    size_t pixel_size = contrasts->pixel_size;
+    size_t row_size = pixel_size * contrasts->frame_width;
+    size_t compared_size = pixel_size * (width - 1);
+    size_t* undecided = contrasts->undecided_columns;
+    unsigned char leeway = contrasts->leeway;
+    const struct pixel_loops* loops = select_pixel_loops(contrasts);
+
+    size_t num_pixels_compared = 0;
+    size_t y = 0;
+    while (y < height && contrasts->num_undecided_columns > 0) {
+        if (differences != NULL && contrasts->num_undecided_columns * SPARSE_COLUMNS_RATIO >= width) {
+            memset(differences, 0, compared_size * sizeof(unsigned char));
+            size_t block_end = y + COLUMN_BLOCK_ROWS < height ? y + COLUMN_BLOCK_ROWS : height;
+            num_pixels_compared += (width - 1) * (block_end - y);
+            for (; y < block_end; y++) {
+                unsigned char* row = pixels + row_size * y;
+                accumulate_differences(row, row + pixel_size, compared_size, leeway, differences);
+            }
+
+            size_t num_still_undecided = 0;
+            for (size_t i = 0; i < contrasts->num_undecided_columns; i++) {
+                size_t x = undecided[i];
+                unsigned char* pixel_differences = differences + pixel_size * (x - 1);
+                bool differs = pixel_size == 1 ? pixel_differences[0] : pixel_differences[0] | pixel_differences[1] | pixel_differences[2];
+                if (differs) {
+                    mark_contrast(contrasts->columns, x);
+                } else {
+                    undecided[num_still_undecided++] = x;
+                }
             }
+            contrasts->num_undecided_columns = num_still_undecided;
+        } else {
+            num_pixels_compared += contrasts->num_undecided_columns;
+            loops->mark_differing_columns(contrasts, pixels + row_size * y);
+            y++;
         }
-        // Currently, left_pixel is the rightmost pixel in the previous
-        // column, and cur_pixel is the leftmost pixel in the current row –
-        // so we gotta skip forward once.
-        left_pixel += 3;
-        cur_pixel += 3;
     }
+    return num_pixels_compared;
+}
+
+/*
+    Room for update_column_contrasts_from_rows to OR a block of rows'
+    differences together in. NULL if so few columns are undecided that
+    they're quicker to compare one by one anyway – or if there isn't room,
+    in which case they're compared one by one throughout: slower, but just
+    as right.
+*/
+static unsigned char* create_column_differences(const struct contrasts* contrasts)
+{
+    size_t width = contrasts->columns->size;
+    if (width < 2 || contrasts->num_undecided_columns * SPARSE_COLUMNS_RATIO < width) {return NULL;}
+    return (unsigned char*) malloc(contrasts->pixel_size * (width - 1) * sizeof(unsigned char));
 }
 
-void update_row_contrasts_from_pixels(size_t width, size_t height, bool row_contrasts[], unsigned char* pixels)
+static size_t update_row_contrasts_from_pixels_simd(struct contrasts* contrasts, size_t first_row, size_t* undecided, size_t num_undecided, unsigned char* pixels)
 {
-    unsigned char* above_pixel = pixels;
-    unsigned char* cur_pixel = pixels + 3 * width;
-    for (size_t y = 1; y < height; y++) {
-        if (row_contrasts[y]) {
-            above_pixel += 3 * width;
-            cur_pixel += 3 * width;
-            continue;
+    size_t row_size = contrasts->pixel_size * contrasts->frame_width;
+    size_t compared_size = contrasts->pixel_size * contrasts->columns->size;
+    unsigned char leeway = contrasts->leeway;
+    size_t num_still_undecided = 0;
+    for (size_t i = 0; i < num_undecided; i++) {
+        size_t y = undecided[i];
+        unsigned char* cur_row = pixels + row_size * (y - first_row);
+        if (any_difference(cur_row - row_size, cur_row, compared_size, leeway)) {
+            mark_contrast(contrasts->rows, y);
+        } else {
+            undecided[num_still_undecided++] = y;
         }
+    }
+    return num_still_undecided;
+}
 
-        for (size_t x = 0; x < width; x++) {
-            if (compare_pixel(&above_pixel, &cur_pixel)) {
-                above_pixel = pixels + 3 * width * y;
-                cur_pixel = pixels + 3 * width * (y + 1);
-                row_contrasts[y] = true;
-                break;
-            }
+// The position of the first undecided column/row at or past index.
+static size_t find_first_undecided(const size_t* undecided, size_t num_undecided, size_t index)
+{
+    size_t low = 0;
+    size_t high = num_undecided;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (undecided[middle] < index) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/*
+    A frame's about to be scanned, with the region settled. Its rows are
+    fingerprinted from the second frame on – most screenshots only have the
+    one – but only for as long as that pays off: frames of an animation or
+    stream tend to share most of their rows, different screenshots hardly
+    any. A frame that turned out to share too few of them with the one
+    before it puts fingerprinting off for a while. If there isn't room for
+    the fingerprints, frames are simply scanned in full.
+*/
+static void start_frame(struct contrasts* contrasts)
+{
+    count_stats(STATS_FRAMES, 1);
+    count_stats(STATS_COLUMNS_SKIPPED, contrasts->columns->size - contrasts->num_undecided_columns);
+    count_stats(STATS_ROWS_SKIPPED, contrasts->rows->size - contrasts->num_undecided_rows);
+
+    if (
+        contrasts->fingerprinting && contrasts->num_fingerprinted_frames > 1 &&
+        contrasts->num_rows_unchanged * MIN_UNCHANGED_RATIO < contrasts->num_rows_fingerprinted
+    ) {
+        contrasts->frames_until_fingerprinting = FINGERPRINTING_RETRY_FRAMES;
+    }
+    contrasts->fingerprinting = false;
+    contrasts->num_rows_fingerprinted = 0;
+    contrasts->num_rows_unchanged = 0;
+    if (contrasts->frames_until_fingerprinting > 0) {
+        contrasts->frames_until_fingerprinting--;
+        contrasts->num_fingerprinted_frames = 0;
+        return;
+    }
+
+    size_t height = contrasts->rows->size;
+    if (contrasts->row_fingerprints == NULL) {
+        // Big enough for any region of the frame.
+        contrasts->row_fingerprints = (uint64_t*) malloc(contrasts->frame_height * sizeof(uint64_t));
+        contrasts->last_row_fingerprints = (uint64_t*) malloc(contrasts->frame_height * sizeof(uint64_t));
+        if (contrasts->row_fingerprints == NULL || contrasts->last_row_fingerprints == NULL) {
+            free(contrasts->row_fingerprints);
+            free(contrasts->last_row_fingerprints);
+            contrasts->row_fingerprints = NULL;
+            contrasts->last_row_fingerprints = NULL;
+            return;
+        }
+    }
+    uint64_t* last_row_fingerprints = contrasts->row_fingerprints;
+    contrasts->row_fingerprints = contrasts->last_row_fingerprints;
+    contrasts->last_row_fingerprints = last_row_fingerprints;
+    // The first frame fingerprinted has nothing to compare to, so every
+    // row counts as changed.
+    if (contrasts->num_fingerprinted_frames == 0) {memset(contrasts->last_row_fingerprints, 0, height * sizeof(uint64_t));}
+    memset(contrasts->row_fingerprints, 0, height * sizeof(uint64_t));
+    contrasts->num_fingerprinted_frames++;
+    contrasts->fingerprinting = true;
+}
+
+/*
+    Fingerprints the height rows starting at first_row – pixels pointing to
+    the first of them – and sets whether each one's the same as in the last
+    frame. If record is set, the fingerprints are kept for the next frame
+    to compare to; only the band a row belongs to gets to do that.
+*/
+static void find_unchanged_rows(struct contrasts* contrasts, size_t first_row, size_t height, const unsigned char* pixels, bool* unchanged, bool record)
+{
+    size_t row_size = contrasts->pixel_size * contrasts->frame_width;
+    size_t compared_size = contrasts->pixel_size * contrasts->columns->size;
+    size_t num_unchanged = 0;
+    for (size_t y = 0; y < height; y++) {
+        uint64_t fingerprint = fingerprint_row(pixels + row_size * y, compared_size);
+        unchanged[y] = contrasts->last_row_fingerprints[first_row + y] == fingerprint;
+        if (record) {contrasts->row_fingerprints[first_row + y] = fingerprint;}
+        num_unchanged += unchanged[y];
+    }
+    if (record) {
+        contrasts->num_rows_fingerprinted += height;
+        contrasts->num_rows_unchanged += num_unchanged;
+        count_stats(STATS_ROWS_UNCHANGED, num_unchanged);
+    }
+}
+
+/*
+    A 64-bit hash of a row's pixels, and never 0, which stands for a row
+    that wasn't fingerprinted. Rows with the same fingerprint are taken to
+    be the same, as cache entries are: the odds of two different ones
+    sharing one are vanishingly small.
+*/
+static inline uint64_t fingerprint_row(const unsigned char* row, size_t size)
+{
+    uint64_t fingerprint = hash_bytes(row, size);
+    return fingerprint != 0 ? fingerprint : 1;
+}
+
+/*
+    The templates for the pixel_loops instances: always inlined into them,
+    with comparison and pixel_size constants in each.
+*/
+static inline __attribute__((always_inline)) bool pixels_differ(const unsigned char* pixel_1, const unsigned char* pixel_2, enum pixel_comparison comparison, size_t pixel_size, unsigned char leeway)
+{
+    if (pixel_size == 1) {return *pixel_1 != *pixel_2;}
+    return comparison == COMPARE_EXACT ? pixels_differ_exact(pixel_1, pixel_2) : pixels_differ_fuzzy(pixel_1, pixel_2, leeway);
+}
+
+static inline __attribute__((always_inline)) void mark_differing_columns(struct contrasts* contrasts, const unsigned char* row, enum pixel_comparison comparison, size_t pixel_size)
+{
+    unsigned char leeway = contrasts->leeway;
+    size_t* undecided = contrasts->undecided_columns;
+    size_t num_still_undecided = 0;
+    for (size_t i = 0; i < contrasts->num_undecided_columns; i++) {
+        size_t x = undecided[i];
+        if (pixels_differ(row + pixel_size * (x - 1), row + pixel_size * x, comparison, pixel_size, leeway)) {
+            mark_contrast(contrasts->columns, x);
+        } else {
+            undecided[num_still_undecided++] = x;
         }
     }
+    contrasts->num_undecided_columns = num_still_undecided;
 }
+
+static void mark_differing_columns_exact(struct contrasts* contrasts, const unsigned char* row) {mark_differing_columns(contrasts, row, COMPARE_EXACT, 3);}
+static void mark_differing_columns_fuzzy(struct contrasts* contrasts, const unsigned char* row) {mark_differing_columns(contrasts, row, COMPARE_FUZZY, 3);}
+static void mark_differing_columns_indexed(struct contrasts* contrasts, const unsigned char* row) {mark_differing_columns(contrasts, row, COMPARE_EXACT, 1);}
+
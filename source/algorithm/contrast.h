@@ -1,6 +1,6 @@
 /*
     Functions that condense the rows and columns in a scaled image (or a series
-    of images that were scaled identically) into an array each that signifies
+    of images that were scaled identically) into a set each that signifies
     at which row/column in the scaled image a new row/column starts in the
     original 1:1 image.
 */
@@ -9,16 +9,108 @@
 
 #include <stdbool.h>
 #include <stddef.h>
-#ifdef IMAGEMAGICK_7
-#include <MagickWand/MagickWand.h>
-#endif
-#ifdef IMAGEMAGICK_6
-#include <wand/MagickWand.h>
-#endif
+#include <stdint.h>
+#include "algorithm/compare.h"
+#include "algorithm/contrast_set.h"
+#include "algorithm/pool.h"
+#include "input/reader.h"
+
+// What the update_contrasts_from_* functions (and scan_image_dimensions and
+// write_scanned_screenshot) return when they fail.
+#define SCAN_WRONG_SIZE 1
+#define SCAN_READ_FAILED 2
+#define SCAN_OUT_OF_MEMORY 3
+#define SCAN_WRITE_FAILED 4
+#define SCAN_REGION_OUTSIDE 5
+
+// A rectangle of an image, in pixels. A width of 0 stands for no region.
+struct scan_region {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+};
+
+struct contrasts {
+    // The contrasts within the region of each frame that's scanned – the
+    // whole frame, unless it's been narrowed down (see settle_scan_region).
+    struct contrast_set* columns;
+    struct contrast_set* rows;
+    size_t frame_width;
+    size_t frame_height;
+    // How many bytes each pixel of the frame being scanned takes: 3 for RGB,
+    // or 1 while a frame's scanned as palette indices (see
+    // update_contrasts_from_image).
+    size_t pixel_size;
+    size_t region_x;
+    size_t region_y;
+    bool region_settled;
+    // The columns/rows that haven't been marked yet, in order. These are the
+    // only ones that need to be compared any further.
+    size_t* undecided_columns;
+    size_t num_undecided_columns;
+    size_t* undecided_rows;
+    size_t num_undecided_rows;
+
+    // A fingerprint (see fingerprint_row) of each row in the region, as of
+    // this frame and the one before it – 0 for any that weren't scanned. A
+    // row that hasn't changed since the last frame can't tell anything it
+    // didn't then, so it needn't be scanned again. Only used while
+    // fingerprinting is set; see start_frame for when that is.
+    uint64_t* row_fingerprints;
+    uint64_t* last_row_fingerprints;
+    bool fingerprinting;
+    // Frames fingerprinted in a row, and frames to go before the next one
+    // is.
+    size_t num_fingerprinted_frames;
+    size_t frames_until_fingerprinting;
+    // Of this frame's rows.
+    size_t num_rows_fingerprinted;
+    size_t num_rows_unchanged;
+
+    // If set, images are scanned in bands spread out over this pool.
+    struct worker_pool* pool;
+
+    // How these contrasts are scanned and measured. create_contrasts takes
+    // them from the globals that the command line sets (see
+    // use_global_settings), but they can be set per set of contrasts, so that
+    // several can be scanned independently at the same time. leeway is how
+    // much a channel can differ by under comparison: 0 when it's exact.
+    enum pixel_comparison comparison;
+    unsigned char leeway;
+    int nearest_neighbor_max_variation;
+    bool progressive;
+    // The region to scan, or – if there isn't one and trim_borders is set –
+    // the first frame's uniform borders are left out.
+    struct scan_region region;
+    bool trim_borders;
+
+    // How many pixels have gone into these contrasts, and how many of
+    // those were actually looked at (fewer when scanning progressively).
+    size_t num_pixels;
+    size_t num_pixels_touched;
+};
+
+extern size_t scan_strip_height;
+extern bool scan_progressively;
+extern struct scan_region scan_region;
+extern bool trim_borders;
+
+struct contrasts* create_contrasts(size_t width, size_t height);
+void reset_contrasts(struct contrasts* contrasts);
+void destroy_contrasts(struct contrasts* contrasts);
+void use_global_settings(struct contrasts* contrasts);
+void refresh_undecided(struct contrasts* contrasts);
+bool contrasts_saturated(const struct contrasts* contrasts);
+bool scans_progressively(const struct contrasts* contrasts);
+bool dimensions_settled(const struct contrasts* contrasts, size_t* last_width, size_t* last_height);
+size_t scan_buffer_size(size_t width, size_t height);
 
-int update_contrasts_from_wand(size_t width, bool column_contrasts[], size_t height, bool row_contrasts[], unsigned char pixels[], MagickWand* wand);
-int update_contrasts_from_image(size_t width, bool column_contrasts[], size_t height, bool row_contrasts[], unsigned char pixels[], MagickWand* wand);
-void update_column_contrasts_from_pixels(size_t width, bool column_contrasts[], size_t height, unsigned char* pixels);
-void update_row_contrasts_from_pixels(size_t width, size_t height, bool row_contrasts[], unsigned char* pixels);
+int update_contrasts_from_reader(struct contrasts* contrasts, unsigned char pixels[], struct image_reader* reader);
+int update_contrasts_from_image(struct contrasts* contrasts, unsigned char pixels[], struct image_reader* reader);
+int update_contrasts_from_whole_image(struct contrasts* contrasts, unsigned char* pixels);
+void update_contrasts_from_pixels(struct contrasts* contrasts, size_t first_row, size_t height, unsigned char* pixels);
+void update_column_contrasts_from_pixels(struct contrasts* contrasts, size_t height, unsigned char* pixels);
+void update_row_contrasts_from_pixels(struct contrasts* contrasts, size_t first_row, size_t height, unsigned char* pixels);
 
 #endif
@@ -0,0 +1,68 @@
+#include "algorithm/contrast_set.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Returns NULL if there isn't enough memory. The set starts out empty –
+    note that the first column/row of an image always starts a new one,
+    so callers will generally want to mark 0 right away.
+*/
+struct contrast_set* create_contrast_set(size_t size)
+{
+    struct contrast_set* set = (struct contrast_set*) malloc(sizeof(struct contrast_set));
+    if (set == NULL) {return NULL;}
+    set->size = size;
+    set->num_words = (size + CONTRAST_WORD_BITS - 1) / CONTRAST_WORD_BITS;
+    // Always at least one word, so that an empty set can still be read from.
+    set->words = (uint64_t*) calloc(set->num_words ? set->num_words : 1, sizeof(uint64_t));
+    if (set->words == NULL) {
+        free(set);
+        return NULL;
+    }
+    return set;
+}
+
+void destroy_contrast_set(struct contrast_set* set)
+{
+    if (set == NULL) {return;}
+    free(set->words);
+    free(set);
+}
+
+void clear_contrast_set(struct contrast_set* set)
+{
+    memset(set->words, 0, set->num_words * sizeof(uint64_t));
+}
+
+/*
+    Clears the set and changes its size, which can't be any bigger than it
+    was created with – for narrowing a set down to part of an image, and
+    widening it back out.
+*/
+void resize_contrast_set(struct contrast_set* set, size_t size)
+{
+    clear_contrast_set(set);
+    set->size = size;
+    set->num_words = (size + CONTRAST_WORD_BITS - 1) / CONTRAST_WORD_BITS;
+}
+
+// Both sets must be of the same size.
+void merge_contrast_sets(struct contrast_set* into, const struct contrast_set* from)
+{
+    for (size_t i = 0; i < into->num_words; i++) {
+        into->words[i] |= from->words[i];
+    }
+}
+
+size_t count_contrasts(const struct contrast_set* set)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < set->num_words; i++) {
+        count += __builtin_popcountll(set->words[i]);
+    }
+    return count;
+}
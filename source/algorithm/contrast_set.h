@@ -0,0 +1,55 @@
+/*
+    A set of contrasts for one dimension of an image – that is, which of the
+    scaled image's columns (or rows) start a new column (or row) in the 1:1
+    image. Stored as a bitset, one bit per column/row, so that merging the
+    contrasts of several images is a word-wide OR, and so that runs of
+    unmarked columns/rows can be skipped 64 at a time.
+*/
+#ifndef CONTRAST_SET_H
+#define CONTRAST_SET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONTRAST_WORD_BITS 64
+
+struct contrast_set {
+    size_t size;
+    size_t num_words;
+    // Bits past size in the last word are always 0.
+    uint64_t* words;
+};
+
+struct contrast_set* create_contrast_set(size_t size);
+void destroy_contrast_set(struct contrast_set* set);
+void clear_contrast_set(struct contrast_set* set);
+void resize_contrast_set(struct contrast_set* set, size_t size);
+void merge_contrast_sets(struct contrast_set* into, const struct contrast_set* from);
+size_t count_contrasts(const struct contrast_set* set);
+
+static inline bool has_contrast(const struct contrast_set* set, size_t i)
+{
+    return (set->words[i / CONTRAST_WORD_BITS] >> (i % CONTRAST_WORD_BITS)) & 1;
+}
+
+static inline void mark_contrast(struct contrast_set* set, size_t i)
+{
+    set->words[i / CONTRAST_WORD_BITS] |= (uint64_t) 1 << (i % CONTRAST_WORD_BITS);
+}
+
+// The first contrast after i, or the size of the set if there isn't one.
+static inline size_t next_contrast(const struct contrast_set* set, size_t i)
+{
+    i++;
+    size_t word_index = i / CONTRAST_WORD_BITS;
+    if (word_index >= set->num_words) {return set->size;}
+    uint64_t word = set->words[word_index] & (~(uint64_t) 0 << (i % CONTRAST_WORD_BITS));
+    while (word == 0) {
+        if (++word_index >= set->num_words) {return set->size;}
+        word = set->words[word_index];
+    }
+    return word_index * CONTRAST_WORD_BITS + __builtin_ctzll(word);
+}
+
+#endif
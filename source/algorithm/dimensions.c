@@ -2,106 +2,189 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #ifdef DEBUG
 #include <stdio.h>
 #endif
+#include "algorithm/contrast_set.h"
+#include "algorithm/fit.h"
 
-static inline void register_run(size_t run_length, size_t* num_runs, size_t* thinnest, size_t *thickest);
-static inline void count_run(size_t run_length, size_t thinnest, size_t* num_certain_pixels, size_t* certain_pixels_size);
+static inline void register_run(size_t run_length, struct run_analysis* analysis, size_t* certain_runs_by_length, size_t window_size);
 
+// What max_variation is for contrasts created without saying otherwise.
 int nearest_neighbor_max_variation = 1;
 
 /*
     Determine one dimension (i.e. width or height) based on a previously
-    determined array of contrasts.
+    determined set of contrasts, where runs up to max_variation apart in
+    width can all be one source pixel each. Returns 0 if there isn't enough
+    memory. Unless confidence is NULL, it's set to how sure the result is,
+    from 0 to 1.
 */
-size_t determine_dimension(size_t contrasts_size, bool contrasts[])
+size_t determine_dimension(const struct contrast_set* contrasts, int max_variation, double* confidence)
 {
-    size_t num_runs = 0;
-    size_t thinnest = SIZE_MAX;
-    size_t thickest = 0;
-    size_t run_start = 0;
-    size_t i;
-    for (i = 1; i < contrasts_size; i++) {
-        if (contrasts[i]) {
-            register_run(i - run_start, &num_runs, &thinnest, &thickest);
-            run_start = i;
-        }
-    }
-    register_run(i - run_start, &num_runs, &thinnest, &thickest);
+    struct run_analysis analysis;
+    if (analyze_runs(contrasts, max_variation, &analysis)) {return 0;}
 
 #ifdef DEBUG
-    printf("Thinnest: %zu\nThickest: %zu\n\n", thinnest, thickest);
+    printf("Thinnest: %zu\nThickest: %zu\n\n", analysis.thinnest, analysis.thickest);
 #endif
 
-    if (thickest - thinnest <= nearest_neighbor_max_variation) {
+    if (analysis.thickest - analysis.thinnest <= (size_t) max_variation) {
         // The detection has succeeded in identifying every single point where
         // the image switches to a new pixel in this dimension.
         // Put another way, there were no swaths of the same exact color
         // that took up the whole width/height.
-        return num_runs;
-    } else {
-        return determine_dimension_by_certain_delineations(contrasts_size, contrasts, thinnest);
+        if (confidence != NULL) {*confidence = 1;}
+        return analysis.num_runs;
+    }
+
+    double estimated_scale = (double) analysis.certain_runs_size / (double) analysis.num_certain_runs;
+    struct nearest_neighbor_fit fit;
+    fit_nearest_neighbor(contrasts, estimated_scale, &fit);
+
+#ifdef DEBUG
+    printf(
+        "Fitted: %zu (scale %lg, sampled at %d), explaining %zu of %zu contrasts\nConfidence: %lg\n\n",
+        fit.dimension, fit.scale, (int) fit.sampling_point,
+        fit.num_fitting_contrasts, fit.num_known_contrasts, fit.confidence
+    );
+#endif
+
+    // If the image doesn't look like it's been nearest neighbor scaled in
+    // the first place, the fit doesn't mean much.
+    if (fit.dimension > 0 && 2 * fit.num_fitting_contrasts > fit.num_known_contrasts) {
+        if (confidence != NULL) {*confidence = fit.confidence;}
+        return fit.dimension;
     }
+    if (confidence != NULL) {*confidence = 0;}
+    return determine_dimension_by_certain_delineations(contrasts->size, &analysis);
 }
 
-static inline void register_run(size_t run_length, size_t* num_runs, size_t* thinnest, size_t *thickest)
+/*
+    Like determine_dimension, but for a region cut out of an image by hand,
+    whose edges can fall anywhere within a source pixel. Its first and last
+    runs can then be any part of one, which would throw off both the
+    comparison of runs and the fit, so they're left out: the dimension is
+    determined between the first and last contrasts inside the region, and
+    scaled up to all of it from there.
+*/
+size_t determine_region_dimension(const struct contrast_set* contrasts, int max_variation, double* confidence)
 {
-    (*num_runs)++;
-    if (run_length < *thinnest) {
-        *thinnest = run_length;
+    size_t first = next_contrast(contrasts, 0);
+    size_t last = first;
+    for (size_t word_index = contrasts->num_words; word_index-- > 0;) {
+        uint64_t word = contrasts->words[word_index];
+        if (word_index == 0) {word &= ~(uint64_t) 1;}
+        if (word) {
+            last = word_index * CONTRAST_WORD_BITS + CONTRAST_WORD_BITS - 1 - __builtin_clzll(word);
+            break;
+        }
     }
-    if (run_length > *thickest) {
-        *thickest = run_length;
+    // Without at least one whole run, there's nothing better to go on.
+    if (last <= first || last >= contrasts->size) {return determine_dimension(contrasts, max_variation, confidence);}
+
+    struct contrast_set* inner = create_contrast_set(last - first);
+    if (inner == NULL) {return 0;}
+    for (size_t i = first; i < last; i = next_contrast(contrasts, i)) {
+        mark_contrast(inner, i - first);
     }
+    size_t inner_dimension = determine_dimension(inner, max_variation, confidence);
+    destroy_contrast_set(inner);
+
+    return (size_t) ((double) contrasts->size * (double) inner_dimension / (double) (last - first) + 0.5);
 }
 
 /*
-    Determine one dimension (i.e. width or height) based on a previously
-    determined array of contrasts. There may be swaths of uncertainty in the
-    array (that is to say, longer runs of identical pixels, where it was not
-    possible to determine where the rows/columns start and end).
+    Measure every run in a set of contrasts in a single pass, a 64-bit word at
+    a time: the set bits in each word are found with count-trailing-zeros, so
+    long stretches without contrasts cost next to nothing.
 
-    The way this algorithm currently works is by counting the number of known
-    pixels and dividing that by how many pixels they take up in the scaled
-    image, thus averaging out to an estimated scale based on what we do know.
+    Counting the certain runs (those no more than max_variation wider than
+    the thinnest) requires knowing the thinnest run, which isn't known until
+    the end. So runs are tallied by length for every length that could still
+    turn out to be certain, and whenever a new thinnest run turns up, the
+    tally slides down to match.
 
-    What this ignores is that a nearest-neighbor algorithm will always place
-    duplicated pixels at an equal (or, y'know ± 1 since it's rounded) distance
-    from each other. The algorithm could takethis into account, and attempt
-    to get the exact parameters for the original nearest-neigbor scaling
-    process (i.e. find the origin [center rounding up like ImageMagick {the
-    sane approach}, bottom right like Paint.net, or perhaps center rounding
-    down or top left {though I haven't found software that uses those yet}],
-    and calculate the scale based on where known extra pixels are positioned).
-    I'd imagine this would particularly help images at a non- integer scale
-    that's between 1× and 2×, since that's the only case when a 2-pixel-wide
-    run could either be two pixels or a widened single pixel – but that's a
-    very particular case, that I'm not sure will come up much IRL. If it does,
-    it may be time to improve this algorithm.
+    Returns nonzero if there isn't enough memory for the tally.
 */
-size_t determine_dimension_by_certain_delineations(size_t contrasts_size, bool contrasts[], size_t thinnest)
+int analyze_runs(const struct contrast_set* contrasts, int max_variation, struct run_analysis* analysis)
 {
-    size_t num_certain_pixels = 0;
-    size_t certain_pixels_size = 0;
+    size_t window_size = (size_t) max_variation + 1;
+    if (window_size > contrasts->size + 1) {window_size = contrasts->size + 1;}
+    size_t* certain_runs_by_length = (size_t*) calloc(window_size, sizeof(size_t));
+    if (certain_runs_by_length == NULL) {return 1;}
+
+    analysis->num_runs = 0;
+    analysis->thinnest = SIZE_MAX;
+    analysis->thickest = 0;
+    analysis->num_certain_runs = 0;
+    analysis->certain_runs_size = 0;
+
     size_t run_start = 0;
-    size_t i;
-    for (i = 1; i < contrasts_size; i++) {
-        if (contrasts[i]) {
-            count_run(i - run_start, thinnest, &num_certain_pixels, &certain_pixels_size);
+    for (size_t word_index = 0; word_index < contrasts->num_words; word_index++) {
+        uint64_t word = contrasts->words[word_index];
+        // The first column/row always starts a run, marked or not.
+        if (word_index == 0) {word &= ~(uint64_t) 1;}
+        while (word) {
+            size_t i = word_index * CONTRAST_WORD_BITS + __builtin_ctzll(word);
+            word &= word - 1;
+            register_run(i - run_start, analysis, certain_runs_by_length, window_size);
             run_start = i;
         }
     }
-    count_run(i - run_start, thinnest, &num_certain_pixels, &certain_pixels_size);
+    register_run(contrasts->size - run_start, analysis, certain_runs_by_length, window_size);
 
-    double determined_scale = (double) certain_pixels_size / (double) num_certain_pixels;
-    return (size_t) (contrasts_size / determined_scale + 0.5);
+    for (size_t offset = 0; offset < window_size; offset++) {
+        analysis->num_certain_runs += certain_runs_by_length[offset];
+        analysis->certain_runs_size += certain_runs_by_length[offset] * (analysis->thinnest + offset);
+    }
+
+    free(certain_runs_by_length);
+    return 0;
 }
 
-static inline void count_run(size_t run_length, size_t thinnest, size_t* num_certain_pixels, size_t* certain_pixels_size)
+static inline void register_run(size_t run_length, struct run_analysis* analysis, size_t* certain_runs_by_length, size_t window_size)
 {
-    if (run_length - thinnest <= nearest_neighbor_max_variation) {
-        (*num_certain_pixels)++;
-        (*certain_pixels_size) += run_length;
+    analysis->num_runs++;
+    if (run_length < analysis->thinnest) {
+        if (analysis->thinnest != SIZE_MAX) {
+            // Slide the tally down, dropping whichever lengths are now too
+            // wide to be certain.
+            size_t shift = analysis->thinnest - run_length;
+            for (size_t offset = window_size; offset-- > 0;) {
+                certain_runs_by_length[offset] = offset >= shift ? certain_runs_by_length[offset - shift] : 0;
+            }
+        }
+        analysis->thinnest = run_length;
     }
+    if (run_length > analysis->thickest) {
+        analysis->thickest = run_length;
+    }
+    if (run_length - analysis->thinnest < window_size) {
+        certain_runs_by_length[run_length - analysis->thinnest]++;
+    }
+}
+
+/*
+    Determine one dimension (i.e. width or height) based on a previously
+    determined set of contrasts. There may be swaths of uncertainty in the
+    set (that is to say, longer runs of identical pixels, where it was not
+    possible to determine where the rows/columns start and end).
+
+    The way this algorithm works is by counting the number of known pixels
+    and dividing that by how many pixels they take up in the scaled image,
+    thus averaging out to an estimated scale based on what we do know. The
+    counting itself happens as part of analyze_runs.
+
+    What this ignores is that a nearest-neighbor algorithm will always place
+    duplicated pixels at an equal (or, y'know ± 1 since it's rounded) distance
+    from each other – which fit_nearest_neighbor (see fit.c) does take into
+    account, so this is only the fallback for when the image doesn't look
+    nearest-neighbor scaled enough for that to work.
+*/
+size_t determine_dimension_by_certain_delineations(size_t contrasts_size, const struct run_analysis* analysis)
+{
+    double determined_scale = (double) analysis->certain_runs_size / (double) analysis->num_certain_runs;
+    return (size_t) (contrasts_size / determined_scale + 0.5);
 }
@@ -1,15 +1,29 @@
 /*
-    Determine a single dimension at a time based on a contrast array.
+    Determine a single dimension at a time based on a set of contrasts.
 */
 #ifndef DIMENSIONS_H
 #define DIMENSIONS_H
 
 #include <stdbool.h>
 #include <stddef.h>
+#include "algorithm/contrast_set.h"
+
+// Runs are the stretches of columns/rows between one contrast and the next.
+struct run_analysis {
+    size_t num_runs;
+    size_t thinnest;
+    size_t thickest;
+    // Runs no more than max_variation wider than the thinnest, and how many
+    // columns/rows they take up together.
+    size_t num_certain_runs;
+    size_t certain_runs_size;
+};
 
 extern int nearest_neighbor_max_variation;
 
-size_t determine_dimension(size_t contrasts_size, bool contrasts[]);
-size_t determine_dimension_by_certain_delineations(size_t contrasts_size, bool contrasts[], size_t thinnest);
+size_t determine_dimension(const struct contrast_set* contrasts, int max_variation, double* confidence);
+size_t determine_region_dimension(const struct contrast_set* contrasts, int max_variation, double* confidence);
+int analyze_runs(const struct contrast_set* contrasts, int max_variation, struct run_analysis* analysis);
+size_t determine_dimension_by_certain_delineations(size_t contrasts_size, const struct run_analysis* analysis);
 
 #endif
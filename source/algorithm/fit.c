@@ -0,0 +1,181 @@
+#include "algorithm/fit.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "algorithm/contrast_set.h"
+
+// How many sizes on either side of the one the fitted scale points to are
+// tried. The same however big the image, so that the search costs the same
+// too – the least squares fit is rarely more than a few pixels off.
+#define SEARCH_RADIUS 6
+// How many times the contrasts are numbered and fitted, each time going by
+// the scale from the time before.
+#define NUM_FITTING_PASSES 3
+
+static const enum sampling_point sampling_points[] = {
+    SAMPLED_AT_CENTER,
+    SAMPLED_AT_BOTTOM_RIGHT,
+    SAMPLED_AT_TOP_LEFT,
+    SAMPLED_AT_CENTER_ROUNDING_DOWN
+};
+#define NUM_SAMPLING_POINTS (sizeof(sampling_points) / sizeof(sampling_points[0]))
+
+struct candidate {
+    size_t dimension;
+    enum sampling_point sampling_point;
+    size_t num_fitting_contrasts;
+};
+
+static double fit_scale(const struct contrast_set* contrasts, double scale);
+static double lead_with_every_contrast(size_t scaled_size, const struct candidate* best, const struct candidate* runner_up);
+static size_t count_fitting_contrasts(const struct contrast_set* contrasts, size_t dimension, enum sampling_point sampling_point);
+static inline bool predicts_contrast(size_t i, size_t dimension, size_t scaled_size, enum sampling_point sampling_point);
+
+/*
+    A nearest neighbor algorithm maps scaled pixel i to original pixel
+    floor((i + offset) × dimension / scaled size), where the offset depends
+    on where it samples. So the contrasts fall at (roughly) evenly spaced
+    points along a line whose slope is the scale – and the contrasts that
+    are known, however few, pin it down.
+
+    First, every known contrast is numbered with the original pixel it
+    starts, going by the distance from the last one and the scale, and a
+    line is fitted to them by least squares – a few times over, each time
+    going by the last fitted scale. That gives a dimension. Then, each
+    dimension close to that and each sampling point is checked against the
+    known contrasts exactly, and whichever explains the most of them wins.
+    All in all, that's NUM_FITTING_PASSES passes over the known contrasts,
+    and one for each sampling point and each of the 2 × SEARCH_RADIUS + 1
+    dimensions tried – plus one over every column/row, for the confidence.
+
+    How far ahead the winner is of the best other dimension says how sure
+    the fit is – but even if every contrast were known, the two would agree
+    on plenty of them, so that's compared to how far ahead it would be then.
+
+    estimated_scale is what to start out with, like the average width of the
+    runs that look like single pixels.
+*/
+void fit_nearest_neighbor(const struct contrast_set* contrasts, double estimated_scale, struct nearest_neighbor_fit* fit)
+{
+    size_t scaled_size = contrasts->size;
+    fit->scale = estimated_scale;
+    for (int pass = 0; pass < NUM_FITTING_PASSES; pass++) {
+        fit->scale = fit_scale(contrasts, fit->scale);
+    }
+    fit->num_known_contrasts = 0;
+    for (size_t i = next_contrast(contrasts, 0); i < scaled_size; i = next_contrast(contrasts, i)) {
+        fit->num_known_contrasts++;
+    }
+
+    double scaled_dimension = scaled_size / fit->scale;
+    size_t center = (size_t) (scaled_dimension + 0.5);
+    size_t first = center > SEARCH_RADIUS ? center - SEARCH_RADIUS : 1;
+    size_t last = center + SEARCH_RADIUS < scaled_size ? center + SEARCH_RADIUS : scaled_size;
+
+    struct candidate best = {0, SAMPLED_AT_CENTER, 0};
+    struct candidate runner_up = {0, SAMPLED_AT_CENTER, 0};
+    for (size_t dimension = first; dimension <= last; dimension++) {
+        struct candidate candidate = {dimension, SAMPLED_AT_CENTER, 0};
+        for (size_t i = 0; i < NUM_SAMPLING_POINTS; i++) {
+            size_t count = count_fitting_contrasts(contrasts, dimension, sampling_points[i]);
+            if (count > candidate.num_fitting_contrasts || i == 0) {
+                candidate.sampling_point = sampling_points[i];
+                candidate.num_fitting_contrasts = count;
+            }
+        }
+
+        // Ties go to whichever's closest to the fitted scale.
+        bool better =
+            best.dimension == 0 || candidate.num_fitting_contrasts > best.num_fitting_contrasts || (
+                candidate.num_fitting_contrasts == best.num_fitting_contrasts &&
+                fabs(dimension - scaled_dimension) < fabs(best.dimension - scaled_dimension)
+            );
+        if (better) {
+            runner_up = best;
+            best = candidate;
+        } else if (runner_up.dimension == 0 || candidate.num_fitting_contrasts > runner_up.num_fitting_contrasts) {
+            runner_up = candidate;
+        }
+    }
+
+    fit->dimension = best.dimension;
+    fit->sampling_point = best.sampling_point;
+    fit->num_fitting_contrasts = best.num_fitting_contrasts;
+    fit->confidence = 0;
+    if (fit->num_known_contrasts > 0 && runner_up.dimension != 0) {
+        double lead = (double) (best.num_fitting_contrasts - runner_up.num_fitting_contrasts) / fit->num_known_contrasts;
+        double full_lead = lead_with_every_contrast(scaled_size, &best, &runner_up);
+        fit->confidence = full_lead > lead ? lead / full_lead : 1;
+    }
+}
+
+/*
+    Numbers the known contrasts going by scale and fits a line through them,
+    returning its slope. Contrasts less than half a pixel from the last one
+    can't be where a new original pixel starts, so they're left out.
+*/
+static double fit_scale(const struct contrast_set* contrasts, double scale)
+{
+    // The first column/row starts original pixel 0.
+    double n = 1;
+    double sum_pixels = 0;
+    double sum_positions = 0;
+    double sum_pixels_squared = 0;
+    double sum_products = 0;
+
+    size_t pixel = 0;
+    size_t last_position = 0;
+    for (size_t i = next_contrast(contrasts, 0); i < contrasts->size; i = next_contrast(contrasts, i)) {
+        size_t num_pixels = (size_t) ((i - last_position) / scale + 0.5);
+        if (num_pixels == 0) {continue;}
+        pixel += num_pixels;
+        last_position = i;
+
+        n++;
+        sum_pixels += pixel;
+        sum_positions += i;
+        sum_pixels_squared += (double) pixel * pixel;
+        sum_products += (double) pixel * i;
+    }
+
+    double variance = n * sum_pixels_squared - sum_pixels * sum_pixels;
+    if (variance <= 0) {return scale;}
+    double slope = (n * sum_products - sum_pixels * sum_positions) / variance;
+    // Nearest neighbor scaling can't make an image any smaller.
+    return slope >= 1 ? slope : scale;
+}
+
+/*
+    How far ahead of the runner-up the best fit would be if every one of its
+    contrasts were known: the share of them that the runner-up doesn't
+    predict.
+*/
+static double lead_with_every_contrast(size_t scaled_size, const struct candidate* best, const struct candidate* runner_up)
+{
+    size_t num_contrasts = 0;
+    size_t num_shared = 0;
+    for (size_t i = 1; i < scaled_size; i++) {
+        if (predicts_contrast(i, best->dimension, scaled_size, best->sampling_point)) {
+            num_contrasts++;
+            if (predicts_contrast(i, runner_up->dimension, scaled_size, runner_up->sampling_point)) {num_shared++;}
+        }
+    }
+    return num_contrasts == 0 ? 0 : (double) (num_contrasts - num_shared) / num_contrasts;
+}
+
+// How many of the known contrasts a given fit predicts.
+static size_t count_fitting_contrasts(const struct contrast_set* contrasts, size_t dimension, enum sampling_point sampling_point)
+{
+    size_t count = 0;
+    for (size_t i = next_contrast(contrasts, 0); i < contrasts->size; i = next_contrast(contrasts, i)) {
+        if (predicts_contrast(i, dimension, contrasts->size, sampling_point)) {count++;}
+    }
+    return count;
+}
+
+static inline bool predicts_contrast(size_t i, size_t dimension, size_t scaled_size, enum sampling_point sampling_point)
+{
+    return source_pixel(i, dimension, scaled_size, sampling_point) != source_pixel(i - 1, dimension, scaled_size, sampling_point);
+}
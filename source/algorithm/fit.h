@@ -0,0 +1,63 @@
+/*
+    Fitting a model of nearest neighbor scaling to a set of contrasts that's
+    missing some, to find the original size of a dimension from where the
+    contrasts that are known fall – rather than just from how wide the runs
+    between them are.
+*/
+#ifndef FIT_H
+#define FIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "algorithm/contrast_set.h"
+
+// Where in each scaled pixel a nearest neighbor algorithm samples the
+// original image, which decides where the wider and narrower runs fall.
+enum sampling_point {
+    // The center, with ties going to the pixel after. What ImageMagick does.
+    SAMPLED_AT_CENTER,
+    // What Paint.net does.
+    SAMPLED_AT_BOTTOM_RIGHT,
+    SAMPLED_AT_TOP_LEFT,
+    SAMPLED_AT_CENTER_ROUNDING_DOWN
+};
+
+struct nearest_neighbor_fit {
+    size_t dimension;
+    enum sampling_point sampling_point;
+    double scale;
+    // How many of the known contrasts (other than the first column/row,
+    // which always is one) the fit puts exactly where they are.
+    size_t num_known_contrasts;
+    size_t num_fitting_contrasts;
+    // From 0 to 1: how many more of the known contrasts the fit explains
+    // than the best fit of any other size does, compared to how many more it
+    // would if every contrast were known. 0 means it's a toss-up.
+    double confidence;
+};
+
+void fit_nearest_neighbor(const struct contrast_set* contrasts, double estimated_scale, struct nearest_neighbor_fit* fit);
+
+// Which original pixel scaled pixel i comes from.
+static inline size_t source_pixel(size_t i, size_t dimension, size_t scaled_size, enum sampling_point sampling_point)
+{
+    uint64_t pixel;
+    switch (sampling_point) {
+        case SAMPLED_AT_BOTTOM_RIGHT:
+            pixel = (uint64_t) (i + 1) * dimension / scaled_size;
+            break;
+        case SAMPLED_AT_TOP_LEFT:
+            pixel = (uint64_t) i * dimension / scaled_size;
+            break;
+        case SAMPLED_AT_CENTER_ROUNDING_DOWN:
+            // Rounding (i + 0.5) × dimension / scaled_size up and subtracting
+            // 1, so that landing right on an edge goes to the pixel before.
+            pixel = ((uint64_t) (2 * i + 1) * dimension + 2 * scaled_size - 1) / (2 * scaled_size) - 1;
+            break;
+        default:
+            pixel = (uint64_t) (2 * i + 1) * dimension / (2 * scaled_size);
+    }
+    return pixel < dimension ? pixel : dimension - 1;
+}
+
+#endif
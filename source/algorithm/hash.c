@@ -0,0 +1,158 @@
+#include "algorithm/hash.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PRIME_1 UINT64_C(0x9E3779B185EBCA87)
+#define PRIME_2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PRIME_3 UINT64_C(0x165667B19E3779F9)
+#define PRIME_4 UINT64_C(0x85EBCA77C2B2AE63)
+#define PRIME_5 UINT64_C(0x27D4EB2F165667C5)
+
+// How much of a file is read at a time. Has to be a multiple of the
+// 32-byte stripes the hash consumes.
+#define CHUNK_SIZE (1 << 16)
+
+struct hash_state {
+    uint64_t lanes[4];
+    uint64_t size;
+};
+
+static void start_hash(struct hash_state* state);
+static void hash_stripes(struct hash_state* state, const unsigned char* data, size_t num_stripes);
+static uint64_t finish_hash(const struct hash_state* state, const unsigned char* rest, size_t rest_size);
+static inline uint64_t hash_round(uint64_t accumulator, uint64_t input);
+static inline uint64_t merge_round(uint64_t accumulator, uint64_t lane);
+static inline uint64_t rotate_left(uint64_t value, int amount);
+static inline uint64_t read_64(const unsigned char* bytes);
+static inline uint32_t read_32(const unsigned char* bytes);
+
+/*
+    Hash everything from the file's current position to its end. Returns
+    false if it couldn't all be read.
+*/
+bool hash_file(FILE* file, uint64_t* hash, uint64_t* size)
+{
+    unsigned char* chunk = (unsigned char*) malloc(CHUNK_SIZE * sizeof(unsigned char));
+    if (chunk == NULL) {return false;}
+
+    struct hash_state state;
+    start_hash(&state);
+    size_t chunk_size;
+    while ((chunk_size = fread(chunk, 1, CHUNK_SIZE, file)) == CHUNK_SIZE) {
+        hash_stripes(&state, chunk, CHUNK_SIZE / 32);
+    }
+    bool read = !ferror(file);
+    if (read) {
+        // Only the very last chunk can come up short.
+        hash_stripes(&state, chunk, chunk_size / 32);
+        *hash = finish_hash(&state, chunk + chunk_size / 32 * 32, chunk_size % 32);
+        *size = state.size + chunk_size % 32;
+    }
+
+    free(chunk);
+    return read;
+}
+
+uint64_t hash_bytes(const void* data, size_t size)
+{
+    struct hash_state state;
+    start_hash(&state);
+    hash_stripes(&state, (const unsigned char*) data, size / 32);
+    return finish_hash(&state, (const unsigned char*) data + size / 32 * 32, size % 32);
+}
+
+static void start_hash(struct hash_state* state)
+{
+    state->lanes[0] = PRIME_1 + PRIME_2;
+    state->lanes[1] = PRIME_2;
+    state->lanes[2] = 0;
+    state->lanes[3] = -PRIME_1;
+    state->size = 0;
+}
+
+static void hash_stripes(struct hash_state* state, const unsigned char* data, size_t num_stripes)
+{
+    uint64_t lane_0 = state->lanes[0];
+    uint64_t lane_1 = state->lanes[1];
+    uint64_t lane_2 = state->lanes[2];
+    uint64_t lane_3 = state->lanes[3];
+    for (size_t i = 0; i < num_stripes; i++, data += 32) {
+        lane_0 = hash_round(lane_0, read_64(data));
+        lane_1 = hash_round(lane_1, read_64(data + 8));
+        lane_2 = hash_round(lane_2, read_64(data + 16));
+        lane_3 = hash_round(lane_3, read_64(data + 24));
+    }
+    state->lanes[0] = lane_0;
+    state->lanes[1] = lane_1;
+    state->lanes[2] = lane_2;
+    state->lanes[3] = lane_3;
+    state->size += num_stripes * 32;
+}
+
+static uint64_t finish_hash(const struct hash_state* state, const unsigned char* rest, size_t rest_size)
+{
+    uint64_t hash;
+    if (state->size >= 32) {
+        hash = rotate_left(state->lanes[0], 1) + rotate_left(state->lanes[1], 7) +
+            rotate_left(state->lanes[2], 12) + rotate_left(state->lanes[3], 18);
+        for (int i = 0; i < 4; i++) {
+            hash = merge_round(hash, state->lanes[i]);
+        }
+    } else {
+        hash = PRIME_5;
+    }
+    hash += state->size + rest_size;
+
+    for (; rest_size >= 8; rest += 8, rest_size -= 8) {
+        hash ^= hash_round(0, read_64(rest));
+        hash = rotate_left(hash, 27) * PRIME_1 + PRIME_4;
+    }
+    if (rest_size >= 4) {
+        hash ^= (uint64_t) read_32(rest) * PRIME_1;
+        hash = rotate_left(hash, 23) * PRIME_2 + PRIME_3;
+        rest += 4;
+        rest_size -= 4;
+    }
+    for (; rest_size > 0; rest++, rest_size--) {
+        hash ^= *rest * PRIME_5;
+        hash = rotate_left(hash, 11) * PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static inline uint64_t hash_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * PRIME_2;
+    return rotate_left(accumulator, 31) * PRIME_1;
+}
+
+static inline uint64_t merge_round(uint64_t accumulator, uint64_t lane)
+{
+    accumulator ^= hash_round(0, lane);
+    return accumulator * PRIME_1 + PRIME_4;
+}
+
+static inline uint64_t rotate_left(uint64_t value, int amount) {return (value << amount) | (value >> (64 - amount));}
+
+// Little-endian, whatever the machine, so that hashes are the same
+// everywhere.
+static inline uint64_t read_64(const unsigned char* bytes)
+{
+    return (uint64_t) read_32(bytes) | (uint64_t) read_32(bytes + 4) << 32;
+}
+
+static inline uint32_t read_32(const unsigned char* bytes)
+{
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
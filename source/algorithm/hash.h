@@ -0,0 +1,16 @@
+/*
+    A fast, non-cryptographic hash of a file's contents, for recognizing
+    screenshots that have already been scanned. It's XXH64 (with a seed of
+    0), which runs at close to the speed of reading memory.
+*/
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+bool hash_file(FILE* file, uint64_t* hash, uint64_t* size);
+uint64_t hash_bytes(const void* data, size_t size);
+
+#endif
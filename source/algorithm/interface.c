@@ -2,24 +2,128 @@
 
 #include <stdbool.h>
 #include <stddef.h>
-#ifdef IMAGEMAGICK_7
-#include <MagickWand/MagickWand.h>
-#endif
-#ifdef IMAGEMAGICK_6
-#include <wand/MagickWand.h>
-#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "algorithm/cache.h"
+#include "algorithm/compare.h"
 #include "algorithm/contrast.h"
+#include "algorithm/contrast_set.h"
 #include "algorithm/dimensions.h"
+#include "algorithm/pipeline.h"
+#include "algorithm/pool.h"
+#include "algorithm/profile.h"
+#include "algorithm/simd.h"
+#include "algorithm/unscale.h"
+#include "input/mapping.h"
+#include "input/reader.h"
+#include "output/writer.h"
+#include "stats/stats.h"
 
-#define ThrowWandException(wand) \
-{ \
-  char* description; \
-  ExceptionType severity; \
-  description = MagickGetException(wand, &severity); \
-  (void) fprintf(stderr, "%s %s %lu %s\n", GetMagickModule(), description); \
-  description = (char*) MagickRelinquishMemory(description); \
-  exit(-1); \
-}
+// How many threads to scan each image with. 0 means one per CPU core.
+size_t num_scan_threads = 0;
+// How many screenshots to decode in the background while scanning others.
+// 0 means decoding and scanning one after another.
+size_t num_decode_threads = 2;
+// How many pixels the last call to determine_dimensions went through, and
+// how many of those it actually had to look at.
+size_t num_pixels_scanned = 0;
+size_t num_pixels_touched = 0;
+// How sure the last call to determine_dimensions was of each dimension,
+// from 0 to 1.
+double width_confidence = 0;
+double height_confidence = 0;
+// The region of the screenshots that the last call to determine_dimensions
+// (or scan_stream_frames) scanned – all of them, unless asked otherwise
+// (see scan_region and trim_borders).
+struct scan_region active_area = {0, 0, 0, 0};
+// If set, determine_dimensions also writes each screenshot out scaled back
+// down (see unscale.h) to this path – or, if there are several, into this
+// directory, under their own names (see output_file_path).
+const char* output_path = NULL;
+
+struct dimension_scanner {
+    unsigned char* pixels;
+    size_t pixels_size;
+    struct contrasts* contrasts;
+    struct worker_pool* pool;
+    // Whether pixels holds the whole of the last screenshot scanned – it
+    // having only the one frame – so that writing it out needn't decode it
+    // all over again.
+    bool holds_screenshot;
+    // Of the last screenshot scanned.
+    double width_confidence;
+    double height_confidence;
+    // Unless has_settings is set (see set_scanner_settings), the global
+    // settings are scanned with.
+    bool has_settings;
+    enum pixel_comparison comparison;
+    unsigned char leeway;
+    int nearest_neighbor_max_variation;
+};
+
+struct dimension_profile {
+    const char* path;
+    struct profile_header header;
+    struct cache_key* hashes;
+    size_t hashes_capacity;
+    // NULL until the first screenshot's gone in.
+    struct contrasts* contrasts;
+    struct dimension_scanner* scanner;
+};
+
+struct dimension_stream {
+    const char* path;
+    struct contrasts* contrasts;
+    struct worker_pool* pool;
+    struct decode_pipeline* pipeline;
+    // Whether there's no point in scanning any more frames: the stream's
+    // ended, every column and row has been marked, or – when scanning
+    // progressively – a frame didn't change the dimensions.
+    bool done;
+    size_t last_width;
+    size_t last_height;
+};
+
+static void update_contrasts_from_paths(struct contrasts* contrasts, unsigned char pixels[], size_t num_image_paths, char** image_paths);
+static void update_contrasts_from_pipeline(struct contrasts* contrasts, struct decode_pipeline* pipeline, char** image_paths);
+static void determine_dimensions_through_cache(
+    size_t num_image_paths, char** image_paths,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height
+);
+static int scan_reader_dimensions(
+    struct dimension_scanner* scanner, struct image_reader* reader, const struct cache_key* cache_key,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height,
+    char error_description[READER_ERROR_SIZE]
+);
+static bool load_cached_contrasts(struct dimension_scanner* scanner, const struct cache_key* cache_key, size_t* scaled_width, size_t* scaled_height);
+static void determine_both_dimensions(
+    const struct contrasts* contrasts,
+    size_t* determined_width, size_t* determined_height,
+    double* width_confidence, double* height_confidence
+);
+static void record_contrast_run_widths(const struct contrasts* contrasts);
+static struct scan_region region_scanned(const struct contrasts* contrasts);
+static int prepare_dimension_scanner(struct dimension_scanner* scanner, size_t width, size_t height);
+static unsigned char scanner_leeway(const struct dimension_scanner* scanner);
+static void write_unscaled_screenshots(
+    const struct contrasts* contrasts, unsigned char pixels[], bool holds_first_screenshot,
+    size_t num_image_paths, char** image_paths,
+    size_t determined_width, size_t determined_height
+);
+static int write_unscaled_screenshot(
+    const struct unscale_plan* plan, const char* image_path, unsigned char pixels[], bool holds_screenshot,
+    const char* path, char error_description[READER_ERROR_SIZE]
+);
+static int read_unscaled_screenshot(
+    const struct unscale_plan* plan, const char* image_path, unsigned char pixels[], unsigned char output[],
+    char error_description[READER_ERROR_SIZE]
+);
+static bool profile_has_hash(const struct dimension_profile* profile, const struct cache_key* key);
+static bool add_profile_hash(struct dimension_profile* profile, const struct cache_key* key);
+static void exit_with_scan_error(int error, const char* image_path, const char* error_description);
 
 void determine_dimensions(
     size_t num_image_paths, char** image_paths,
@@ -27,57 +131,899 @@ void determine_dimensions(
     size_t* determined_width, size_t* determined_height
 )
 {
-    MagickWandGenesis();
-
-    MagickWand* wand = NewMagickWand();
-    MagickBooleanType status = MagickReadImage(wand, image_paths[0]);
-    if (status == MagickFalse) {ThrowWandException(wand);}
-    MagickResetIterator(wand);
-    MagickNextImage(wand);
-    *scaled_width = MagickGetImageWidth(wand);
-    *scaled_height = MagickGetImageHeight(wand);
-    unsigned char* pixels = (unsigned char*) malloc(*scaled_width * *scaled_height * 3 * sizeof(unsigned char));
-    bool* column_contrasts = (bool*) calloc(*scaled_width, sizeof(bool));
-    bool* row_contrasts = (bool*) calloc(*scaled_height, sizeof(bool));
-    // Since the leftmost / top pixel in a scaled image always starts
-    // a new pixel in the source image.
-    column_contrasts[0] = true;
-    row_contrasts[0] = true;
-
-    update_contrasts_from_wand(*scaled_width, column_contrasts, *scaled_height, row_contrasts, pixels, wand);
-
-    wand = DestroyMagickWand(wand);
-
-    for (size_t i = 1; i < num_image_paths; i++) {
-        char* cur_path = image_paths[i];
-        wand = NewMagickWand();
-        MagickBooleanType status = MagickReadImage(wand, cur_path);
-        if (status == MagickFalse) {ThrowWandException(wand);}
-
-        int error = update_contrasts_from_wand(*scaled_width, column_contrasts, *scaled_height, row_contrasts, pixels, wand);
-        if (error) {
-            fprintf(stderr, "ERROR: Screenshots not of the same resolution (\"%s\" differs).", image_paths[i]);
+    if (cache_directory != NULL) {
+        determine_dimensions_through_cache(
+            num_image_paths, image_paths,
+            scaled_width, scaled_height,
+            determined_width, determined_height
+        );
+        return;
+    }
+
+    select_simd_kernels();
+
+    char error_description[READER_ERROR_SIZE];
+    struct image_reader* reader = open_image(image_paths[0], error_description);
+    if (reader == NULL) {exit_with_scan_error(SCAN_READ_FAILED, image_paths[0], error_description);}
+    if (!next_frame(reader)) {exit_with_scan_error(SCAN_READ_FAILED, image_paths[0], reader->error_description);}
+    *scaled_width = reader->width;
+    *scaled_height = reader->height;
+    unsigned char* pixels = (unsigned char*) malloc(scan_buffer_size(*scaled_width, *scaled_height) * sizeof(unsigned char));
+    struct contrasts* contrasts = create_contrasts(*scaled_width, *scaled_height);
+    if (pixels == NULL || contrasts == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        exit(-1);
+    }
+    // If the threads can't be started, it's no big deal – the scan just
+    // happens on this thread instead.
+    struct worker_pool* pool = create_worker_pool(num_scan_threads ? num_scan_threads : count_cpu_cores());
+    contrasts->pool = pool;
+
+    // The rest of the screenshots start decoding right away, so that they're
+    // (hopefully) ready by the time the first one's been scanned. Not when
+    // scanning in strips, though – the point of that is to keep memory use
+    // down, and reading ahead means keeping several whole images around.
+    // Nor when the first one can be scanned right where it is in memory:
+    // there's nothing to decode then, so the rest are just fetched ahead
+    // of time instead, one by one.
+    struct decode_pipeline* pipeline = NULL;
+    if (num_image_paths > 1 && num_decode_threads > 0 && scan_strip_height == 0 && reader->frame_pixels == NULL) {
+        pipeline = start_decode_pipeline(num_image_paths - 1, image_paths + 1, *scaled_width, *scaled_height, num_decode_threads);
+    } else if (num_image_paths > 1) {
+        prefetch_file(image_paths[1]);
+    }
+
+    int error = update_contrasts_from_reader(contrasts, pixels, reader);
+    if (error) {exit_with_scan_error(error, image_paths[0], reader->error_description);}
+
+    bool scanned_in_place = reader->frame_pixels != NULL;
+    bool scanned_as_indices = reader->pixel_size != 3;
+    close_image(reader);
+
+    // Unless it's been scanned in strips, in place or as palette indices, or
+    // had more frames, the first screenshot is still in the pixel buffer –
+    // so long as the rest aren't going to be read into it.
+    bool holds_first_screenshot =
+        !scanned_in_place && !scanned_as_indices &&
+        (scan_strip_height == 0 || scan_strip_height >= *scaled_height) &&
+        contrasts->num_pixels == contrasts->columns->size * contrasts->rows->size &&
+        (pipeline != NULL || num_image_paths == 1 || contrasts_saturated(contrasts));
+
+    if (pipeline != NULL) {
+        update_contrasts_from_pipeline(contrasts, pipeline, image_paths + 1);
+        stop_decode_pipeline(pipeline);
+    } else {
+        update_contrasts_from_paths(contrasts, pixels, num_image_paths - 1, image_paths + 1);
+    }
+
+    determine_both_dimensions(contrasts, determined_width, determined_height, &width_confidence, &height_confidence);
+    num_pixels_scanned = contrasts->num_pixels;
+    num_pixels_touched = contrasts->num_pixels_touched;
+    active_area = region_scanned(contrasts);
+
+    if (output_path != NULL) {
+        write_unscaled_screenshots(
+            contrasts, pixels, holds_first_screenshot,
+            num_image_paths, image_paths,
+            *determined_width, *determined_height
+        );
+    }
+
+    free(pixels);
+    destroy_contrasts(contrasts);
+    destroy_worker_pool(pool);
+}
+
+/*
+    determine_dimensions, for when there's a cache: each screenshot is
+    looked up (or scanned on its own and stored) and its contrasts merged
+    in, rather than every screenshot being scanned into the same contrasts.
+*/
+static void determine_dimensions_through_cache(
+    size_t num_image_paths, char** image_paths,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height
+)
+{
+    struct dimension_scanner* scanner = create_dimension_scanner();
+    if (scanner == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        exit(-1);
+    }
+
+    struct contrasts* contrasts = NULL;
+    num_pixels_scanned = 0;
+    num_pixels_touched = 0;
+    for (size_t i = 0; i < num_image_paths && (contrasts == NULL || !contrasts_saturated(contrasts)); i++) {
+        size_t width;
+        size_t height;
+        size_t unused_width;
+        size_t unused_height;
+        char error_description[READER_ERROR_SIZE];
+        int error = scan_image_dimensions(
+            scanner, image_paths[i],
+            &width, &height,
+            &unused_width, &unused_height,
+            error_description
+        );
+        if (error) {exit_with_scan_error(error, image_paths[i], error_description);}
+
+        if (contrasts == NULL) {
+            *scaled_width = width;
+            *scaled_height = height;
+            contrasts = create_contrasts(width, height);
+            if (contrasts == NULL) {
+                fprintf(stderr, "ERROR: Out of memory.\n");
+                exit(-1);
+            }
+        } else if (width != *scaled_width || height != *scaled_height) {
+            exit_with_scan_error(SCAN_WRONG_SIZE, image_paths[i], NULL);
+        }
+        merge_contrast_sets(contrasts->columns, scanner->contrasts->columns);
+        merge_contrast_sets(contrasts->rows, scanner->contrasts->rows);
+        refresh_undecided(contrasts);
+        num_pixels_scanned += scanner->contrasts->num_pixels;
+        num_pixels_touched += scanner->contrasts->num_pixels_touched;
+    }
+    active_area = region_scanned(contrasts);
+
+    determine_both_dimensions(contrasts, determined_width, determined_height, &width_confidence, &height_confidence);
+
+    if (output_path != NULL) {
+        write_unscaled_screenshots(
+            contrasts, NULL, false,
+            num_image_paths, image_paths,
+            *determined_width, *determined_height
+        );
+    }
+
+    destroy_contrasts(contrasts);
+    destroy_dimension_scanner(scanner);
+}
+
+/*
+    For determining the dimensions of a stream of frames (see
+    open_image_stream) as they come in – e.g. live emulator or capture card
+    output piped from ffmpeg. Frames are read in the background into a ring
+    of reusable buffers (one more than num_decode_threads, and at least two)
+    and scanned straight from there. Exits if the stream can't be read.
+*/
+struct dimension_stream* open_dimension_stream(const char* path, enum stream_format format, size_t width, size_t height)
+{
+    select_simd_kernels();
+
+    char error_description[READER_ERROR_SIZE];
+    struct image_reader* reader = open_image_stream(path, format, width, height, error_description);
+    if (reader == NULL) {exit_with_scan_error(SCAN_READ_FAILED, path, error_description);}
+    if (!next_frame(reader)) {exit_with_scan_error(SCAN_READ_FAILED, path, reader->error_description);}
+
+    struct dimension_stream* stream = (struct dimension_stream*) calloc(1, sizeof(struct dimension_stream));
+    if (stream != NULL) {
+        stream->path = path;
+        stream->contrasts = create_contrasts(reader->width, reader->height);
+        stream->pipeline = start_stream_pipeline(reader, num_decode_threads + 1);
+    }
+    if (stream == NULL || stream->contrasts == NULL || stream->pipeline == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        exit(-1);
+    }
+    stream->pool = create_worker_pool(num_scan_threads ? num_scan_threads : count_cpu_cores());
+    stream->contrasts->pool = stream->pool;
+    return stream;
+}
+
+/*
+    Scans up to num_frames more frames of the stream (0 meaning as many as
+    there are), and determines the dimensions from every frame so far.
+    Returns false once there's no point in calling this again.
+*/
+bool scan_stream_frames(
+    struct dimension_stream* stream, size_t num_frames,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height
+)
+{
+    struct contrasts* contrasts = stream->contrasts;
+    for (size_t i = 0; num_frames == 0 || i < num_frames; i++) {
+        stream->done = contrasts_saturated(contrasts) || (
+            scans_progressively(contrasts) &&
+            dimensions_settled(contrasts, &stream->last_width, &stream->last_height)
+        );
+        if (stream->done) {break;}
+
+        struct decoded_frame* frame = next_decoded_frame(stream->pipeline);
+        if (frame == NULL) {
+            stream->done = true;
+            break;
+        }
+        int error;
+        switch (frame->status) {
+            case FRAME_DECODED:
+                error = update_contrasts_from_whole_image(contrasts, frame->pixels);
+                if (error) {exit_with_scan_error(error, stream->path, NULL);}
+                break;
+            case FRAME_READ_FAILED:
+                exit_with_scan_error(SCAN_READ_FAILED, stream->path, frame->error_description);
+                break;
+            case FRAME_WRONG_SIZE:
+                exit_with_scan_error(SCAN_WRONG_SIZE, stream->path, NULL);
+                break;
+        }
+        release_decoded_frame(stream->pipeline, frame);
+    }
+
+    *scaled_width = contrasts->columns->size;
+    *scaled_height = contrasts->rows->size;
+    determine_both_dimensions(contrasts, determined_width, determined_height, &width_confidence, &height_confidence);
+    num_pixels_scanned = contrasts->num_pixels;
+    num_pixels_touched = contrasts->num_pixels_touched;
+    active_area = region_scanned(contrasts);
+    return !stream->done;
+}
+
+// Stops reading the stream, even if it hasn't ended.
+void close_dimension_stream(struct dimension_stream* stream)
+{
+    stop_decode_pipeline(stream->pipeline);
+    destroy_contrasts(stream->contrasts);
+    destroy_worker_pool(stream->pool);
+    free(stream);
+}
+
+/*
+    For building up a profile (see profile.h) one screenshot at a time,
+    starting from what's saved at path – if anything is. Exits if what's
+    there isn't a profile, or was scanned with a different leeway. If path
+    is NULL, the profile's only ever kept in memory.
+*/
+struct dimension_profile* open_dimension_profile(const char* path)
+{
+    struct dimension_profile* profile = (struct dimension_profile*) calloc(1, sizeof(struct dimension_profile));
+    if (profile != NULL) {profile->scanner = create_dimension_scanner();}
+    if (profile == NULL || profile->scanner == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        exit(-1);
+    }
+    profile->path = path;
+    profile->header.leeway = pixel_comparison_leeway();
+    if (path == NULL) {return profile;}
+
+    struct profile_header header;
+    FILE* file;
+    int status = open_profile(path, &header, &file);
+    if (status == PROFILE_MISSING) {return profile;}
+    if (status == PROFILE_OK && header.leeway != profile->header.leeway) {
+        fprintf(stderr, "ERROR: Profile \"%s\" was made with a different --inexact or --leeway.\n", path);
+        exit(-1);
+    }
+    if (status == PROFILE_OK) {
+        profile->contrasts = create_contrasts(header.width, header.height);
+        profile->hashes = (struct cache_key*) malloc((header.num_hashes > 0 ? header.num_hashes : 1) * sizeof(struct cache_key));
+        if (profile->contrasts == NULL || profile->hashes == NULL) {
+            fprintf(stderr, "ERROR: Out of memory.\n");
             exit(-1);
         }
+        profile->hashes_capacity = header.num_hashes > 0 ? header.num_hashes : 1;
+        if (!read_profile(file, &header, profile->hashes, profile->contrasts->columns, profile->contrasts->rows)) {
+            status = PROFILE_BROKEN;
+        }
+    }
+    if (status == PROFILE_BROKEN) {
+        fprintf(stderr, "ERROR: \"%s\" isn't a valid profile.\n", path);
+        exit(-1);
+    }
+    profile->header = header;
+    refresh_undecided(profile->contrasts);
+    return profile;
+}
 
-        wand = DestroyMagickWand(wand);
+/*
+    Scans the screenshot at image_path and merges its contrasts into the
+    profile – unless it's gone into the profile before, in which case it's
+    only hashed, and added is set to false. Returns the same errors as
+    scan_image_dimensions, as well as SCAN_WRONG_SIZE if the screenshot's
+    resolution isn't the same as the profile's.
+*/
+int add_to_dimension_profile(struct dimension_profile* profile, const char* image_path, bool* added, char error_description[READER_ERROR_SIZE])
+{
+    *added = false;
+    struct cache_key key;
+    bool hashed = make_cache_key(image_path, pixel_comparison_leeway(), &key);
+    if (hashed && profile_has_hash(profile, &key)) {return 0;}
+
+    size_t width;
+    size_t height;
+    size_t unused_width;
+    size_t unused_height;
+    int error = scan_image_dimensions(
+        profile->scanner, image_path,
+        &width, &height,
+        &unused_width, &unused_height,
+        error_description
+    );
+    if (error) {return error;}
+
+    if (profile->contrasts == NULL) {
+        profile->contrasts = create_contrasts(width, height);
+        if (profile->contrasts == NULL) {
+            strcpy(error_description, "Out of memory.");
+            return SCAN_OUT_OF_MEMORY;
+        }
+        profile->header.width = width;
+        profile->header.height = height;
+    } else if (width != profile->header.width || height != profile->header.height) {
+        strcpy(error_description, "Not of the same resolution as the profile.");
+        return SCAN_WRONG_SIZE;
     }
+    if (hashed && !add_profile_hash(profile, &key)) {
+        strcpy(error_description, "Out of memory.");
+        return SCAN_OUT_OF_MEMORY;
+    }
+
+    merge_contrast_sets(profile->contrasts->columns, profile->scanner->contrasts->columns);
+    merge_contrast_sets(profile->contrasts->rows, profile->scanner->contrasts->rows);
+    refresh_undecided(profile->contrasts);
+    profile->header.num_screenshots++;
+    *added = true;
+    return 0;
+}
+
+/*
+    Determines the dimensions from every screenshot in the profile. Returns
+    false if there aren't any.
+*/
+bool determine_profile_dimensions(
+    const struct dimension_profile* profile,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height
+)
+{
+    if (profile->contrasts == NULL) {return false;}
+    *scaled_width = profile->header.width;
+    *scaled_height = profile->header.height;
+    determine_both_dimensions(profile->contrasts, determined_width, determined_height, &width_confidence, &height_confidence);
+    // Nothing's sampled – the screenshots are long gone.
+    num_pixels_scanned = 0;
+    num_pixels_touched = 0;
+    active_area = region_scanned(profile->contrasts);
+    return true;
+}
+
+size_t profile_screenshot_count(const struct dimension_profile* profile) {return profile->header.num_screenshots;}
+
+// Returns false if the profile couldn't be written.
+bool save_dimension_profile(const struct dimension_profile* profile)
+{
+    if (profile->path == NULL || profile->contrasts == NULL) {return true;}
+    return write_profile(profile->path, &profile->header, profile->hashes, profile->contrasts->columns, profile->contrasts->rows);
+}
+
+void close_dimension_profile(struct dimension_profile* profile)
+{
+    destroy_dimension_scanner(profile->scanner);
+    destroy_contrasts(profile->contrasts);
+    free(profile->hashes);
+    free(profile);
+}
+
+static bool profile_has_hash(const struct dimension_profile* profile, const struct cache_key* key)
+{
+    for (size_t i = 0; i < profile->header.num_hashes; i++) {
+        if (profile->hashes[i].hash == key->hash && profile->hashes[i].size == key->size) {return true;}
+    }
+    return false;
+}
+
+static bool add_profile_hash(struct dimension_profile* profile, const struct cache_key* key)
+{
+    if (profile->header.num_hashes == profile->hashes_capacity) {
+        size_t capacity = profile->hashes_capacity > 0 ? 2 * profile->hashes_capacity : 16;
+        struct cache_key* hashes = (struct cache_key*) realloc(profile->hashes, capacity * sizeof(struct cache_key));
+        if (hashes == NULL) {return false;}
+        profile->hashes = hashes;
+        profile->hashes_capacity = capacity;
+    }
+    profile->hashes[profile->header.num_hashes++] = *key;
+    return true;
+}
+
+/*
+    For determining the dimensions of many unrelated screenshots one after
+    another, each on its own. The pixel buffer, contrasts and threads are
+    kept around between screenshots rather than set up anew for each one.
+    Returns NULL if there isn't enough memory.
+*/
+struct dimension_scanner* create_dimension_scanner(void)
+{
+    select_simd_kernels();
+
+    struct dimension_scanner* scanner = (struct dimension_scanner*) calloc(1, sizeof(struct dimension_scanner));
+    if (scanner == NULL) {return NULL;}
+    scanner->pool = create_worker_pool(num_scan_threads ? num_scan_threads : count_cpu_cores());
+    return scanner;
+}
+
+/*
+    Has the scanner scan with these settings from now on, rather than the
+    global ones (pixel_comparison, compare_pixel_fuzzy_fuzziness and
+    nearest_neighbor_max_variation) – so that scanners with different
+    settings can scan at the same time.
+*/
+void set_scanner_settings(struct dimension_scanner* scanner, enum pixel_comparison comparison, int fuzziness, int nearest_neighbor_max_variation)
+{
+    scanner->has_settings = true;
+    scanner->comparison = comparison;
+    scanner->leeway = comparison_leeway(comparison, fuzziness);
+    scanner->nearest_neighbor_max_variation = nearest_neighbor_max_variation;
+}
+
+void destroy_dimension_scanner(struct dimension_scanner* scanner)
+{
+    if (scanner == NULL) {return;}
+    free(scanner->pixels);
+    destroy_contrasts(scanner->contrasts);
+    destroy_worker_pool(scanner->pool);
+    free(scanner);
+}
+
+/*
+    Like determine_dimensions, but for a single screenshot (all frames of
+    which are scanned), and without exiting when something goes wrong.
+    Instead, returns SCAN_READ_FAILED, SCAN_WRONG_SIZE (if its frames
+    differ in size), SCAN_REGION_OUTSIDE or SCAN_OUT_OF_MEMORY, with a
+    description of what went wrong in error_description.
+*/
+int scan_image_dimensions(
+    struct dimension_scanner* scanner, const char* image_path,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height,
+    char error_description[READER_ERROR_SIZE]
+)
+{
+    scanner->holds_screenshot = false;
+    struct cache_key cache_key;
+    bool cacheable = cache_directory != NULL && make_cache_key(image_path, scanner_leeway(scanner), &cache_key);
+    if (cacheable && load_cached_contrasts(scanner, &cache_key, scaled_width, scaled_height)) {
+        determine_both_dimensions(
+            scanner->contrasts, determined_width, determined_height,
+            &scanner->width_confidence, &scanner->height_confidence
+        );
+        return 0;
+    }
+
+    error_description[0] = 0;
+    struct image_reader* reader = open_image(image_path, error_description);
+    if (reader == NULL) {return SCAN_READ_FAILED;}
+    return scan_reader_dimensions(
+        scanner, reader, cacheable ? &cache_key : NULL,
+        scaled_width, scaled_height,
+        determined_width, determined_height,
+        error_description
+    );
+}
+
+// The same as scan_image_dimensions, but for an image file held in memory.
+int scan_image_blob_dimensions(
+    struct dimension_scanner* scanner, const void* data, size_t size,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height,
+    char error_description[READER_ERROR_SIZE]
+)
+{
+    scanner->holds_screenshot = false;
+    struct cache_key cache_key;
+    bool cacheable = cache_directory != NULL && make_cache_key_for_blob(data, size, scanner_leeway(scanner), &cache_key);
+    if (cacheable && load_cached_contrasts(scanner, &cache_key, scaled_width, scaled_height)) {
+        determine_both_dimensions(
+            scanner->contrasts, determined_width, determined_height,
+            &scanner->width_confidence, &scanner->height_confidence
+        );
+        return 0;
+    }
+
+    error_description[0] = 0;
+    struct image_reader* reader = open_image_blob(data, size, error_description);
+    if (reader == NULL) {return SCAN_READ_FAILED;}
+    return scan_reader_dimensions(
+        scanner, reader, cacheable ? &cache_key : NULL,
+        scaled_width, scaled_height,
+        determined_width, determined_height,
+        error_description
+    );
+}
+
+/*
+    Scans every frame of an opened image, and closes it. If a cache key is
+    given, whatever's found is stored in the cache under it.
+*/
+static int scan_reader_dimensions(
+    struct dimension_scanner* scanner, struct image_reader* reader, const struct cache_key* cache_key,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height,
+    char error_description[READER_ERROR_SIZE]
+)
+{
+    int error = SCAN_READ_FAILED;
+    if (next_frame(reader)) {
+        *scaled_width = reader->width;
+        *scaled_height = reader->height;
+        error = prepare_dimension_scanner(scanner, reader->width, reader->height);
+        if (!error) {
+            error = update_contrasts_from_reader(scanner->contrasts, scanner->pixels, reader);
+        }
+    }
+    bool scanned_in_place = reader->frame_pixels != NULL;
+    bool scanned_as_indices = reader->pixel_size != 3;
+
+    switch (error) {
+        case 0: break;
+        case SCAN_WRONG_SIZE:
+            strcpy(error_description, "Frames not of the same resolution.");
+            break;
+        case SCAN_OUT_OF_MEMORY:
+            strcpy(error_description, "Out of memory.");
+            break;
+        case SCAN_REGION_OUTSIDE:
+            strcpy(error_description, "Region to scan doesn't fit in the screenshot.");
+            break;
+        default:
+            if (reader->error_description[0]) {
+                memcpy(error_description, reader->error_description, READER_ERROR_SIZE);
+            } else {
+                strcpy(error_description, "No image data.");
+            }
+    }
+    close_image(reader);
+    if (error) {return error;}
+
+    scanner->holds_screenshot =
+        !scanned_in_place && !scanned_as_indices &&
+        (scan_strip_height == 0 || scan_strip_height >= *scaled_height) &&
+        scanner->contrasts->num_pixels == scanner->contrasts->columns->size * scanner->contrasts->rows->size;
+    if (cache_key != NULL) {
+        write_cache_entry(cache_key, scanner->contrasts->columns, scanner->contrasts->rows);
+    }
+    determine_both_dimensions(
+        scanner->contrasts, determined_width, determined_height,
+        &scanner->width_confidence, &scanner->height_confidence
+    );
+    return 0;
+}
+
+// The region of the screenshot the scanner last went through.
+struct scan_region scanner_region(const struct dimension_scanner* scanner)
+{
+    if (scanner->contrasts == NULL) {
+        struct scan_region none = {0, 0, 0, 0};
+        return none;
+    }
+    return region_scanned(scanner->contrasts);
+}
+
+// How sure the scanner is of the last screenshot it went through.
+struct scan_quality scanner_quality(const struct dimension_scanner* scanner)
+{
+    struct scan_quality quality = {scanner->width_confidence, scanner->height_confidence, 0};
+    if (scanner->contrasts != NULL && scanner->contrasts->num_pixels > 0) {
+        quality.pixels_touched = (double) scanner->contrasts->num_pixels_touched / scanner->contrasts->num_pixels;
+    }
+    return quality;
+}
+
+/*
+    Writes the screenshot at image_path, which has to be the one the
+    scanner's just gone through, out scaled back down to path.
+    Returns SCAN_READ_FAILED, SCAN_WRONG_SIZE (if it's changed since),
+    SCAN_OUT_OF_MEMORY or SCAN_WRITE_FAILED, with a description of what went
+    wrong in error_description, if it can't be.
+*/
+int write_scanned_screenshot(
+    struct dimension_scanner* scanner, const char* image_path, const char* path,
+    size_t determined_width, size_t determined_height,
+    char error_description[READER_ERROR_SIZE]
+)
+{
+    struct unscale_plan* plan = create_unscale_plan(
+        scanner->contrasts->columns, scanner->contrasts->rows,
+        determined_width, determined_height
+    );
+    int error = SCAN_OUT_OF_MEMORY;
+    if (plan != NULL) {
+        const struct contrasts* contrasts = scanner->contrasts;
+        place_unscale_plan(plan, contrasts->region_x, contrasts->region_y, contrasts->frame_width, contrasts->frame_height);
+        error = write_unscaled_screenshot(plan, image_path, scanner->pixels, scanner->holds_screenshot, path, error_description);
+    }
+    destroy_unscale_plan(plan);
+
+    switch (error) {
+        case SCAN_WRONG_SIZE:
+            strcpy(error_description, "Resolution changed since scanning.");
+            break;
+        case SCAN_OUT_OF_MEMORY:
+            strcpy(error_description, "Out of memory.");
+            break;
+        case SCAN_READ_FAILED:
+            if (!error_description[0]) {strcpy(error_description, "No image data.");}
+            break;
+    }
+    return error;
+}
+
+static bool load_cached_contrasts(struct dimension_scanner* scanner, const struct cache_key* cache_key, size_t* scaled_width, size_t* scaled_height)
+{
+    size_t width;
+    size_t height;
+    FILE* entry = open_cache_entry(cache_key, &width, &height);
+    if (entry == NULL) {return false;}
+    if (
+        prepare_dimension_scanner(scanner, width, height) ||
+        !read_cache_entry(entry, scanner->contrasts->columns, scanner->contrasts->rows)
+    ) {
+        return false;
+    }
+    refresh_undecided(scanner->contrasts);
+    *scaled_width = width;
+    *scaled_height = height;
+    return true;
+}
+
+// The confidences can be NULL.
+static void determine_both_dimensions(
+    const struct contrasts* contrasts,
+    size_t* determined_width, size_t* determined_height,
+    double* width_confidence, double* height_confidence
+)
+{
+    enter_stats_phase(STATS_DETERMINE);
 
 #ifdef DEBUG
     printf("== COLUMNS (width) ==\n\n");
 #endif
 
-    *determined_width = determine_dimension(*scaled_width, column_contrasts);
+    // A region's edges needn't line up with the source pixels, the way
+    // trimmed borders' do.
+    size_t (*determine)(const struct contrast_set*, int, double*) =
+        contrasts->region.width > 0 ? determine_region_dimension : determine_dimension;
+
+    *determined_width = determine(contrasts->columns, contrasts->nearest_neighbor_max_variation, width_confidence);
 
 #ifdef DEBUG
     printf("== ROWS (height) ==\n\n");
 #endif
 
-    *determined_height = determine_dimension(*scaled_height, row_contrasts);
+    *determined_height = determine(contrasts->rows, contrasts->nearest_neighbor_max_variation, height_confidence);
 
-    free(pixels);
-    free(column_contrasts);
-    free(row_contrasts);
+    if (collect_stats) {record_contrast_run_widths(contrasts);}
+    leave_stats_phase();
+}
+
+static struct scan_region region_scanned(const struct contrasts* contrasts)
+{
+    struct scan_region region = {contrasts->region_x, contrasts->region_y, contrasts->columns->size, contrasts->rows->size};
+    return region;
+}
+
+static void record_contrast_run_widths(const struct contrasts* contrasts)
+{
+    struct run_analysis analysis;
+    if (!analyze_runs(contrasts->columns, contrasts->nearest_neighbor_max_variation, &analysis)) {
+        record_run_widths(false, analysis.thinnest, analysis.thickest);
+    }
+    if (!analyze_runs(contrasts->rows, contrasts->nearest_neighbor_max_variation, &analysis)) {
+        record_run_widths(true, analysis.thinnest, analysis.thickest);
+    }
+}
 
-    MagickWandTerminus();
+/*
+    Make sure the scanner's pixel buffer is big enough for an image of the
+    given size, and that its contrasts are fresh and of the right size.
+    Screenshots in a batch tend to share a resolution, so the contrasts are
+    only ever recreated when it changes. Either way, they're set up to scan
+    with the scanner's settings, if it has any, or the current global ones.
+*/
+static int prepare_dimension_scanner(struct dimension_scanner* scanner, size_t width, size_t height)
+{
+    size_t pixels_size = scan_buffer_size(width, height);
+    if (pixels_size > scanner->pixels_size) {
+        free(scanner->pixels);
+        scanner->pixels_size = 0;
+        scanner->pixels = (unsigned char*) malloc(pixels_size * sizeof(unsigned char));
+        if (scanner->pixels == NULL) {return SCAN_OUT_OF_MEMORY;}
+        scanner->pixels_size = pixels_size;
+    }
+
+    if (
+        scanner->contrasts != NULL &&
+        scanner->contrasts->frame_width == width && scanner->contrasts->frame_height == height
+    ) {
+        reset_contrasts(scanner->contrasts);
+        use_global_settings(scanner->contrasts);
+    } else {
+        destroy_contrasts(scanner->contrasts);
+        scanner->contrasts = create_contrasts(width, height);
+        if (scanner->contrasts == NULL) {return SCAN_OUT_OF_MEMORY;}
+        scanner->contrasts->pool = scanner->pool;
+    }
+    if (scanner->has_settings) {
+        scanner->contrasts->comparison = scanner->comparison;
+        scanner->contrasts->leeway = scanner->leeway;
+        scanner->contrasts->nearest_neighbor_max_variation = scanner->nearest_neighbor_max_variation;
+    }
+    return 0;
+}
+
+// The leeway that the scanner's next screenshot will be scanned with.
+static unsigned char scanner_leeway(const struct dimension_scanner* scanner)
+{
+    return scanner->has_settings ? scanner->leeway : pixel_comparison_leeway();
+}
+
+static void update_contrasts_from_paths(struct contrasts* contrasts, unsigned char pixels[], size_t num_image_paths, char** image_paths)
+{
+    // Once every column and row has been marked, there's nothing more
+    // any further screenshots could tell us.
+    for (size_t i = 0; i < num_image_paths && !contrasts_saturated(contrasts); i++) {
+        // The next one can be on its way while this one's being scanned.
+        if (i + 1 < num_image_paths) {prefetch_file(image_paths[i + 1]);}
+
+        char error_description[READER_ERROR_SIZE];
+        struct image_reader* reader = open_image(image_paths[i], error_description);
+        if (reader == NULL) {exit_with_scan_error(SCAN_READ_FAILED, image_paths[i], error_description);}
+
+        int error = SCAN_READ_FAILED;
+        if (next_frame(reader)) {
+            error = update_contrasts_from_reader(contrasts, pixels, reader);
+        }
+        if (error) {exit_with_scan_error(error, image_paths[i], reader->error_description);}
+
+        close_image(reader);
+    }
+}
+
+static void update_contrasts_from_pipeline(struct contrasts* contrasts, struct decode_pipeline* pipeline, char** image_paths)
+{
+    struct decoded_frame* frame;
+    while (!contrasts_saturated(contrasts) && (frame = next_decoded_frame(pipeline)) != NULL) {
+        int error;
+        switch (frame->status) {
+            case FRAME_DECODED:
+                error = update_contrasts_from_whole_image(contrasts, frame->pixels);
+                if (error) {exit_with_scan_error(error, image_paths[frame->image_index], NULL);}
+                break;
+            case FRAME_READ_FAILED:
+                exit_with_scan_error(SCAN_READ_FAILED, image_paths[frame->image_index], frame->error_description);
+                break;
+            case FRAME_WRONG_SIZE:
+                exit_with_scan_error(SCAN_WRONG_SIZE, image_paths[frame->image_index], NULL);
+                break;
+        }
+        release_decoded_frame(pipeline, frame);
+    }
+}
+
+/*
+    For determine_dimensions: writes every screenshot out scaled back down,
+    exiting if any can't be. Only the first can be in pixels already; the
+    rest are decoded again, into pixels if it's given.
+*/
+static void write_unscaled_screenshots(
+    const struct contrasts* contrasts, unsigned char pixels[], bool holds_first_screenshot,
+    size_t num_image_paths, char** image_paths,
+    size_t determined_width, size_t determined_height
+)
+{
+    struct unscale_plan* plan = create_unscale_plan(contrasts->columns, contrasts->rows, determined_width, determined_height);
+    if (plan != NULL) {
+        place_unscale_plan(plan, contrasts->region_x, contrasts->region_y, contrasts->frame_width, contrasts->frame_height);
+    }
+    unsigned char* buffer = pixels != NULL ? pixels : (unsigned char*) malloc(scan_buffer_size(contrasts->columns->size, contrasts->rows->size) * sizeof(unsigned char));
+    if (plan == NULL || buffer == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        exit(-1);
+    }
+    if (num_image_paths > 1 && !create_output_directory(output_path)) {
+        fprintf(stderr, "ERROR: Could not create output directory \"%s\".\n", output_path);
+        exit(-1);
+    }
+
+    for (size_t i = 0; i < num_image_paths; i++) {
+        char* path = num_image_paths > 1 ? output_file_path(output_path, image_paths[i]) : (char*) output_path;
+        if (path == NULL) {
+            fprintf(stderr, "ERROR: Out of memory.\n");
+            exit(-1);
+        }
+        char error_description[READER_ERROR_SIZE] = {0};
+        int error = write_unscaled_screenshot(plan, image_paths[i], buffer, i == 0 && holds_first_screenshot, path, error_description);
+        if (error == SCAN_WRITE_FAILED) {
+            fprintf(stderr, "ERROR: Could not write \"%s\": %s\n", path, error_description);
+            exit(-1);
+        } else if (error == SCAN_OUT_OF_MEMORY) {
+            fprintf(stderr, "ERROR: Out of memory.\n");
+            exit(-1);
+        } else if (error) {
+            exit_with_scan_error(error, image_paths[i], error_description);
+        }
+        if (path != output_path) {free(path);}
+    }
+
+    if (buffer != pixels) {free(buffer);}
+    destroy_unscale_plan(plan);
+}
+
+/*
+    Writes the screenshot at image_path, scaled according to the plan, to
+    path. If holds_screenshot is set, pixels holds it already; otherwise
+    its first frame is decoded into pixels – which has to be
+    scan_buffer_size – a strip at a time, the same as when scanning.
+*/
+static int write_unscaled_screenshot(
+    const struct unscale_plan* plan, const char* image_path, unsigned char pixels[], bool holds_screenshot,
+    const char* path, char error_description[READER_ERROR_SIZE]
+)
+{
+    error_description[0] = 0;
+    unsigned char* output = (unsigned char*) malloc(plan->width * plan->height * 3 * sizeof(unsigned char));
+    if (output == NULL) {return SCAN_OUT_OF_MEMORY;}
+
+    enter_stats_phase(STATS_OUTPUT);
+    int error = 0;
+    if (holds_screenshot) {
+        unscale_rows(plan, 0, plan->scaled_height, pixels, output);
+    } else {
+        error = read_unscaled_screenshot(plan, image_path, pixels, output, error_description);
+    }
+    if (!error && write_image_file(path, output, plan->width, plan->height, error_description)) {
+        error = SCAN_WRITE_FAILED;
+    }
+    leave_stats_phase();
+    free(output);
+    return error;
+}
+
+static int read_unscaled_screenshot(
+    const struct unscale_plan* plan, const char* image_path, unsigned char pixels[], unsigned char output[],
+    char error_description[READER_ERROR_SIZE]
+)
+{
+    struct image_reader* reader = open_image(image_path, error_description);
+    if (reader == NULL) {return SCAN_READ_FAILED;}
+
+    int error = SCAN_READ_FAILED;
+    if (next_frame(reader)) {
+        error = reader->width == plan->scaled_width && reader->height == plan->scaled_height ? 0 : SCAN_WRONG_SIZE;
+        if (!error && reader->frame_pixels != NULL) {
+            // Nothing to read – it's in memory as it is.
+            unscale_rows(plan, 0, reader->height, reader->frame_pixels, output);
+        } else if (!error) {
+            size_t height = reader->height;
+            size_t strip_height = scan_strip_height > 0 && scan_strip_height < height ? scan_strip_height : height;
+            for (size_t first_row = 0; !error && first_row < height; first_row += strip_height) {
+                size_t num_rows = height - first_row < strip_height ? height - first_row : strip_height;
+                if (read_rows(reader, first_row, num_rows, pixels)) {
+                    error = SCAN_READ_FAILED;
+                } else {
+                    unscale_rows(plan, first_row, num_rows, pixels, output);
+                }
+            }
+        }
+    }
+    if (error == SCAN_READ_FAILED) {
+        memcpy(error_description, reader->error_description, READER_ERROR_SIZE);
+    }
+    close_image(reader);
+    return error;
+}
+
+static void exit_with_scan_error(int error, const char* image_path, const char* error_description)
+{
+    if (error == SCAN_WRONG_SIZE) {
+        fprintf(stderr, "ERROR: Screenshots not of the same resolution (\"%s\" differs).\n", image_path);
+    } else if (error == SCAN_REGION_OUTSIDE) {
+        fprintf(stderr, "ERROR: Region to scan doesn't fit in \"%s\".\n", image_path);
+    } else if (error == SCAN_OUT_OF_MEMORY) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+    } else {
+        fprintf(stderr, "ERROR: Could not read \"%s\": %s\n", image_path, error_description[0] ? error_description : "No image data.");
+    }
+    exit(-1);
 }
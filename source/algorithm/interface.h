@@ -1,10 +1,39 @@
 /*
-    The public interface for the unscaling algorithm.
+    The public interface for the unscaling algorithm. Whatever uses it calls
+    finish_image_readers (see reader.h) once, when it's done with images for
+    good.
 */
 #ifndef INTERFACE_H
 #define INTERFACE_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include "algorithm/contrast.h"
+#include "input/reader.h"
+
+extern size_t num_scan_threads;
+extern size_t num_decode_threads;
+extern size_t num_pixels_scanned;
+extern size_t num_pixels_touched;
+extern double width_confidence;
+extern double height_confidence;
+extern struct scan_region active_area;
+extern const char* output_path;
+
+struct dimension_scanner;
+struct dimension_stream;
+struct dimension_profile;
+
+// How sure a scan is of what it found, and how much it had to look at to
+// find it.
+struct scan_quality {
+    // From 0 to 1 (see determine_dimension).
+    double width_confidence;
+    double height_confidence;
+    // The share of the pixels scanned that were actually looked at – less
+    // than all of them only when scanning progressively.
+    double pixels_touched;
+};
 
 void determine_dimensions(
     size_t num_image_paths, char** image_paths,
@@ -12,4 +41,46 @@ void determine_dimensions(
     size_t* determined_width, size_t* determined_height
 );
 
+struct dimension_stream* open_dimension_stream(const char* path, enum stream_format format, size_t width, size_t height);
+bool scan_stream_frames(
+    struct dimension_stream* stream, size_t num_frames,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height
+);
+void close_dimension_stream(struct dimension_stream* stream);
+
+struct dimension_profile* open_dimension_profile(const char* path);
+int add_to_dimension_profile(struct dimension_profile* profile, const char* image_path, bool* added, char error_description[READER_ERROR_SIZE]);
+bool determine_profile_dimensions(
+    const struct dimension_profile* profile,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height
+);
+size_t profile_screenshot_count(const struct dimension_profile* profile);
+bool save_dimension_profile(const struct dimension_profile* profile);
+void close_dimension_profile(struct dimension_profile* profile);
+
+struct dimension_scanner* create_dimension_scanner(void);
+void set_scanner_settings(struct dimension_scanner* scanner, enum pixel_comparison comparison, int fuzziness, int nearest_neighbor_max_variation);
+void destroy_dimension_scanner(struct dimension_scanner* scanner);
+int scan_image_dimensions(
+    struct dimension_scanner* scanner, const char* image_path,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height,
+    char error_description[READER_ERROR_SIZE]
+);
+int scan_image_blob_dimensions(
+    struct dimension_scanner* scanner, const void* data, size_t size,
+    size_t* scaled_width, size_t* scaled_height,
+    size_t* determined_width, size_t* determined_height,
+    char error_description[READER_ERROR_SIZE]
+);
+struct scan_region scanner_region(const struct dimension_scanner* scanner);
+struct scan_quality scanner_quality(const struct dimension_scanner* scanner);
+int write_scanned_screenshot(
+    struct dimension_scanner* scanner, const char* image_path, const char* path,
+    size_t determined_width, size_t determined_height,
+    char error_description[READER_ERROR_SIZE]
+);
+
 #endif
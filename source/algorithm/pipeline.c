@@ -0,0 +1,337 @@
+#include "algorithm/pipeline.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "input/mapping.h"
+#include "input/reader.h"
+#include "stats/stats.h"
+
+struct decode_pipeline {
+    char** image_paths;
+    size_t num_image_paths;
+    // Set instead of the image paths when decoding a stream.
+    struct image_reader* stream;
+    size_t width;
+    size_t height;
+
+    pthread_t* decoders;
+    size_t num_decoders;
+    size_t num_decoders_running;
+
+    // One frame per decoder, plus one for the scanner to work on meanwhile.
+    struct decoded_frame* frames;
+    size_t num_frames;
+    // The frames that aren't in use, as a stack…
+    struct decoded_frame** free_frames;
+    size_t num_free_frames;
+    // …and the ones waiting to be scanned, as a ring.
+    struct decoded_frame** ready_frames;
+    size_t first_ready_frame;
+    size_t num_ready_frames;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t frame_freed;
+    pthread_cond_t frame_ready;
+    size_t next_image;
+    bool stopping;
+};
+
+static struct decode_pipeline* create_decode_pipeline(size_t width, size_t height, size_t num_frames);
+static bool start_decoders(struct decode_pipeline* pipeline, size_t num_decoders, void* (*decode)(void*));
+static void* decode(void* pipeline_pointer);
+static void* decode_stream(void* pipeline_pointer);
+static bool decode_image(struct decode_pipeline* pipeline, size_t image_index);
+static void export_frame(struct decode_pipeline* pipeline, struct image_reader* reader, struct decoded_frame* frame);
+static struct decoded_frame* take_free_frame(struct decode_pipeline* pipeline);
+static void hand_over_frame(struct decode_pipeline* pipeline, struct decoded_frame* frame);
+
+/*
+    Starts decoding every image in image_paths in the background. Each frame
+    of each image is expected to be width × height. Returns NULL if there
+    isn't enough memory or no threads could be started.
+*/
+struct decode_pipeline* start_decode_pipeline(size_t num_image_paths, char** image_paths, size_t width, size_t height, size_t num_decoders)
+{
+    if (num_decoders < 1) {num_decoders = 1;}
+    if (num_decoders > num_image_paths) {num_decoders = num_image_paths;}
+
+    struct decode_pipeline* pipeline = create_decode_pipeline(width, height, num_decoders + 1);
+    if (pipeline == NULL) {return NULL;}
+    pipeline->image_paths = image_paths;
+    pipeline->num_image_paths = num_image_paths;
+    if (!start_decoders(pipeline, num_decoders, decode)) {
+        stop_decode_pipeline(pipeline);
+        return NULL;
+    }
+    return pipeline;
+}
+
+/*
+    Starts reading a stream of frames (see open_image_stream), the first of
+    which has already been moved on to, in the background. There are
+    num_buffers frames to read into, at least two: the one being scanned,
+    and the one being read meanwhile. The pipeline takes over the reader,
+    closing it once stopped. Returns NULL (leaving the reader be) if there
+    isn't enough memory or the thread couldn't be started.
+*/
+struct decode_pipeline* start_stream_pipeline(struct image_reader* reader, size_t num_buffers)
+{
+    if (num_buffers < 2) {num_buffers = 2;}
+    struct decode_pipeline* pipeline = create_decode_pipeline(reader->width, reader->height, num_buffers);
+    if (pipeline == NULL) {return NULL;}
+    pipeline->stream = reader;
+    if (!start_decoders(pipeline, 1, decode_stream)) {
+        pipeline->stream = NULL;
+        stop_decode_pipeline(pipeline);
+        return NULL;
+    }
+    return pipeline;
+}
+
+// Returns NULL if there isn't enough memory.
+static struct decode_pipeline* create_decode_pipeline(size_t width, size_t height, size_t num_frames)
+{
+    struct decode_pipeline* pipeline = (struct decode_pipeline*) calloc(1, sizeof(struct decode_pipeline));
+    if (pipeline == NULL) {return NULL;}
+    pipeline->width = width;
+    pipeline->height = height;
+    pipeline->num_frames = num_frames;
+    pipeline->decoders = (pthread_t*) calloc(num_frames, sizeof(pthread_t));
+    pipeline->frames = (struct decoded_frame*) calloc(pipeline->num_frames, sizeof(struct decoded_frame));
+    pipeline->free_frames = (struct decoded_frame**) calloc(pipeline->num_frames, sizeof(struct decoded_frame*));
+    pipeline->ready_frames = (struct decoded_frame**) calloc(pipeline->num_frames, sizeof(struct decoded_frame*));
+    pthread_mutex_init(&pipeline->mutex, NULL);
+    pthread_cond_init(&pipeline->frame_freed, NULL);
+    pthread_cond_init(&pipeline->frame_ready, NULL);
+    if (
+        pipeline->decoders == NULL || pipeline->frames == NULL ||
+        pipeline->free_frames == NULL || pipeline->ready_frames == NULL
+    ) {
+        stop_decode_pipeline(pipeline);
+        return NULL;
+    }
+    for (size_t i = 0; i < pipeline->num_frames; i++) {
+        pipeline->frames[i].pixels = (unsigned char*) malloc(width * height * 3 * sizeof(unsigned char));
+        if (pipeline->frames[i].pixels == NULL) {
+            stop_decode_pipeline(pipeline);
+            return NULL;
+        }
+        pipeline->free_frames[pipeline->num_free_frames++] = &pipeline->frames[i];
+    }
+    return pipeline;
+}
+
+// Returns false if not a single one could be started.
+static bool start_decoders(struct decode_pipeline* pipeline, size_t num_decoders, void* (*decode)(void*))
+{
+    pthread_mutex_lock(&pipeline->mutex);
+    for (size_t i = 0; i < num_decoders; i++) {
+        if (pthread_create(&pipeline->decoders[i], NULL, decode, pipeline) != 0) {break;}
+        pipeline->num_decoders++;
+        pipeline->num_decoders_running++;
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return pipeline->num_decoders > 0;
+}
+
+/*
+    Waits for the next decoded frame and returns it, or returns NULL once
+    every image has been decoded and every frame handed over. Each frame has
+    to be given back with release_decoded_frame once it's been scanned.
+*/
+struct decoded_frame* next_decoded_frame(struct decode_pipeline* pipeline)
+{
+    // The decoding itself happens on the decoders' threads. All there is to
+    // charge to it on this one is the wait.
+    enter_stats_phase(STATS_DECODE);
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->num_ready_frames == 0 && pipeline->num_decoders_running > 0) {
+        pthread_cond_wait(&pipeline->frame_ready, &pipeline->mutex);
+    }
+    struct decoded_frame* frame = NULL;
+    if (pipeline->num_ready_frames > 0) {
+        frame = pipeline->ready_frames[pipeline->first_ready_frame];
+        pipeline->first_ready_frame = (pipeline->first_ready_frame + 1) % pipeline->num_frames;
+        pipeline->num_ready_frames--;
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    leave_stats_phase();
+    return frame;
+}
+
+void release_decoded_frame(struct decode_pipeline* pipeline, struct decoded_frame* frame)
+{
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->free_frames[pipeline->num_free_frames++] = frame;
+    pthread_cond_signal(&pipeline->frame_freed);
+    pthread_mutex_unlock(&pipeline->mutex);
+}
+
+/*
+    Stops decoding – whether or not every image has been decoded yet –
+    and frees everything. Any frames not yet released are invalidated.
+*/
+void stop_decode_pipeline(struct decode_pipeline* pipeline)
+{
+    if (pipeline == NULL) {return;}
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->stopping = true;
+    pthread_cond_broadcast(&pipeline->frame_freed);
+    pthread_mutex_unlock(&pipeline->mutex);
+    for (size_t i = 0; i < pipeline->num_decoders; i++) {
+        // A stream's decoder may be waiting for the next frame to come in,
+        // which could take forever.
+        if (pipeline->stream != NULL) {pthread_cancel(pipeline->decoders[i]);}
+        pthread_join(pipeline->decoders[i], NULL);
+    }
+    close_image(pipeline->stream);
+
+    if (pipeline->frames != NULL) {
+        for (size_t i = 0; i < pipeline->num_frames; i++) {
+            free(pipeline->frames[i].pixels);
+        }
+    }
+    pthread_mutex_destroy(&pipeline->mutex);
+    pthread_cond_destroy(&pipeline->frame_freed);
+    pthread_cond_destroy(&pipeline->frame_ready);
+    free(pipeline->decoders);
+    free(pipeline->frames);
+    free(pipeline->free_frames);
+    free(pipeline->ready_frames);
+    free(pipeline);
+}
+
+static void* decode(void* pipeline_pointer)
+{
+    struct decode_pipeline* pipeline = (struct decode_pipeline*) pipeline_pointer;
+    while (true) {
+        pthread_mutex_lock(&pipeline->mutex);
+        size_t image_index = pipeline->next_image++;
+        bool done = pipeline->stopping || image_index >= pipeline->num_image_paths;
+        // While this one's being decoded, the one that'll be up once every
+        // decoder's taken another can already be fetched.
+        size_t upcoming_index = image_index + pipeline->num_decoders;
+        pthread_mutex_unlock(&pipeline->mutex);
+        if (done) {break;}
+        if (upcoming_index < pipeline->num_image_paths) {prefetch_file(pipeline->image_paths[upcoming_index]);}
+        if (!decode_image(pipeline, image_index)) {break;}
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->num_decoders_running--;
+    pthread_cond_broadcast(&pipeline->frame_ready);
+    pthread_mutex_unlock(&pipeline->mutex);
+    return NULL;
+}
+
+/*
+    Decodes every frame of one image and hands them over, along with any
+    error. Returns false if the pipeline is stopping.
+*/
+static bool decode_image(struct decode_pipeline* pipeline, size_t image_index)
+{
+    char error_description[READER_ERROR_SIZE];
+    struct image_reader* reader = open_image(pipeline->image_paths[image_index], error_description);
+    if (reader == NULL) {
+        struct decoded_frame* frame = take_free_frame(pipeline);
+        if (frame == NULL) {return false;}
+        frame->status = FRAME_READ_FAILED;
+        frame->image_index = image_index;
+        memcpy(frame->error_description, error_description, READER_ERROR_SIZE);
+        hand_over_frame(pipeline, frame);
+        return true;
+    }
+
+    bool keep_going = true;
+    while (next_frame(reader) || reader->error_description[0]) {
+        struct decoded_frame* frame = take_free_frame(pipeline);
+        if (frame == NULL) {
+            keep_going = false;
+            break;
+        }
+        frame->image_index = image_index;
+        export_frame(pipeline, reader, frame);
+        hand_over_frame(pipeline, frame);
+        if (frame->status != FRAME_DECODED) {break;}
+    }
+    close_image(reader);
+    return keep_going;
+}
+
+static void* decode_stream(void* pipeline_pointer)
+{
+    struct decode_pipeline* pipeline = (struct decode_pipeline*) pipeline_pointer;
+    struct image_reader* reader = pipeline->stream;
+    // Stopping cancels this thread, but only ever while it's reading – never
+    // while it's holding the mutex.
+    int cancel_state;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+    bool first_frame = true;
+    struct decoded_frame* frame;
+    while ((frame = take_free_frame(pipeline)) != NULL) {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &cancel_state);
+        bool has_frame = first_frame || next_frame(reader) || reader->error_description[0];
+        if (has_frame) {export_frame(pipeline, reader, frame);}
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+        first_frame = false;
+        if (!has_frame) {
+            release_decoded_frame(pipeline, frame);
+            break;
+        }
+        frame->image_index = 0;
+        hand_over_frame(pipeline, frame);
+        if (frame->status != FRAME_DECODED) {break;}
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->num_decoders_running--;
+    pthread_cond_broadcast(&pipeline->frame_ready);
+    pthread_mutex_unlock(&pipeline->mutex);
+    return NULL;
+}
+
+// Reads the reader's current frame into the frame, or says why it can't.
+static void export_frame(struct decode_pipeline* pipeline, struct image_reader* reader, struct decoded_frame* frame)
+{
+    if (reader->error_description[0]) {
+        frame->status = FRAME_READ_FAILED;
+    } else if (reader->width != pipeline->width || reader->height != pipeline->height) {
+        frame->status = FRAME_WRONG_SIZE;
+    } else if (read_rows(reader, 0, pipeline->height, frame->pixels)) {
+        frame->status = FRAME_READ_FAILED;
+    } else {
+        frame->status = FRAME_DECODED;
+    }
+    if (frame->status == FRAME_READ_FAILED) {
+        memcpy(frame->error_description, reader->error_description, READER_ERROR_SIZE);
+    }
+}
+
+// Returns NULL if the pipeline is stopping.
+static struct decoded_frame* take_free_frame(struct decode_pipeline* pipeline)
+{
+    pthread_mutex_lock(&pipeline->mutex);
+    while (!pipeline->stopping && pipeline->num_free_frames == 0) {
+        pthread_cond_wait(&pipeline->frame_freed, &pipeline->mutex);
+    }
+    struct decoded_frame* frame = NULL;
+    if (!pipeline->stopping) {
+        frame = pipeline->free_frames[--pipeline->num_free_frames];
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return frame;
+}
+
+static void hand_over_frame(struct decode_pipeline* pipeline, struct decoded_frame* frame)
+{
+    pthread_mutex_lock(&pipeline->mutex);
+    size_t end = (pipeline->first_ready_frame + pipeline->num_ready_frames) % pipeline->num_frames;
+    pipeline->ready_frames[end] = frame;
+    pipeline->num_ready_frames++;
+    pthread_cond_signal(&pipeline->frame_ready);
+    pthread_mutex_unlock(&pipeline->mutex);
+}
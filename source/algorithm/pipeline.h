@@ -0,0 +1,40 @@
+/*
+    Decoding screenshots in the background while others are being scanned.
+    A few decoder threads each read the next screenshot in line and export
+    its frames into a small, fixed set of reusable pixel buffers, which are
+    handed over to the scanner in whatever order they're finished in (the
+    order doesn't matter, since contrasts are merged by OR anyway).
+
+    The same goes for a stream of frames, which has a single decoder thread
+    reading it frame by frame into a ring of buffers.
+*/
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include "input/reader.h"
+
+enum decoded_frame_status {
+    FRAME_DECODED,
+    FRAME_READ_FAILED,
+    FRAME_WRONG_SIZE
+};
+
+struct decoded_frame {
+    enum decoded_frame_status status;
+    size_t image_index;
+    // Only meaningful when status is FRAME_DECODED.
+    unsigned char* pixels;
+    // Only set when status is FRAME_READ_FAILED.
+    char error_description[READER_ERROR_SIZE];
+};
+
+struct decode_pipeline;
+
+struct decode_pipeline* start_decode_pipeline(size_t num_image_paths, char** image_paths, size_t width, size_t height, size_t num_decoders);
+struct decoded_frame* next_decoded_frame(struct decode_pipeline* pipeline);
+struct decode_pipeline* start_stream_pipeline(struct image_reader* reader, size_t num_buffers);
+void release_decoded_frame(struct decode_pipeline* pipeline, struct decoded_frame* frame);
+void stop_decode_pipeline(struct decode_pipeline* pipeline);
+
+#endif
@@ -0,0 +1,161 @@
+#include "algorithm/pool.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <pthread.h>
+#ifdef WIN64
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+struct worker_pool {
+    pthread_t* threads;
+    size_t num_threads;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_available;
+    pthread_cond_t work_done;
+    bool shutting_down;
+
+    // The current batch.
+    void (*task)(void*, size_t);
+    void* argument;
+    size_t num_tasks;
+    size_t next_task;
+    size_t num_finished;
+};
+
+static void* work(void* pool_pointer);
+static bool run_next_task(struct worker_pool* pool);
+
+/*
+    num_threads includes the thread that runs batches, so a pool of 1 doesn't
+    start any threads at all and just runs everything in place. Returns NULL
+    if the threads couldn't be started.
+*/
+struct worker_pool* create_worker_pool(size_t num_threads)
+{
+    struct worker_pool* pool = (struct worker_pool*) calloc(1, sizeof(struct worker_pool));
+    if (pool == NULL) {return NULL;}
+    if (num_threads < 1) {num_threads = 1;}
+    pool->threads = (pthread_t*) calloc(num_threads, sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    pool->num_threads = 1;
+    for (size_t i = 1; i < num_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, work, pool) != 0) {
+            destroy_worker_pool(pool);
+            return NULL;
+        }
+        pool->num_threads++;
+    }
+    return pool;
+}
+
+void destroy_worker_pool(struct worker_pool* pool)
+{
+    if (pool == NULL) {return;}
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutting_down = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+    for (size_t i = 1; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool->threads);
+    free(pool);
+}
+
+size_t worker_pool_size(const struct worker_pool* pool)
+{
+    return pool->num_threads;
+}
+
+/*
+    Calls task(argument, i) for every i < num_tasks, spread out over the
+    pool's threads, and returns once every call has returned.
+*/
+void run_on_worker_pool(struct worker_pool* pool, void (*task)(void* argument, size_t index), void* argument, size_t num_tasks)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->argument = argument;
+    pool->num_tasks = num_tasks;
+    pool->next_task = 0;
+    pool->num_finished = 0;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    while (run_next_task(pool)) {}
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->num_finished < pool->num_tasks) {
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void* work(void* pool_pointer)
+{
+    struct worker_pool* pool = (struct worker_pool*) pool_pointer;
+    while (true) {
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->shutting_down && pool->next_task >= pool->num_tasks) {
+            pthread_cond_wait(&pool->work_available, &pool->mutex);
+        }
+        bool shutting_down = pool->shutting_down;
+        pthread_mutex_unlock(&pool->mutex);
+        if (shutting_down) {break;}
+
+        while (run_next_task(pool)) {}
+    }
+    return NULL;
+}
+
+// Returns false if there were no tasks left to run.
+static bool run_next_task(struct worker_pool* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->next_task >= pool->num_tasks) {
+        pthread_mutex_unlock(&pool->mutex);
+        return false;
+    }
+    size_t index = pool->next_task++;
+    void (*task)(void*, size_t) = pool->task;
+    void* argument = pool->argument;
+    pthread_mutex_unlock(&pool->mutex);
+
+    task(argument, index);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->num_finished++;
+    if (pool->num_finished == pool->num_tasks) {
+        pthread_cond_broadcast(&pool->work_done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return true;
+}
+
+size_t count_cpu_cores(void)
+{
+#ifdef WIN64
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return system_info.dwNumberOfProcessors;
+#else
+    long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return num_cores > 0 ? (size_t) num_cores : 1;
+#endif
+}
@@ -0,0 +1,20 @@
+/*
+    A simple pool of worker threads for running a batch of independent tasks
+    in parallel. The thread that hands over the batch joins in on it, and
+    waits until all of it is done.
+*/
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+struct worker_pool;
+
+struct worker_pool* create_worker_pool(size_t num_threads);
+void destroy_worker_pool(struct worker_pool* pool);
+size_t worker_pool_size(const struct worker_pool* pool);
+void run_on_worker_pool(struct worker_pool* pool, void (*task)(void* argument, size_t index), void* argument, size_t num_tasks);
+
+size_t count_cpu_cores(void);
+
+#endif
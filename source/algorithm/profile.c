@@ -0,0 +1,119 @@
+#include "algorithm/profile.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "algorithm/cache.h"
+#include "algorithm/contrast_set.h"
+
+// The first bytes of every profile. Bump the last one whenever the format
+// changes.
+static const char profile_signature[8] = {'p', 'i', 't', 't', 'p', 'r', 'o', 1};
+
+#define MAX_PROFILE_PATH_LENGTH 4096
+
+static bool read_contrast_set(FILE* file, struct contrast_set* set);
+
+/*
+    Opens the profile at path and reads its header. If it returns
+    PROFILE_OK, the rest has to be read with read_profile next – into
+    num_hashes hashes and contrast sets of the header's size.
+*/
+int open_profile(const char* path, struct profile_header* header, FILE** file)
+{
+    *file = fopen(path, "rb");
+    if (*file == NULL) {return PROFILE_MISSING;}
+
+    char signature[sizeof(profile_signature)];
+    uint64_t fields[5];
+    if (
+        fread(signature, 1, sizeof(signature), *file) != sizeof(signature) ||
+        memcmp(signature, profile_signature, sizeof(signature)) != 0 ||
+        fread(fields, sizeof(uint64_t), 5, *file) != 5 ||
+        fields[0] == 0 || fields[1] == 0 || fields[2] > 255 || fields[4] > fields[3]
+    ) {
+        fclose(*file);
+        *file = NULL;
+        return PROFILE_BROKEN;
+    }
+    header->width = fields[0];
+    header->height = fields[1];
+    header->leeway = (unsigned char) fields[2];
+    header->num_screenshots = fields[3];
+    header->num_hashes = fields[4];
+    return PROFILE_OK;
+}
+
+/*
+    Reads the rest of a profile opened with open_profile, and closes it.
+    Returns false if it turns out to be broken.
+*/
+bool read_profile(FILE* file, const struct profile_header* header, struct cache_key* hashes, struct contrast_set* columns, struct contrast_set* rows)
+{
+    bool read = true;
+    for (size_t i = 0; i < header->num_hashes && read; i++) {
+        uint64_t key[2];
+        read = fread(key, sizeof(uint64_t), 2, file) == 2;
+        hashes[i].hash = key[0];
+        hashes[i].size = key[1];
+        hashes[i].leeway = header->leeway;
+    }
+    read = read && read_contrast_set(file, columns) && read_contrast_set(file, rows) && fgetc(file) == EOF;
+    fclose(file);
+    return read;
+}
+
+// Returns false if the profile couldn't be written, leaving any older one
+// where it was.
+bool write_profile(
+    const char* path, const struct profile_header* header, const struct cache_key* hashes,
+    const struct contrast_set* columns, const struct contrast_set* rows
+)
+{
+    // Hidden, so that it isn't mistaken for a screenshot if the profile's
+    // kept in a directory that's being watched.
+    char temporary_path[MAX_PROFILE_PATH_LENGTH];
+    const char* name = strrchr(path, '/');
+    name = name != NULL ? name + 1 : path;
+    int length = snprintf(
+        temporary_path, MAX_PROFILE_PATH_LENGTH, "%.*s.%s.%ld.tmp",
+        (int) (name - path), path, name, (long) getpid()
+    );
+    if (length < 0 || length >= MAX_PROFILE_PATH_LENGTH) {return false;}
+    FILE* file = fopen(temporary_path, "wb");
+    if (file == NULL) {return false;}
+
+    uint64_t fields[5] = {header->width, header->height, header->leeway, header->num_screenshots, header->num_hashes};
+    fwrite(profile_signature, 1, sizeof(profile_signature), file);
+    fwrite(fields, sizeof(uint64_t), 5, file);
+    for (size_t i = 0; i < header->num_hashes; i++) {
+        uint64_t key[2] = {hashes[i].hash, hashes[i].size};
+        fwrite(key, sizeof(uint64_t), 2, file);
+    }
+    fwrite(columns->words, sizeof(uint64_t), columns->num_words, file);
+    fwrite(rows->words, sizeof(uint64_t), rows->num_words, file);
+    bool written = !ferror(file);
+    written = fclose(file) == 0 && written;
+
+    // Renaming is atomic, so anything reading the profile sees either the
+    // old one or the new one.
+    if (!written || rename(temporary_path, path) != 0) {
+        remove(temporary_path);
+        return false;
+    }
+    return true;
+}
+
+static bool read_contrast_set(FILE* file, struct contrast_set* set)
+{
+    if (fread(set->words, sizeof(uint64_t), set->num_words, file) != set->num_words) {return false;}
+    // Keep the promise that the bits past the end are 0, whatever's in
+    // the file.
+    if (set->size % CONTRAST_WORD_BITS != 0) {
+        set->words[set->num_words - 1] &= ((uint64_t) 1 << (set->size % CONTRAST_WORD_BITS)) - 1;
+    }
+    return true;
+}
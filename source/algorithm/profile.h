@@ -0,0 +1,47 @@
+/*
+    A profile (--profile): the contrasts found in every screenshot that's
+    gone into it, merged together and kept in a file between runs. Merging
+    contrasts is just ORing them, so screenshots can be added to a profile
+    one at a time, whenever they come along, without the ones already in
+    it having to be decoded again. It also keeps the hash of each screenshot
+    file that's gone in (see cache.h), so that going over the same pile of
+    screenshots again only has to hash the ones it's had before.
+
+    Like cache entries, profiles are written to a temporary file and renamed
+    into place, and stored in the machine's own byte order.
+*/
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "algorithm/cache.h"
+#include "algorithm/contrast_set.h"
+
+// What open_profile returns.
+#define PROFILE_OK 0
+#define PROFILE_MISSING 1
+#define PROFILE_BROKEN 2
+
+struct profile_header {
+    size_t width;
+    size_t height;
+    // The comparison leeway the screenshots were scanned with, since
+    // contrasts found with different ones don't mix.
+    unsigned char leeway;
+    size_t num_screenshots;
+    // Screenshots that were scanned a frame at a time with --max-frames or
+    // --frame-stride don't have a hash, so this can be fewer.
+    size_t num_hashes;
+};
+
+int open_profile(const char* path, struct profile_header* header, FILE** file);
+bool read_profile(FILE* file, const struct profile_header* header, struct cache_key* hashes, struct contrast_set* columns, struct contrast_set* rows);
+bool write_profile(
+    const char* path, const struct profile_header* header, const struct cache_key* hashes,
+    const struct contrast_set* columns, const struct contrast_set* rows
+);
+
+#endif
@@ -0,0 +1,174 @@
+#include "algorithm/simd.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+static void accumulate_differences_scalar(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway, unsigned char* accumulator);
+static bool any_difference_scalar(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway);
+
+void (*accumulate_differences)(const unsigned char*, const unsigned char*, size_t, unsigned char, unsigned char*) = accumulate_differences_scalar;
+bool (*any_difference)(const unsigned char*, const unsigned char*, size_t, unsigned char) = any_difference_scalar;
+
+static void accumulate_differences_scalar(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway, unsigned char* accumulator)
+{
+    for (size_t i = 0; i < length; i++) {
+        int difference = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        accumulator[i] |= difference > leeway;
+    }
+}
+
+static bool any_difference_scalar(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway)
+{
+    for (size_t i = 0; i < length; i++) {
+        int difference = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        if (difference > leeway) {return true;}
+    }
+    return false;
+}
+
+#ifdef SIMD_X86
+/*
+    x86 has no unsigned byte absolute difference, but saturating subtraction
+    both ways and ORing the results amounts to the same thing. Subtracting the
+    leeway (saturating again) then leaves nonzero bytes exactly where the
+    difference exceeds it.
+*/
+__attribute__((target("sse2")))
+static inline __m128i exceeding_differences_sse2(const unsigned char* a, const unsigned char* b, __m128i leeway)
+{
+    __m128i a_bytes = _mm_loadu_si128((const __m128i*) a);
+    __m128i b_bytes = _mm_loadu_si128((const __m128i*) b);
+    __m128i difference = _mm_or_si128(_mm_subs_epu8(a_bytes, b_bytes), _mm_subs_epu8(b_bytes, a_bytes));
+    return _mm_subs_epu8(difference, leeway);
+}
+
+__attribute__((target("sse2")))
+static void accumulate_differences_sse2(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway, unsigned char* accumulator)
+{
+    __m128i leeway_bytes = _mm_set1_epi8((char) leeway);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i exceeding = exceeding_differences_sse2(a + i, b + i, leeway_bytes);
+        __m128i accumulated = _mm_loadu_si128((const __m128i*) (accumulator + i));
+        _mm_storeu_si128((__m128i*) (accumulator + i), _mm_or_si128(accumulated, exceeding));
+    }
+    accumulate_differences_scalar(a + i, b + i, length - i, leeway, accumulator + i);
+}
+
+__attribute__((target("sse2")))
+static bool any_difference_sse2(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway)
+{
+    __m128i leeway_bytes = _mm_set1_epi8((char) leeway);
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i exceeding = exceeding_differences_sse2(a + i, b + i, leeway_bytes);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(exceeding, zero)) != 0xFFFF) {return true;}
+    }
+    return any_difference_scalar(a + i, b + i, length - i, leeway);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i exceeding_differences_avx2(const unsigned char* a, const unsigned char* b, __m256i leeway)
+{
+    __m256i a_bytes = _mm256_loadu_si256((const __m256i*) a);
+    __m256i b_bytes = _mm256_loadu_si256((const __m256i*) b);
+    __m256i difference = _mm256_or_si256(_mm256_subs_epu8(a_bytes, b_bytes), _mm256_subs_epu8(b_bytes, a_bytes));
+    return _mm256_subs_epu8(difference, leeway);
+}
+
+__attribute__((target("avx2")))
+static void accumulate_differences_avx2(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway, unsigned char* accumulator)
+{
+    __m256i leeway_bytes = _mm256_set1_epi8((char) leeway);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i exceeding = exceeding_differences_avx2(a + i, b + i, leeway_bytes);
+        __m256i accumulated = _mm256_loadu_si256((const __m256i*) (accumulator + i));
+        _mm256_storeu_si256((__m256i*) (accumulator + i), _mm256_or_si256(accumulated, exceeding));
+    }
+    accumulate_differences_sse2(a + i, b + i, length - i, leeway, accumulator + i);
+}
+
+__attribute__((target("avx2")))
+static bool any_difference_avx2(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway)
+{
+    __m256i leeway_bytes = _mm256_set1_epi8((char) leeway);
+    size_t i = 0;
+    // Checking every 128 bytes rather than every 32 keeps the branch out of
+    // the way, at the cost of a little overshoot when there is a difference.
+    for (; i + 128 <= length; i += 128) {
+        __m256i exceeding = _mm256_or_si256(
+            _mm256_or_si256(
+                exceeding_differences_avx2(a + i, b + i, leeway_bytes),
+                exceeding_differences_avx2(a + i + 32, b + i + 32, leeway_bytes)
+            ),
+            _mm256_or_si256(
+                exceeding_differences_avx2(a + i + 64, b + i + 64, leeway_bytes),
+                exceeding_differences_avx2(a + i + 96, b + i + 96, leeway_bytes)
+            )
+        );
+        if (!_mm256_testz_si256(exceeding, exceeding)) {return true;}
+    }
+    for (; i + 32 <= length; i += 32) {
+        __m256i exceeding = exceeding_differences_avx2(a + i, b + i, leeway_bytes);
+        if (!_mm256_testz_si256(exceeding, exceeding)) {return true;}
+    }
+    return any_difference_sse2(a + i, b + i, length - i, leeway);
+}
+#endif
+
+#ifdef SIMD_NEON
+static void accumulate_differences_neon(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway, unsigned char* accumulator)
+{
+    uint8x16_t leeway_bytes = vdupq_n_u8(leeway);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t exceeding = vqsubq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)), leeway_bytes);
+        vst1q_u8(accumulator + i, vorrq_u8(vld1q_u8(accumulator + i), exceeding));
+    }
+    accumulate_differences_scalar(a + i, b + i, length - i, leeway, accumulator + i);
+}
+
+static bool any_difference_neon(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway)
+{
+    uint8x16_t leeway_bytes = vdupq_n_u8(leeway);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t exceeding = vqsubq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)), leeway_bytes);
+        if (vmaxvq_u8(exceeding) != 0) {return true;}
+    }
+    return any_difference_scalar(a + i, b + i, length - i, leeway);
+}
+#endif
+
+/*
+    Pick the widest kernels the CPU supports. NEON is always present on
+    AArch64, so it's decided at compile time there; on x86, it's up to
+    the CPU the program ends up running on.
+*/
+void select_simd_kernels(void)
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        accumulate_differences = accumulate_differences_avx2;
+        any_difference = any_difference_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        accumulate_differences = accumulate_differences_sse2;
+        any_difference = any_difference_sse2;
+    }
+#endif
+#ifdef SIMD_NEON
+    accumulate_differences = accumulate_differences_neon;
+    any_difference = any_difference_neon;
+#endif
+}
@@ -0,0 +1,27 @@
+/*
+    Vectorized kernels for the contrast scans. Rather than comparing one pixel
+    at a time, these compare whole runs of packed bytes at once, using
+    saturating absolute differences against a leeway (which is 0 for exact
+    comparisons). Since a pixel differs if any one of its channels does, this
+    works on the channels directly, and the caller folds them back into
+    pixels as needed.
+
+    The best implementation for the current CPU is picked at runtime by
+    select_simd_kernels(); a plain C implementation is used when no vector
+    instruction set is available.
+*/
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void select_simd_kernels(void);
+
+// For every i < length, marks accumulator[i] as nonzero if a[i] and b[i]
+// differ by more than leeway. Already-nonzero values are left alone.
+extern void (*accumulate_differences)(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway, unsigned char* accumulator);
+// Whether a[i] and b[i] differ by more than leeway for any i < length.
+extern bool (*any_difference)(const unsigned char* a, const unsigned char* b, size_t length, unsigned char leeway);
+
+#endif
@@ -0,0 +1,185 @@
+#include "algorithm/unscale.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "algorithm/contrast_set.h"
+#include "algorithm/fit.h"
+
+// What to scale the output up by after scaling down, as a whole factor and
+// then as how much wider than tall each pixel should be (below 1 making it
+// taller instead). Set from --output-scale and --output-par.
+size_t output_scale = 1;
+double output_pixel_aspect_ratio = 1;
+
+static void find_pixel_centers(const struct contrast_set* contrasts, size_t dimension, size_t centers[]);
+static void find_fitted_pixel_centers(size_t scaled_size, size_t dimension, enum sampling_point sampling_point, size_t centers[]);
+static void map_output(const size_t centers[], size_t dimension, size_t output_size, size_t output[]);
+
+/*
+    Returns NULL if there isn't enough memory. The determined dimensions
+    needn't agree with the contrasts – if there are fewer of them than runs,
+    the screenshot's just sampled evenly.
+*/
+struct unscale_plan* create_unscale_plan(
+    const struct contrast_set* columns, const struct contrast_set* rows,
+    size_t determined_width, size_t determined_height
+)
+{
+    if (determined_width == 0 || determined_height == 0) {return NULL;}
+    size_t width = determined_width * output_scale;
+    size_t height = determined_height * output_scale;
+    if (output_pixel_aspect_ratio >= 1) {
+        width = (size_t) (width * output_pixel_aspect_ratio + 0.5);
+    } else if (output_pixel_aspect_ratio > 0) {
+        height = (size_t) (height / output_pixel_aspect_ratio + 0.5);
+    }
+
+    struct unscale_plan* plan = (struct unscale_plan*) calloc(1, sizeof(struct unscale_plan));
+    if (plan == NULL) {return NULL;}
+    plan->width = width;
+    plan->height = height;
+    plan->scaled_width = columns->size;
+    plan->scaled_height = rows->size;
+    plan->columns = (size_t*) malloc(width * sizeof(size_t));
+    plan->rows = (size_t*) malloc(height * sizeof(size_t));
+    size_t* centers = (size_t*) malloc((determined_width > determined_height ? determined_width : determined_height) * sizeof(size_t));
+    if (plan->columns == NULL || plan->rows == NULL || centers == NULL) {
+        free(centers);
+        destroy_unscale_plan(plan);
+        return NULL;
+    }
+
+    find_pixel_centers(columns, determined_width, centers);
+    map_output(centers, determined_width, width, plan->columns);
+    find_pixel_centers(rows, determined_height, centers);
+    map_output(centers, determined_height, height, plan->rows);
+    free(centers);
+    return plan;
+}
+
+/*
+    For a plan made from the contrasts of only a region of the screenshot:
+    has it sample that region where it is in the whole screenshot, of
+    scaled_width by scaled_height.
+*/
+void place_unscale_plan(struct unscale_plan* plan, size_t x, size_t y, size_t scaled_width, size_t scaled_height)
+{
+    for (size_t i = 0; i < plan->width; i++) {plan->columns[i] += x;}
+    for (size_t i = 0; i < plan->height; i++) {plan->rows[i] += y;}
+    plan->scaled_width = scaled_width;
+    plan->scaled_height = scaled_height;
+}
+
+void destroy_unscale_plan(struct unscale_plan* plan)
+{
+    if (plan == NULL) {return;}
+    free(plan->columns);
+    free(plan->rows);
+    free(plan);
+}
+
+/*
+    Fills in every row of output that comes from rows first_row up to
+    first_row + num_rows of the screenshot, which pixels holds. Going
+    through the screenshot strip by strip, in order, fills in all of it.
+*/
+void unscale_rows(const struct unscale_plan* plan, size_t first_row, size_t num_rows, const unsigned char* pixels, unsigned char* output)
+{
+    size_t output_row_size = plan->width * 3;
+    for (size_t y = 0; y < plan->height; y++) {
+        if (plan->rows[y] < first_row) {continue;}
+        if (plan->rows[y] >= first_row + num_rows) {break;}
+
+        unsigned char* output_row = output + y * output_row_size;
+        if (y > 0 && plan->rows[y] == plan->rows[y - 1]) {
+            memcpy(output_row, output_row - output_row_size, output_row_size);
+            continue;
+        }
+        const unsigned char* row = pixels + (plan->rows[y] - first_row) * plan->scaled_width * 3;
+        for (size_t x = 0; x < plan->width; x++) {
+            const unsigned char* pixel = row + plan->columns[x] * 3;
+            output_row[x * 3] = pixel[0];
+            output_row[x * 3 + 1] = pixel[1];
+            output_row[x * 3 + 2] = pixel[2];
+        }
+    }
+}
+
+/*
+    Which column/row of the screenshot to take each original pixel from:
+    the middle of the run it was scaled into. If some contrasts are
+    missing, they're filled in from a fitted nearest neighbor model, so
+    long as it's of this dimension and explains every contrast that is
+    known. Failing that, the runs that hold several pixels are split
+    between them going by the average scale – every run getting at least
+    one pixel, so long as there are as many pixels as runs.
+*/
+static void find_pixel_centers(const struct contrast_set* contrasts, size_t dimension, size_t centers[])
+{
+    size_t num_runs = count_contrasts(contrasts);
+    if (num_runs < dimension) {
+        struct nearest_neighbor_fit fit;
+        fit_nearest_neighbor(contrasts, (double) contrasts->size / dimension, &fit);
+        if (fit.dimension == dimension && fit.num_fitting_contrasts == fit.num_known_contrasts) {
+            find_fitted_pixel_centers(contrasts->size, dimension, fit.sampling_point, centers);
+            return;
+        }
+    }
+    if (num_runs > dimension) {
+        for (size_t i = 0; i < dimension; i++) {
+            centers[i] = (size_t) (((uint64_t) (2 * i + 1) * contrasts->size) / (2 * dimension));
+        }
+        return;
+    }
+
+    double scale = (double) contrasts->size / dimension;
+    size_t pixel = 0;
+    size_t runs_left = num_runs;
+    size_t run_start = 0;
+    while (runs_left > 0) {
+        size_t run_end = next_contrast(contrasts, run_start);
+        runs_left--;
+
+        size_t num_pixels;
+        if (runs_left == 0) {
+            num_pixels = dimension - pixel;
+        } else {
+            size_t end_pixel = (size_t) (run_end / scale + 0.5);
+            num_pixels = end_pixel > pixel ? end_pixel - pixel : 1;
+            // Leaving at least one for each run still to come.
+            if (num_pixels > dimension - pixel - runs_left) {num_pixels = dimension - pixel - runs_left;}
+        }
+
+        size_t run_size = run_end - run_start;
+        for (size_t i = 0; i < num_pixels; i++) {
+            centers[pixel + i] = run_start + ((2 * i + 1) * run_size) / (2 * num_pixels);
+        }
+        pixel += num_pixels;
+        run_start = run_end;
+    }
+}
+
+static void find_fitted_pixel_centers(size_t scaled_size, size_t dimension, enum sampling_point sampling_point, size_t centers[])
+{
+    size_t pixel = 0;
+    size_t run_start = 0;
+    for (size_t i = 1; i <= scaled_size; i++) {
+        size_t next_pixel = i < scaled_size ? source_pixel(i, dimension, scaled_size, sampling_point) : dimension;
+        if (next_pixel == pixel) {continue;}
+        for (size_t j = pixel; j < next_pixel; j++) {
+            centers[j] = (run_start + i) / 2;
+        }
+        pixel = next_pixel;
+        run_start = i;
+    }
+}
+
+// Samples each output pixel at its center, the same as scaling up does.
+static void map_output(const size_t centers[], size_t dimension, size_t output_size, size_t output[])
+{
+    for (size_t i = 0; i < output_size; i++) {
+        output[i] = centers[((uint64_t) (2 * i + 1) * dimension) / (2 * output_size)];
+    }
+}
@@ -0,0 +1,37 @@
+/*
+    Scaling a screenshot back down to its original resolution – and, if
+    asked, up again by a whole factor and to a pixel aspect ratio – in a
+    single pass, by sampling it where its contrasts say each original pixel
+    was. Which scaled column/row each output column/row comes from is worked
+    out once up front, so that every screenshot of the same resolution and
+    contrasts can share the work.
+*/
+#ifndef UNSCALE_H
+#define UNSCALE_H
+
+#include <stddef.h>
+#include "algorithm/contrast_set.h"
+
+struct unscale_plan {
+    size_t width;
+    size_t height;
+    size_t scaled_width;
+    size_t scaled_height;
+    // For each column/row of output, which column/row of the screenshot it's
+    // taken from. Never decreasing.
+    size_t* columns;
+    size_t* rows;
+};
+
+extern size_t output_scale;
+extern double output_pixel_aspect_ratio;
+
+struct unscale_plan* create_unscale_plan(
+    const struct contrast_set* columns, const struct contrast_set* rows,
+    size_t determined_width, size_t determined_height
+);
+void place_unscale_plan(struct unscale_plan* plan, size_t x, size_t y, size_t scaled_width, size_t scaled_height);
+void destroy_unscale_plan(struct unscale_plan* plan);
+void unscale_rows(const struct unscale_plan* plan, size_t first_row, size_t num_rows, const unsigned char* pixels, unsigned char* output);
+
+#endif
@@ -1,17 +1,28 @@
 #include "cli/format.h"
 
+#include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "algorithm/contrast.h"
+#include "algorithm/interface.h"
+#include "stats/stats.h"
+
+static void print_json_string(FILE* stream, const char* string);
+static void print_json_number(FILE* stream, double number);
+static void print_json_phase_times(FILE* stream, const struct phase_times* times);
+
+static const char* phase_names[NUM_STATS_PHASES] = {"Decoding", "Scanning", "Determining", "Writing"};
+static const char* phase_keys[NUM_STATS_PHASES] = {"decode", "scan", "determine", "output"};
 
 void print_with_format(
     const char* format,
     size_t scaled_width, size_t scaled_height,
     size_t determined_width, size_t determined_height,
     double determined_x_scale, double determined_y_scale,
-    double pixel_aspect_ratio
+    double pixel_aspect_ratio, const struct scan_quality* quality
 )
 {
     size_t format_length = strlen(format);
@@ -21,7 +32,7 @@ void print_with_format(
     char out_str[1024] = {0};
     char* cur_out_char = out_str;
     bool in_variable = false;
-    char* variable_start;
+    char* variable_start = NULL;
     for (char* cur_char = modifiable_format; cur_char < modifiable_format + format_length; cur_char++) {
         // cur_out_char jumps at most 2 characters forward during one iteration.
         // That is, except for when printing a variable,
@@ -81,6 +92,12 @@ void print_with_format(
                     written = snprintf(cur_out_char, bytes_left, "%lg", determined_y_scale);
                 } else if (strcmp(variable_start, "par") == 0) {
                     written = snprintf(cur_out_char, bytes_left, "%lg", pixel_aspect_ratio);
+                } else if (strcmp(variable_start, "width_confidence") == 0) {
+                    written = snprintf(cur_out_char, bytes_left, "%lg", quality->width_confidence);
+                } else if (strcmp(variable_start, "height_confidence") == 0) {
+                    written = snprintf(cur_out_char, bytes_left, "%lg", quality->height_confidence);
+                } else if (strcmp(variable_start, "pixels_touched") == 0) {
+                    written = snprintf(cur_out_char, bytes_left, "%lg", quality->pixels_touched);
                 } else {
                     written = snprintf(cur_out_char, bytes_left, "%s", variable_start - 1);
                     if (written >= 0 && bytes_left - written > 1) {
@@ -107,3 +124,167 @@ void print_with_format(
     free(modifiable_format);
     printf("%s\n", out_str);
 }
+
+/*
+    Print the results for one screenshot in --batch or --serve mode, as
+    a single line of JSON with the same variables as print_with_format,
+    plus the path – except for pixels_touched, which is only there when
+    scanning progressively. If only part of the screenshot was scanned, the active
+    area is given too, along with what the whole screenshot's resolution
+    would be at the same scale – otherwise, active_area is NULL.
+*/
+void print_json_result(
+    FILE* stream, const char* image_path,
+    size_t scaled_width, size_t scaled_height,
+    size_t determined_width, size_t determined_height,
+    double determined_x_scale, double determined_y_scale,
+    double pixel_aspect_ratio, const struct scan_quality* quality, const struct scan_region* active_area
+)
+{
+    fprintf(stream, "{\"path\": ");
+    print_json_string(stream, image_path);
+    fprintf(stream, ", \"width\": %zu, \"height\": %zu", determined_width, determined_height);
+    fprintf(stream, ", \"scaled_width\": %zu, \"scaled_height\": %zu", scaled_width, scaled_height);
+    fprintf(stream, ", \"x_scale\": ");
+    print_json_number(stream, determined_x_scale);
+    fprintf(stream, ", \"y_scale\": ");
+    print_json_number(stream, determined_y_scale);
+    fprintf(stream, ", \"par\": ");
+    print_json_number(stream, pixel_aspect_ratio);
+    fprintf(stream, ", \"width_confidence\": ");
+    print_json_number(stream, quality->width_confidence);
+    fprintf(stream, ", \"height_confidence\": ");
+    print_json_number(stream, quality->height_confidence);
+    if (scan_progressively) {
+        fprintf(stream, ", \"pixels_touched\": ");
+        print_json_number(stream, quality->pixels_touched);
+    }
+    if (active_area != NULL) {
+        fprintf(
+            stream, ", \"active_area\": {\"x\": %zu, \"y\": %zu, \"width\": %zu, \"height\": %zu}",
+            active_area->x, active_area->y, active_area->width, active_area->height
+        );
+        fprintf(
+            stream, ", \"full_width\": %zu, \"full_height\": %zu",
+            full_frame_dimension(scaled_width, determined_width, active_area->width),
+            full_frame_dimension(scaled_height, determined_height, active_area->height)
+        );
+    }
+    fprintf(stream, "}\n");
+    fflush(stream);
+}
+
+/*
+    How many original pixels the whole screenshot would span, going by how
+    many the part of it that was scanned came out as.
+*/
+size_t full_frame_dimension(size_t scaled_size, size_t determined_size, size_t active_size)
+{
+    if (active_size == 0) {return 0;}
+    return (size_t) ((double) scaled_size * determined_size / active_size + 0.5);
+}
+
+void print_json_error(FILE* stream, const char* image_path, const char* error_description)
+{
+    fprintf(stream, "{\"path\": ");
+    print_json_string(stream, image_path);
+    fprintf(stream, ", \"error\": ");
+    print_json_string(stream, error_description);
+    fprintf(stream, "}\n");
+    fflush(stream);
+}
+
+/*
+    Print what --stats measured of a run, as a table. The input is what the
+    run went through – a path, say – or NULL if there's nothing to call it.
+*/
+void print_stats(FILE* stream, const char* input, const struct run_stats* stats)
+{
+    if (input != NULL) {
+        fprintf(stream, "Stats for \"%s\":\n", input);
+    } else {
+        fprintf(stream, "Stats:\n");
+    }
+    fprintf(stream, "                    Wall          CPU\n");
+    for (size_t i = 0; i < NUM_STATS_PHASES; i++) {
+        fprintf(
+            stream, "  %-12s %9.3lf ms %9.3lf ms\n", phase_names[i],
+            stats->phases[i].wall_nanoseconds / 1e6, stats->phases[i].cpu_nanoseconds / 1e6
+        );
+    }
+    fprintf(stream, "  %-12s %9.3lf ms %9.3lf ms\n", "Total", stats->total.wall_nanoseconds / 1e6, stats->total.cpu_nanoseconds / 1e6);
+    fprintf(stream, "  Bytes decoded:    %llu\n", (unsigned long long) stats->counters[STATS_BYTES_DECODED]);
+    fprintf(stream, "  Frames scanned:   %llu\n", (unsigned long long) stats->counters[STATS_FRAMES]);
+    fprintf(stream, "  Pixels compared:  %llu\n", (unsigned long long) stats->counters[STATS_PIXELS_COMPARED]);
+    fprintf(stream, "  Columns skipped:  %llu\n", (unsigned long long) stats->counters[STATS_COLUMNS_SKIPPED]);
+    fprintf(stream, "  Rows skipped:     %llu\n", (unsigned long long) stats->counters[STATS_ROWS_SKIPPED]);
+    fprintf(stream, "  Rows unchanged:   %llu\n", (unsigned long long) stats->counters[STATS_ROWS_UNCHANGED]);
+    fprintf(stream, "  Column runs:      %zu to %zu wide\n", stats->thinnest_column, stats->thickest_column);
+    fprintf(stream, "  Row runs:         %zu to %zu tall\n", stats->thinnest_row, stats->thickest_row);
+    fflush(stream);
+}
+
+// The same as print_stats, as a single line of JSON.
+void print_json_stats(FILE* stream, const char* input, const struct run_stats* stats)
+{
+    fprintf(stream, "{\"path\": ");
+    if (input != NULL) {
+        print_json_string(stream, input);
+    } else {
+        fprintf(stream, "null");
+    }
+    fprintf(stream, ", \"phases\": {");
+    for (size_t i = 0; i < NUM_STATS_PHASES; i++) {
+        fprintf(stream, "%s\"%s\": ", i > 0 ? ", " : "", phase_keys[i]);
+        print_json_phase_times(stream, &stats->phases[i]);
+    }
+    fprintf(stream, "}, \"total\": ");
+    print_json_phase_times(stream, &stats->total);
+    fprintf(stream, ", \"bytes_decoded\": %llu", (unsigned long long) stats->counters[STATS_BYTES_DECODED]);
+    fprintf(stream, ", \"frames\": %llu", (unsigned long long) stats->counters[STATS_FRAMES]);
+    fprintf(stream, ", \"pixels_compared\": %llu", (unsigned long long) stats->counters[STATS_PIXELS_COMPARED]);
+    fprintf(stream, ", \"columns_skipped\": %llu", (unsigned long long) stats->counters[STATS_COLUMNS_SKIPPED]);
+    fprintf(stream, ", \"rows_skipped\": %llu", (unsigned long long) stats->counters[STATS_ROWS_SKIPPED]);
+    fprintf(stream, ", \"rows_unchanged\": %llu", (unsigned long long) stats->counters[STATS_ROWS_UNCHANGED]);
+    fprintf(stream, ", \"column_runs\": {\"thinnest\": %zu, \"thickest\": %zu}", stats->thinnest_column, stats->thickest_column);
+    fprintf(stream, ", \"row_runs\": {\"thinnest\": %zu, \"thickest\": %zu}", stats->thinnest_row, stats->thickest_row);
+    fprintf(stream, "}\n");
+    fflush(stream);
+}
+
+static void print_json_phase_times(FILE* stream, const struct phase_times* times)
+{
+    fprintf(stream, "{\"wall_ms\": %.3lf, \"cpu_ms\": %.3lf}", times->wall_nanoseconds / 1e6, times->cpu_nanoseconds / 1e6);
+}
+
+static void print_json_string(FILE* stream, const char* string)
+{
+    fputc('"', stream);
+    for (const unsigned char* c = (const unsigned char*) string; *c; c++) {
+        switch (*c) {
+            case '"': fprintf(stream, "\\\""); break;
+            case '\\': fprintf(stream, "\\\\"); break;
+            case '\n': fprintf(stream, "\\n"); break;
+            case '\r': fprintf(stream, "\\r"); break;
+            case '\t': fprintf(stream, "\\t"); break;
+            default:
+                if (*c < 0x20) {
+                    fprintf(stream, "\\u%04x", *c);
+                } else {
+                    fputc(*c, stream);
+                }
+        }
+    }
+    fputc('"', stream);
+}
+
+// JSON has no infinity or NaN, which is what a failed determination ends
+// up as.
+static void print_json_number(FILE* stream, double number)
+{
+    if (isfinite(number)) {
+        fprintf(stream, "%lg", number);
+    } else {
+        fprintf(stream, "null");
+    }
+}
@@ -2,13 +2,28 @@
 #define FORMAT_H
 
 #include <stddef.h>
+#include <stdio.h>
+#include "algorithm/contrast.h"
+#include "algorithm/interface.h"
+#include "stats/stats.h"
 
 void print_with_format(
     const char* format,
     size_t scaled_width, size_t scaled_height,
     size_t determined_width, size_t determined_height,
     double determined_x_scale, double determined_y_scale,
-    double pixel_aspect_ratio
+    double pixel_aspect_ratio, const struct scan_quality* quality
 );
+void print_json_result(
+    FILE* stream, const char* image_path,
+    size_t scaled_width, size_t scaled_height,
+    size_t determined_width, size_t determined_height,
+    double determined_x_scale, double determined_y_scale,
+    double pixel_aspect_ratio, const struct scan_quality* quality, const struct scan_region* active_area
+);
+size_t full_frame_dimension(size_t scaled_size, size_t determined_size, size_t active_size);
+void print_json_error(FILE* stream, const char* image_path, const char* error_description);
+void print_stats(FILE* stream, const char* input, const struct run_stats* stats);
+void print_json_stats(FILE* stream, const char* input, const struct run_stats* stats);
 
 #endif
@@ -16,10 +16,19 @@
 #ifdef IMAGEMAGICK_6
 #include <wand/MagickWand.h>
 #endif
+#include "algorithm/cache.h"
 #include "algorithm/compare.h"
+#include "algorithm/contrast.h"
 #include "algorithm/dimensions.h"
 #include "algorithm/interface.h"
+#include "algorithm/unscale.h"
 #include "cli/format.h"
+#include "cli/serve.h"
+#include "cli/watch.h"
+#include "input/mapping.h"
+#include "input/reader.h"
+#include "output/writer.h"
+#include "stats/stats.h"
 
 #define _STRINGIFY(s) #s
 #define STRINGIFY(s) _STRINGIFY(s)
@@ -36,10 +45,34 @@ static struct argp_option options[] = {
     {"inexact", 'i', 0, 0, "Allow for some leeway when scanning for differing pixels. Useful for, for example, PlayStation 1 screenshots."},
     {"leeway", 'l', "[0..255]", 0, "How much an R, G, or B value can differ when using --inexact (0-255). " STRINGIFY(DEFAULT_FUZZINESS) " by default."},
     {"nearest-neighbor-variation", 'n', "[0...]", 0, "With nearest-neighbor scaling to a non-integer factor, pixels will only vary by 1 pixel in size in each dimension. However, if nearest-neighbor scaling has been applied multiple times to an image, this variation may be larger. For such images, this option lets you set the maximum variation in width/height of rows/columns. 1 by default."},
+    {"threads", 't', "[1...]", 0, "How many threads to scan each image with. Defaults to the number of CPU cores."},
+    {"read-ahead", 0x81, "[0...]", 0, "When given multiple screenshots, how many to decode in the background while scanning the others. 0 decodes and scans them one after another. 2 by default."},
+    {"strip-height", 0x82, "[1...]", 0, "Export and scan each image this many rows at a time rather than all at once, which keeps memory use down for huge images. Turns off --read-ahead."},
+    {"sample", 0x86, 0, 0, "Scan an evenly spaced sample of each screenshot's rows and columns, filling in the gaps only until the resolution stops changing, and print how much of the screenshots was looked at. Animations are likewise only scanned until a frame doesn't change the resolution. Two to three times quicker for screenshots scaled up by 2x or more whose neighboring pixels mostly differ; the rest (including ones scaled up by less than 2x) end up being scanned in full, at about the same speed as without it. Can't be combined with --inexact or --strip-height."},
+    {"max-frames", 0x89, "[1...]", 0, "Of animated screenshots (or ones with several pages), scan only this many frames at most. By default, frames are scanned until there's nothing more they could tell."},
+    {"frame-stride", 0x8A, "[1...]", 0, "Of animated screenshots, scan only every this-many-th frame, for skimming long clips. Frames in between aren't decoded at all. 1 by default."},
+    {"region", 0x8E, "x,y,width,height", 0, "Only scan this region of each screenshot (e.g. \"32,0,1216,720\" for a 4:3 game in a 16:9 frame), and print where it is and what the whole screenshot's resolution comes out as at the same scale as well. Can't be combined with --cache."},
+    {"trim-borders", 0x8F, 0, 0, "Leave out the borders of uniform color around the first screenshot – letterboxing, overscan, or an emulator's backdrop – scanning only what's inside them, the same as --region. Can't be combined with --region, --strip-height, or --cache."},
+    {"cache", 0x85, "directory", 0, "Keep what's found in each screenshot in this directory, so that screenshots that have been scanned before (with the same --inexact and --leeway) only need to be hashed. The directory can be shared between any number of pittari processes at once."},
+    {"profile", 0x90, "file", 0, "Add the screenshots to the profile kept in this file – creating it if there isn't one yet – and print the result from every screenshot that's ever been added to it. Only new screenshots are scanned; ones that have been added before only need to be hashed. With a profile, no screenshots need to be given at all. Can't be combined with --batch, --serve, --connect, --stream, --output, --region, or --trim-borders."},
+    {"watch", 0x91, "directory", 0, "Instead of taking any screenshots, scan the ones in this directory, and then keep running and scan each new one as it's added, printing the result every time – and, with --profile, keeping the profile up to date. Can't be combined with what --profile can't, nor with --stats."},
 
     {0, 0, 0, 0, "Output options:"},
-    {"custom", 'c', "format", 0, "Print the data in a custom format you supply and exit. Available variables are {width}, {height}, {scaled_width}, {scaled_height}, {x_scale}, {y_scale}, and {par}."},
+    {"custom", 'c', "format", 0, "Print the data in a custom format you supply and exit. Available variables are {width}, {height}, {scaled_width}, {scaled_height}, {x_scale}, {y_scale}, {par}, {width_confidence} and {height_confidence} (from 0 to 1), and {pixels_touched} (the share of pixels looked at with --sample)."},
     {"print", 'p', "property", 0, "Print one property and exit. Valid values are \"resolution\" (or \"r\"), \"scale\" (or \"s\"), and \"pixel aspect ratio\" (or \"par\"), printing in the formats \"{width}x{height}\", \"{x_scale}x{y_scale}\", and \"{par}\" respectively. Try --custom for more precise output control."},
+    {"batch", 'b', 0, 0, "Treat each screenshot as unrelated to the others, and print the results for each one as a line of JSON with the keys \"path\", \"width\", \"height\", \"scaled_width\", \"scaled_height\", \"x_scale\", \"y_scale\", \"par\", \"width_confidence\", and \"height_confidence\" (plus \"pixels_touched\" with --sample) – or \"path\" and \"error\" if it couldn't be scanned, in which case the rest are still scanned. Can't be combined with --custom or --print, and turns off --read-ahead."},
+    {"output", 'o', "path", 0, "Also write the screenshot scaled down to its original resolution to this path, sampled straight from where its pixels begin and end. The format goes by the extension: PNG and PPM are written directly, anything else through ImageMagick. Given multiple screenshots (or --batch), this is a directory that each one is written to, under its own name, as a PNG."},
+    {"output-scale", 0x87, "[1...]", 0, "Scale --output back up by this whole factor, in the same pass. 1 by default."},
+    {"output-par", 0x88, "ratio", 0, "Stretch --output so that each pixel is this much wider than it is tall (e.g. \"8:7\" or \"1.14\"), in the same pass – making it taller instead if less than 1. 1 by default."},
+    {"stats", 0x8D, "format", OPTION_ARG_OPTIONAL, "After the result (for each screenshot with --batch), print to standard error how long decoding, scanning, determining the resolution and writing --output took – in wall and CPU time – along with how many bytes were decoded, frames scanned and pixels compared, how many columns and rows were skipped for having been decided already, how many rows were passed over for being the same as in the frame before, and the thinnest and thickest runs of columns and rows. The format can be \"text\" (the default) or \"json\", for a line of JSON. Can't be combined with --serve or --connect."},
+
+    {0, 0, 0, 0, "Stream options:"},
+    {"stream", 0x8B, "format", 0, "Instead of screenshot files, read a stream of frames from the path given – or from standard input if none is, or it's \"-\" – such as live emulator or capture card output piped from ffmpeg. The format can be \"y4m\" (-f yuv4mpegpipe), \"netpbm\" (concatenated PAM, PPM or PGM images), or \"rgb24:<width>x<height>\" (-f rawvideo -pix_fmt rgb24). Frames are scanned as they come in until the stream ends, or – with --sample – until a frame no longer changes the resolution."},
+    {"report-every", 0x8C, "[1...]", 0, "With --stream, print the result so far every this many frames, as well as at the end."},
+
+    {0, 0, 0, 0, "Server options:"},
+    {"serve", 0x83, "socket", 0, "Instead of scanning any screenshots, keep running and scan whatever's sent to the Unix domain socket at this path – see --connect. Saves on startup time when scanning screenshots one by one as they come in. The algorithm options given are the defaults for requests that don't set their own. Requests are scanned in parallel, so each gets one thread by default."},
+    {"connect", 0x84, "socket", 0, "Send the screenshots to a server started with --serve at this path, along with any algorithm options, and print its replies (the same as --batch). A screenshot path of \"-\" sends standard input."},
 
     {0, 0, 0, 0, "Help:", -1},
     {"help", 'h', 0, 0, "Print this help page and exit."},
@@ -54,14 +87,40 @@ struct options {
     bool inexact;
     int leeway;
     int nearest_neighbor_max_variation;
+    int threads;
+    int read_ahead;
+    int strip_height;
+    int max_frames;
+    int frame_stride;
+    char* cache;
+    char* profile;
+    char* watch;
+    bool sample;
+    struct scan_region region;
+    bool trim_borders;
 
     bool format_specified;
     char* format;
+    bool batch;
+    char* output;
+    int output_scale;
+    double output_pixel_aspect_ratio;
+    char* serve_socket;
+    char* connect_socket;
+    bool stats;
+    bool stats_as_json;
+    bool stream;
+    enum stream_format stream_format;
+    size_t stream_width;
+    size_t stream_height;
+    int report_interval;
 
     size_t num_image_paths;
     char** image_paths;
 };
 
+static double parse_ratio(const char* arg);
+
 static int parse_options(int key, char *arg, struct argp_state *state) {
     struct options* options = state->input;
     switch (key) {
@@ -80,6 +139,57 @@ static int parse_options(int key, char *arg, struct argp_state *state) {
                 exit(-1);
             }
             break;
+        case 't':
+            options->threads = atoi(arg);
+            if (options->threads < 1) {
+                fprintf(stderr, "ERROR: Invalid --threads argument: \"%s\"\n", arg);
+                exit(-1);
+            }
+            break;
+        case 0x81:
+            options->read_ahead = atoi(arg);
+            if ((options->read_ahead == 0 && strcmp(arg, "0") != 0) || options->read_ahead < 0) {
+                fprintf(stderr, "ERROR: Invalid --read-ahead argument: \"%s\"\n", arg);
+                exit(-1);
+            }
+            break;
+        case 0x82:
+            options->strip_height = atoi(arg);
+            if (options->strip_height < 1) {
+                fprintf(stderr, "ERROR: Invalid --strip-height argument: \"%s\"\n", arg);
+                exit(-1);
+            }
+            break;
+
+        case 0x89:
+            options->max_frames = atoi(arg);
+            if (options->max_frames < 1) {
+                fprintf(stderr, "ERROR: Invalid --max-frames argument: \"%s\"\n", arg);
+                exit(-1);
+            }
+            break;
+        case 0x8A:
+            options->frame_stride = atoi(arg);
+            if (options->frame_stride < 1) {
+                fprintf(stderr, "ERROR: Invalid --frame-stride argument: \"%s\"\n", arg);
+                exit(-1);
+            }
+            break;
+
+        case 0x8E:
+            if (
+                sscanf(arg, "%zu,%zu,%zu,%zu", &options->region.x, &options->region.y, &options->region.width, &options->region.height) != 4 ||
+                options->region.width == 0 || options->region.height == 0
+            ) {
+                fprintf(stderr, "ERROR: Invalid --region argument: \"%s\"\n", arg);
+                exit(-1);
+            }
+            break;
+        case 0x8F: options->trim_borders = true; break;
+        case 0x85: options->cache = arg; break;
+        case 0x90: options->profile = arg; break;
+        case 0x91: options->watch = arg; break;
+        case 0x86: options->sample = true; break;
 
         case 'c':
             options->format_specified = true;
@@ -98,6 +208,61 @@ static int parse_options(int key, char *arg, struct argp_state *state) {
                 exit(-1);
             }
             break;
+        case 'b': options->batch = true; break;
+        case 'o': options->output = arg; break;
+        case 0x87:
+            options->output_scale = atoi(arg);
+            if (options->output_scale < 1) {
+                fprintf(stderr, "ERROR: Invalid --output-scale argument: \"%s\"\n", arg);
+                exit(-1);
+            }
+            break;
+        case 0x88:
+            options->output_pixel_aspect_ratio = parse_ratio(arg);
+            if (options->output_pixel_aspect_ratio <= 0) {
+                fprintf(stderr, "ERROR: Invalid --output-par argument: \"%s\"\n", arg);
+                exit(-1);
+            }
+            break;
+
+        case 0x8D:
+            options->stats = true;
+            if (arg == NULL || strcmp(arg, "text") == 0) {
+                options->stats_as_json = false;
+            } else if (strcmp(arg, "json") == 0) {
+                options->stats_as_json = true;
+            } else {
+                fprintf(stderr, "ERROR: Invalid --stats argument: \"%s\"\nValid arguments are \"text\" and \"json\".\n", arg);
+                exit(-1);
+            }
+            break;
+
+        case 0x83: options->serve_socket = arg; break;
+        case 0x84: options->connect_socket = arg; break;
+
+        case 0x8B:
+            options->stream = true;
+            if (strcmp(arg, "y4m") == 0) {
+                options->stream_format = STREAM_Y4M;
+            } else if (strcmp(arg, "netpbm") == 0) {
+                options->stream_format = STREAM_NETPBM;
+            } else if (
+                sscanf(arg, "rgb24:%zux%zu", &options->stream_width, &options->stream_height) == 2 &&
+                options->stream_width > 0 && options->stream_height > 0
+            ) {
+                options->stream_format = STREAM_RGB24;
+            } else {
+                fprintf(stderr, "ERROR: Invalid --stream argument: \"%s\"\nValid arguments are \"y4m\", \"netpbm\", and \"rgb24:<width>x<height>\".\n", arg);
+                exit(-1);
+            }
+            break;
+        case 0x8C:
+            options->report_interval = atoi(arg);
+            if (options->report_interval < 1) {
+                fprintf(stderr, "ERROR: Invalid --report-every argument: \"%s\"\n", arg);
+                exit(-1);
+            }
+            break;
 
         case 'h':
             argp_state_help(state, stdout, ARGP_HELP_SHORT_USAGE | ARGP_HELP_DOC | ARGP_HELP_LONG | ARGP_HELP_BUG_ADDR | ARGP_HELP_EXIT_OK);
@@ -116,6 +281,7 @@ static int parse_options(int key, char *arg, struct argp_state *state) {
             break;
         
         case ARGP_KEY_NO_ARGS:
+            if (options->serve_socket != NULL || options->stream || options->profile != NULL || options->watch != NULL) {break;}
             argp_state_help(state, stdout, ARGP_HELP_SHORT_USAGE | ARGP_HELP_PRE_DOC | ARGP_HELP_EXIT_ERR);
             break;
 
@@ -127,6 +293,36 @@ static int parse_options(int key, char *arg, struct argp_state *state) {
 
 static struct argp argp = {options, parse_options, args_doc, doc, 0, 0, 0};
 
+// Either a decimal number or "width:height" (or "width/height"). Returns 0
+// if it's neither.
+static double parse_ratio(const char* arg)
+{
+    char* end;
+    double ratio = strtod(arg, &end);
+    if (end == arg) {return 0;}
+    if (*end == ':' || *end == '/') {
+        const char* denominator_start = end + 1;
+        double denominator = strtod(denominator_start, &end);
+        if (end == denominator_start || denominator <= 0) {return 0;}
+        ratio /= denominator;
+    }
+    return *end == 0 ? ratio : 0;
+}
+
+static void run_single(const struct options* options);
+static int run_batch(const struct options* options);
+static int run_stream(const struct options* options);
+static int run_profile(const struct options* options);
+static int run_watch(const struct options* options);
+static bool add_to_profile(struct dimension_profile* profile, const char* image_path, bool exit_on_error);
+static bool print_profile_result(const struct options* options, const struct dimension_profile* profile);
+static void print_result(
+    const struct options* options,
+    size_t scaled_width, size_t scaled_height,
+    size_t determined_width, size_t determined_height
+);
+static void print_run_stats(const struct options* options, const char* input);
+
 int main(int argc, char **argv)
 {
     struct options options;
@@ -134,14 +330,133 @@ int main(int argc, char **argv)
     options.inexact = false;
     options.leeway = DEFAULT_FUZZINESS;
     options.nearest_neighbor_max_variation = 1;
+    options.threads = 0;
+    options.read_ahead = 2;
+    options.strip_height = 0;
+    options.max_frames = 0;
+    options.frame_stride = 1;
+    options.cache = NULL;
+    options.profile = NULL;
+    options.watch = NULL;
+    options.sample = false;
+    options.region.x = 0;
+    options.region.y = 0;
+    options.region.width = 0;
+    options.region.height = 0;
+    options.trim_borders = false;
     options.format_specified = false;
     options.format = 0;
+    options.batch = false;
+    options.output = NULL;
+    options.output_scale = 1;
+    options.output_pixel_aspect_ratio = 1;
+    options.stats = false;
+    options.stats_as_json = false;
+    options.serve_socket = NULL;
+    options.connect_socket = NULL;
+    options.stream = false;
+    options.stream_format = STREAM_NETPBM;
+    options.stream_width = 0;
+    options.stream_height = 0;
+    options.report_interval = 0;
+    options.num_image_paths = 0;
+    options.image_paths = NULL;
 
     argp_parse(&argp, argc, argv, ARGP_NO_HELP, 0, &options);
 
-    if (options.inexact) {compare_pixel = compare_pixel_fuzzy;}
+    if (options.batch && options.format_specified) {
+        fprintf(stderr, "ERROR: --batch can't be combined with --custom or --print.\n");
+        exit(-1);
+    }
+    if (options.connect_socket != NULL && (options.format_specified || options.batch)) {
+        fprintf(stderr, "ERROR: --connect can't be combined with --custom, --print, or --batch.\n");
+        exit(-1);
+    }
+    if (options.serve_socket != NULL && (options.num_image_paths > 0 || options.connect_socket != NULL)) {
+        fprintf(stderr, "ERROR: --serve doesn't take any screenshots.\n");
+        exit(-1);
+    }
+    if (options.stream && (
+        options.batch || options.serve_socket != NULL || options.connect_socket != NULL ||
+        options.output != NULL || options.cache != NULL
+    )) {
+        fprintf(stderr, "ERROR: --stream can't be combined with --batch, --serve, --connect, --output, or --cache.\n");
+        exit(-1);
+    }
+    if (options.stream && options.num_image_paths > 1) {
+        fprintf(stderr, "ERROR: --stream reads a single stream.\n");
+        exit(-1);
+    }
+    if (options.report_interval > 0 && !options.stream) {
+        fprintf(stderr, "ERROR: --report-every only goes with --stream.\n");
+        exit(-1);
+    }
+    if (options.output != NULL && (options.serve_socket != NULL || options.connect_socket != NULL)) {
+        fprintf(stderr, "ERROR: --output can't be combined with --serve or --connect.\n");
+        exit(-1);
+    }
+    if (options.stats && (options.serve_socket != NULL || options.connect_socket != NULL)) {
+        fprintf(stderr, "ERROR: --stats can't be combined with --serve or --connect.\n");
+        exit(-1);
+    }
+    if ((options.profile != NULL || options.watch != NULL) && (
+        options.batch || options.serve_socket != NULL || options.connect_socket != NULL || options.stream ||
+        options.output != NULL || options.region.width > 0 || options.trim_borders
+    )) {
+        fprintf(stderr, "ERROR: --profile and --watch can't be combined with --batch, --serve, --connect, --stream, --output, --region, or --trim-borders.\n");
+        exit(-1);
+    }
+    if (options.watch != NULL && options.num_image_paths > 0) {
+        fprintf(stderr, "ERROR: --watch doesn't take any screenshots.\n");
+        exit(-1);
+    }
+    if (options.watch != NULL && options.stats) {
+        fprintf(stderr, "ERROR: --stats can't be combined with --watch.\n");
+        exit(-1);
+    }
+    collect_stats = options.stats;
+
+    if (options.inexact) {pixel_comparison = COMPARE_FUZZY;}
     compare_pixel_fuzzy_fuzziness = options.leeway;
     nearest_neighbor_max_variation = options.nearest_neighbor_max_variation;
+    num_scan_threads = options.threads;
+    num_decode_threads = options.read_ahead;
+    scan_strip_height = options.strip_height;
+    max_frames = options.max_frames;
+    frame_stride = options.frame_stride;
+    if (options.sample && options.strip_height > 0) {
+        fprintf(stderr, "ERROR: --sample can't be combined with --strip-height.\n");
+        exit(-1);
+    }
+    if (options.sample && options.inexact) {
+        fprintf(stderr, "ERROR: --sample can't be combined with --inexact.\n");
+        exit(-1);
+    }
+    scan_progressively = options.sample;
+    if (options.trim_borders && (options.region.width > 0 || options.strip_height > 0)) {
+        fprintf(stderr, "ERROR: --trim-borders can't be combined with --region or --strip-height.\n");
+        exit(-1);
+    }
+    if ((options.region.width > 0 || options.trim_borders) && options.cache != NULL) {
+        fprintf(stderr, "ERROR: --region and --trim-borders can't be combined with --cache.\n");
+        exit(-1);
+    }
+    scan_region = options.region;
+    trim_borders = options.trim_borders;
+    if (options.cache != NULL) {
+        if (!create_cache_directory(options.cache)) {
+            fprintf(stderr, "ERROR: Invalid --cache argument: \"%s\"\n", options.cache);
+            exit(-1);
+        }
+        cache_directory = options.cache;
+    }
+    output_path = options.output;
+    output_scale = options.output_scale;
+    output_pixel_aspect_ratio = options.output_pixel_aspect_ratio;
+    if (options.output != NULL && options.batch && !create_output_directory(options.output)) {
+        fprintf(stderr, "ERROR: Invalid --output argument: \"%s\"\n", options.output);
+        exit(-1);
+    }
 
 #ifdef WIN64
     // Here's the skinny: ImageMagick is not at all friendly to portable
@@ -163,38 +478,347 @@ int main(int argc, char **argv)
     putenv(putenv_directive);
 #endif
 
+    struct scan_options scan_options;
+    scan_options.inexact = options.inexact;
+    scan_options.leeway = options.leeway;
+    scan_options.nearest_neighbor_max_variation = options.nearest_neighbor_max_variation;
+    if (options.serve_socket != NULL) {
+        serve(options.serve_socket, &scan_options);
+    }
+    if (options.connect_socket != NULL) {
+        return connect_and_scan(options.connect_socket, &scan_options, options.num_image_paths, options.image_paths);
+    }
+
+    // ImageMagick, if it was started up at all, is only shut down once
+    // everything's been scanned, since it can't be started up again.
+    int status = 0;
+    if (options.batch) {
+        status = run_batch(&options);
+    } else if (options.stream) {
+        status = run_stream(&options);
+    } else if (options.watch != NULL) {
+        status = run_watch(&options);
+    } else if (options.profile != NULL) {
+        status = run_profile(&options);
+    } else {
+        run_single(&options);
+    }
+    finish_image_readers();
+    return status;
+}
+
+// Scans every image given as one, and prints the result.
+static void run_single(const struct options* options)
+{
     size_t scaled_width;
     size_t scaled_height;
     size_t determined_width;
     size_t determined_height;
 
+    start_run_stats();
     determine_dimensions(
-        options.num_image_paths, options.image_paths,
+        options->num_image_paths, options->image_paths,
         &scaled_width, &scaled_height,
         &determined_width, &determined_height
     );
 
-    double determined_x_scale = (double) scaled_width / (double) determined_width;
-    double determined_y_scale = (double) scaled_height / (double) determined_height;
+    print_result(
+        options,
+        scaled_width, scaled_height,
+        determined_width, determined_height
+    );
+    print_run_stats(options, options->num_image_paths == 1 ? options->image_paths[0] : NULL);
+}
+
+/*
+    Scan a stream of frames, printing the result every so many frames if
+    asked to, and at the end.
+*/
+static int run_stream(const struct options* options)
+{
+    const char* path = options->num_image_paths > 0 ? options->image_paths[0] : "-";
+    start_run_stats();
+    struct dimension_stream* stream = open_dimension_stream(path, options->stream_format, options->stream_width, options->stream_height);
+
+    size_t scaled_width;
+    size_t scaled_height;
+    size_t determined_width;
+    size_t determined_height;
+    while (scan_stream_frames(
+        stream, options->report_interval,
+        &scaled_width, &scaled_height,
+        &determined_width, &determined_height
+    )) {
+        print_result(
+            options,
+            scaled_width, scaled_height,
+            determined_width, determined_height
+        );
+        fflush(stdout);
+    }
+    close_dimension_stream(stream);
+
+    print_result(
+        options,
+        scaled_width, scaled_height,
+        determined_width, determined_height
+    );
+    print_run_stats(options, path);
+    return 0;
+}
+
+/*
+    Add the screenshots to the --profile, save it, and print the result from
+    every screenshot that's in it.
+*/
+static int run_profile(const struct options* options)
+{
+    start_run_stats();
+    struct dimension_profile* profile = open_dimension_profile(options->profile);
+    bool changed = false;
+    for (size_t i = 0; i < options->num_image_paths; i++) {
+        // The next one can be on its way while this one's being scanned.
+        if (i + 1 < options->num_image_paths) {prefetch_file(options->image_paths[i + 1]);}
+        changed = add_to_profile(profile, options->image_paths[i], true) || changed;
+    }
+    if (changed && !save_dimension_profile(profile)) {
+        fprintf(stderr, "ERROR: Could not write profile \"%s\".\n", options->profile);
+        exit(-1);
+    }
+    if (!print_profile_result(options, profile)) {
+        fprintf(stderr, "ERROR: Profile \"%s\" doesn't have any screenshots in it yet.\n", options->profile);
+        exit(-1);
+    }
+    print_run_stats(options, options->num_image_paths == 1 ? options->image_paths[0] : NULL);
+    close_dimension_profile(profile);
+    return 0;
+}
+
+/*
+    Scan every screenshot in the --watch directory that isn't in the
+    --profile (if there is one) yet, and then each one that's added to it,
+    for as long as the directory's there. The result's printed – and the
+    profile saved – every time a screenshot's added, so that neither is ever
+    out of date when this is stopped. Screenshots that can't be scanned are
+    passed over.
+*/
+static int run_watch(const struct options* options)
+{
+    // Watching starts before the screenshots already there are listed, so
+    // that none added in between are missed. Any that are picked up twice
+    // as a result are only hashed the second time.
+    struct directory_watch* watch = start_watching_directory(options->watch);
+    size_t num_paths;
+    char** paths = watch != NULL ? list_directory_files(options->watch, &num_paths) : NULL;
+    if (paths == NULL) {
+        fprintf(stderr, "ERROR: Invalid --watch argument: \"%s\"\n", options->watch);
+        exit(-1);
+    }
+    struct dimension_profile* profile = open_dimension_profile(options->profile);
+
+    bool changed = false;
+    for (size_t i = 0; i < num_paths; i++) {
+        if (options->profile != NULL && same_file(paths[i], options->profile)) {continue;}
+        if (i + 1 < num_paths) {prefetch_file(paths[i + 1]);}
+        changed = add_to_profile(profile, paths[i], false) || changed;
+    }
+    free_paths(paths, num_paths);
+
+    char* path = NULL;
+    do {
+        if (path != NULL && !(options->profile != NULL && same_file(path, options->profile))) {
+            changed = add_to_profile(profile, path, false);
+        }
+        free(path);
+        if (changed && !save_dimension_profile(profile)) {
+            fprintf(stderr, "ERROR: Could not write profile \"%s\".\n", options->profile);
+            exit(-1);
+        }
+        if (changed || path == NULL) {
+            print_profile_result(options, profile);
+            fflush(stdout);
+        }
+        changed = false;
+    } while ((path = next_added_file(watch)) != NULL);
+
+    fprintf(stderr, "ERROR: Stopped being able to watch \"%s\".\n", options->watch);
+    stop_watching_directory(watch);
+    close_dimension_profile(profile);
+    return -1;
+}
+
+/*
+    Returns whether the screenshot's new to the profile. If it can't be
+    scanned, either exits or says so and carries on.
+*/
+static bool add_to_profile(struct dimension_profile* profile, const char* image_path, bool exit_on_error)
+{
+    bool added;
+    char error_description[READER_ERROR_SIZE];
+    if (add_to_dimension_profile(profile, image_path, &added, error_description)) {
+        fprintf(stderr, "ERROR: Could not add \"%s\" to the profile: %s\n", image_path, error_description);
+        if (exit_on_error) {exit(-1);}
+        return false;
+    }
+    return added;
+}
+
+// Returns false if there's nothing in the profile to print.
+static bool print_profile_result(const struct options* options, const struct dimension_profile* profile)
+{
+    size_t scaled_width;
+    size_t scaled_height;
+    size_t determined_width;
+    size_t determined_height;
+    if (!determine_profile_dimensions(
+        profile,
+        &scaled_width, &scaled_height,
+        &determined_width, &determined_height
+    )) {
+        return false;
+    }
+    print_result(
+        options,
+        scaled_width, scaled_height,
+        determined_width, determined_height
+    );
+    if (!options->format_specified) {
+        printf("Screenshots:         %zu\n", profile_screenshot_count(profile));
+    }
+    return true;
+}
+
+static void print_result(
+    const struct options* options,
+    size_t scaled_width, size_t scaled_height,
+    size_t determined_width, size_t determined_height
+)
+{
+    // The resolution's that of the active area, which may be all there is.
+    bool partial = active_area.width != scaled_width || active_area.height != scaled_height;
+    double determined_x_scale = (double) active_area.width / (double) determined_width;
+    double determined_y_scale = (double) active_area.height / (double) determined_height;
     double pixel_aspect_ratio = determined_x_scale / determined_y_scale;
 
 #ifdef DEBUG
     printf("== RESULT ==\n\n");
 #endif
 
-    if (!options.format_specified) {
+    if (!options->format_specified) {
         printf("Original resolution: %zu x %zu\n", determined_width, determined_height);
         printf("Scale:               %lg x %lg\n", determined_x_scale, determined_y_scale);
         printf("Pixel aspect ratio:  %lg\n", pixel_aspect_ratio);
+        printf("Confidence:          %.0lf%% x %.0lf%%\n", 100 * width_confidence, 100 * height_confidence);
+        if (partial) {
+            printf(
+                "Active area:         %zu x %zu at %zu, %zu\n",
+                active_area.width, active_area.height, active_area.x, active_area.y
+            );
+            printf(
+                "Full frame:          %zu x %zu\n",
+                full_frame_dimension(scaled_width, determined_width, active_area.width),
+                full_frame_dimension(scaled_height, determined_height, active_area.height)
+            );
+        }
+        if (options->sample && num_pixels_scanned > 0) {
+            printf("Pixels looked at:    %.3lg%%\n", 100.0 * num_pixels_touched / num_pixels_scanned);
+        }
     } else {
+        struct scan_quality quality = {
+            width_confidence, height_confidence,
+            num_pixels_scanned > 0 ? (double) num_pixels_touched / num_pixels_scanned : 0
+        };
         print_with_format(
-            options.format,
+            options->format,
             scaled_width, scaled_height,
             determined_width, determined_height,
             determined_x_scale, determined_y_scale,
-            pixel_aspect_ratio
+            pixel_aspect_ratio, &quality
         );
     }
+}
 
-    return 0;
+/*
+    Scan every screenshot on its own, printing a line of JSON for each – and
+    writing each one into the --output directory, if there is one. Returns
+    the exit code: -1 if any of them couldn't be scanned (or written).
+*/
+static int run_batch(const struct options* options)
+{
+    size_t num_image_paths = options->num_image_paths;
+    char** image_paths = options->image_paths;
+    const char* output_directory = options->output;
+    struct dimension_scanner* scanner = create_dimension_scanner();
+    if (scanner == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        exit(-1);
+    }
+
+    int exit_code = 0;
+    for (size_t i = 0; i < num_image_paths; i++) {
+        size_t scaled_width;
+        size_t scaled_height;
+        size_t determined_width;
+        size_t determined_height;
+        char error_description[READER_ERROR_SIZE];
+
+        start_run_stats();
+        // The next one can be on its way while this one's being scanned.
+        if (i + 1 < num_image_paths) {prefetch_file(image_paths[i + 1]);}
+        int error = scan_image_dimensions(
+            scanner, image_paths[i],
+            &scaled_width, &scaled_height,
+            &determined_width, &determined_height,
+            error_description
+        );
+
+        if (!error && output_directory != NULL) {
+            char* path = output_file_path(output_directory, image_paths[i]);
+            if (path == NULL) {
+                fprintf(stderr, "ERROR: Out of memory.\n");
+                exit(-1);
+            }
+            error = write_scanned_screenshot(
+                scanner, image_paths[i], path,
+                determined_width, determined_height,
+                error_description
+            );
+            free(path);
+        }
+
+        if (error) {
+            print_json_error(stdout, image_paths[i], error_description);
+            exit_code = -1;
+        } else {
+            struct scan_region area = scanner_region(scanner);
+            struct scan_quality quality = scanner_quality(scanner);
+            bool partial = area.width != scaled_width || area.height != scaled_height;
+            double determined_x_scale = (double) area.width / (double) determined_width;
+            double determined_y_scale = (double) area.height / (double) determined_height;
+            print_json_result(
+                stdout, image_paths[i],
+                scaled_width, scaled_height,
+                determined_width, determined_height,
+                determined_x_scale, determined_y_scale,
+                determined_x_scale / determined_y_scale, &quality, partial ? &area : NULL
+            );
+        }
+        print_run_stats(options, image_paths[i]);
+    }
+
+    destroy_dimension_scanner(scanner);
+    return exit_code;
+}
+
+// With --stats, prints what was measured since start_run_stats.
+static void print_run_stats(const struct options* options, const char* input)
+{
+    if (!options->stats) {return;}
+    struct run_stats stats;
+    finish_run_stats(&stats);
+    if (options->stats_as_json) {
+        print_json_stats(stderr, input, &stats);
+    } else {
+        print_stats(stderr, input, &stats);
+    }
 }
@@ -0,0 +1,412 @@
+#include "cli/serve.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN64
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "algorithm/compare.h"
+#include "algorithm/interface.h"
+#include "algorithm/pool.h"
+#include "cli/format.h"
+#include "input/reader.h"
+
+#ifndef WIN64
+
+// Long enough for a "path" line with any path the system allows.
+#define MAX_REQUEST_LINE_LENGTH (PATH_MAX + 64)
+// Blobs any bigger than this are turned away rather than read into memory.
+#define MAX_BLOB_SIZE ((size_t) 1 << 30)
+// A reply is a line of JSON with a path in it, every character of which
+// may take up to 6 once escaped.
+#define MAX_REPLY_LENGTH (6 * PATH_MAX + 256)
+
+struct server {
+    struct scan_options defaults;
+
+    // One scanner per request that can be scanned at once, each with the
+    // algorithm options of whichever request it's scanning. Any requests
+    // beyond that wait for one to free up.
+    struct dimension_scanner** idle_scanners;
+    size_t num_idle_scanners;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t scanner_freed;
+};
+
+struct connection {
+    struct server* server;
+    int socket;
+};
+
+static void* handle_connection(void* connection_pointer);
+static bool handle_request(struct server* server, FILE* in, FILE* out);
+static struct dimension_scanner* take_scanner(struct server* server, const struct scan_options* options);
+static void give_back_scanner(struct server* server, struct dimension_scanner* scanner);
+static bool read_request_line(FILE* in, char line[MAX_REQUEST_LINE_LENGTH]);
+static bool parse_request_number(const char* string, int* number);
+static unsigned char* read_whole_file(FILE* file, size_t* size);
+static int open_socket(const char* socket_path, struct sockaddr_un* address);
+
+/*
+    Runs the server until the process is killed. Exits if the socket can't
+    be set up.
+*/
+void serve(const char* socket_path, const struct scan_options* defaults)
+{
+    // A client hanging up mid-reply shouldn't take the whole server down.
+    signal(SIGPIPE, SIG_IGN);
+    // Requests are scanned in parallel with each other, so each one gets
+    // a single thread unless told otherwise.
+    if (num_scan_threads == 0) {num_scan_threads = 1;}
+
+    struct server server;
+    server.defaults = *defaults;
+    server.num_idle_scanners = count_cpu_cores();
+    server.idle_scanners = (struct dimension_scanner**) calloc(server.num_idle_scanners, sizeof(struct dimension_scanner*));
+    if (server.idle_scanners == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        exit(-1);
+    }
+    // The scanners are all set up front, since setting one up also picks
+    // the SIMD kernels, which mustn't change while others are scanning.
+    for (size_t i = 0; i < server.num_idle_scanners; i++) {
+        server.idle_scanners[i] = create_dimension_scanner();
+        if (server.idle_scanners[i] == NULL) {
+            fprintf(stderr, "ERROR: Out of memory.\n");
+            exit(-1);
+        }
+    }
+    pthread_mutex_init(&server.mutex, NULL);
+    pthread_cond_init(&server.scanner_freed, NULL);
+
+    struct sockaddr_un address;
+    int listener = open_socket(socket_path, &address);
+    if (listener < 0) {
+        fprintf(stderr, "ERROR: Invalid --serve socket path: \"%s\"\n", socket_path);
+        exit(-1);
+    }
+    // A socket left behind by a server that's no longer running would
+    // otherwise be in the way.
+    struct stat socket_stat;
+    if (stat(socket_path, &socket_stat) == 0 && S_ISSOCK(socket_stat.st_mode)) {
+        unlink(socket_path);
+    }
+    if (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        fprintf(stderr, "ERROR: Could not listen on \"%s\": %s\n", socket_path, strerror(errno));
+        exit(-1);
+    }
+
+    while (true) {
+        int connection_socket = accept(listener, NULL, NULL);
+        if (connection_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {continue;}
+            fprintf(stderr, "ERROR: Could not accept connection: %s\n", strerror(errno));
+            exit(-1);
+        }
+
+        struct connection* connection = (struct connection*) malloc(sizeof(struct connection));
+        pthread_t thread;
+        if (connection == NULL) {
+            close(connection_socket);
+            continue;
+        }
+        connection->server = &server;
+        connection->socket = connection_socket;
+        if (pthread_create(&thread, NULL, handle_connection, connection) != 0) {
+            close(connection_socket);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+/*
+    Sends every screenshot to the server at socket_path and prints its
+    replies. A path of "-" sends whatever's on standard input. Returns the
+    exit code: -1 if any of them couldn't be scanned.
+*/
+int connect_and_scan(const char* socket_path, const struct scan_options* options, size_t num_image_paths, char** image_paths)
+{
+    struct sockaddr_un address;
+    int server_socket = open_socket(socket_path, &address);
+    if (server_socket < 0) {
+        fprintf(stderr, "ERROR: Invalid --connect socket path: \"%s\"\n", socket_path);
+        exit(-1);
+    }
+    if (connect(server_socket, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        fprintf(stderr, "ERROR: Could not connect to \"%s\": %s\n", socket_path, strerror(errno));
+        exit(-1);
+    }
+    FILE* out = fdopen(server_socket, "wb");
+    FILE* in = fdopen(dup(server_socket), "rb");
+    char* reply = (char*) malloc(MAX_REPLY_LENGTH * sizeof(char));
+    if (out == NULL || in == NULL || reply == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        exit(-1);
+    }
+
+    int exit_code = 0;
+    for (size_t i = 0; i < num_image_paths; i++) {
+        unsigned char* blob = NULL;
+        size_t blob_size = 0;
+        if (strcmp(image_paths[i], "-") == 0) {
+            blob = read_whole_file(stdin, &blob_size);
+            // The server would turn an empty blob away and hang up, leaving
+            // the rest of the screenshots unsent.
+            if (blob_size == 0) {
+                free(blob);
+                print_json_error(stdout, "-", "No image data.");
+                fflush(stdout);
+                exit_code = -1;
+                continue;
+            }
+        }
+
+        if (options->inexact) {fprintf(out, "inexact\n");}
+        fprintf(out, "leeway %d\n", options->leeway);
+        fprintf(out, "nearest-neighbor-variation %d\n", options->nearest_neighbor_max_variation);
+        if (blob != NULL) {
+            fprintf(out, "blob %zu\n", blob_size);
+            fwrite(blob, 1, blob_size, out);
+            free(blob);
+        } else {
+            // The server's working directory isn't necessarily this one.
+            char absolute_path[PATH_MAX];
+            fprintf(out, "path %s\n", realpath(image_paths[i], absolute_path) != NULL ? absolute_path : image_paths[i]);
+        }
+        fflush(out);
+
+        if (fgets(reply, MAX_REPLY_LENGTH, in) == NULL) {
+            fprintf(stderr, "ERROR: The server hung up.\n");
+            exit(-1);
+        }
+        if (strstr(reply, "\"error\": ") != NULL) {exit_code = -1;}
+        fputs(reply, stdout);
+        fflush(stdout);
+    }
+
+    free(reply);
+    fclose(in);
+    fclose(out);
+    return exit_code;
+}
+
+static void* handle_connection(void* connection_pointer)
+{
+    struct connection* connection = (struct connection*) connection_pointer;
+    FILE* in = fdopen(connection->socket, "rb");
+    int out_socket = dup(connection->socket);
+    FILE* out = out_socket >= 0 ? fdopen(out_socket, "wb") : NULL;
+    if (in != NULL && out != NULL) {
+        while (handle_request(connection->server, in, out)) {}
+    }
+
+    if (in != NULL) {fclose(in);} else {close(connection->socket);}
+    if (out != NULL) {fclose(out);} else if (out_socket >= 0) {close(out_socket);}
+    free(connection);
+    return NULL;
+}
+
+/*
+    Reads one request, scans it, and sends the reply. Returns false once
+    the connection should be closed – when the client's done, or has sent
+    something that doesn't make sense.
+*/
+static bool handle_request(struct server* server, FILE* in, FILE* out)
+{
+    struct scan_options options = server->defaults;
+    char line[MAX_REQUEST_LINE_LENGTH];
+    const char* image_path = NULL;
+    unsigned char* blob = NULL;
+    size_t blob_size = 0;
+    while (image_path == NULL && blob == NULL) {
+        if (!read_request_line(in, line)) {return false;}
+
+        if (strcmp(line, "inexact") == 0) {
+            options.inexact = true;
+        } else if (strncmp(line, "leeway ", 7) == 0) {
+            if (!parse_request_number(line + 7, &options.leeway)) {
+                print_json_error(out, "", "Invalid leeway.");
+                return false;
+            }
+        } else if (strncmp(line, "nearest-neighbor-variation ", 27) == 0) {
+            if (!parse_request_number(line + 27, &options.nearest_neighbor_max_variation)) {
+                print_json_error(out, "", "Invalid nearest-neighbor-variation.");
+                return false;
+            }
+        } else if (strncmp(line, "path ", 5) == 0) {
+            image_path = line + 5;
+        } else if (strncmp(line, "blob ", 5) == 0) {
+            char* end;
+            blob_size = strtoull(line + 5, &end, 10);
+            if (end == line + 5 || *end != 0 || blob_size == 0 || blob_size > MAX_BLOB_SIZE) {
+                print_json_error(out, "-", "Invalid blob size.");
+                return false;
+            }
+            blob = (unsigned char*) malloc(blob_size * sizeof(unsigned char));
+            if (blob == NULL) {
+                print_json_error(out, "-", "Out of memory.");
+                return false;
+            }
+            if (fread(blob, 1, blob_size, in) != blob_size) {
+                free(blob);
+                return false;
+            }
+        } else {
+            print_json_error(out, "", "Invalid request.");
+            return false;
+        }
+    }
+
+    size_t scaled_width;
+    size_t scaled_height;
+    size_t determined_width;
+    size_t determined_height;
+    char error_description[READER_ERROR_SIZE];
+    int error;
+
+    struct dimension_scanner* scanner = take_scanner(server, &options);
+    if (image_path != NULL) {
+        error = scan_image_dimensions(
+            scanner, image_path,
+            &scaled_width, &scaled_height,
+            &determined_width, &determined_height,
+            error_description
+        );
+    } else {
+        error = scan_image_blob_dimensions(
+            scanner, blob, blob_size,
+            &scaled_width, &scaled_height,
+            &determined_width, &determined_height,
+            error_description
+        );
+        image_path = "-";
+    }
+    struct scan_region area = scanner_region(scanner);
+    struct scan_quality quality = scanner_quality(scanner);
+    give_back_scanner(server, scanner);
+    free(blob);
+
+    if (error) {
+        print_json_error(out, image_path, error_description);
+    } else {
+        bool partial = area.width != scaled_width || area.height != scaled_height;
+        double determined_x_scale = (double) area.width / (double) determined_width;
+        double determined_y_scale = (double) area.height / (double) determined_height;
+        print_json_result(
+            out, image_path,
+            scaled_width, scaled_height,
+            determined_width, determined_height,
+            determined_x_scale, determined_y_scale,
+            determined_x_scale / determined_y_scale, &quality, partial ? &area : NULL
+        );
+    }
+    return !ferror(out);
+}
+
+/*
+    Waits for a scanner to free up, and then sets it up with the options
+    for this request.
+*/
+static struct dimension_scanner* take_scanner(struct server* server, const struct scan_options* options)
+{
+    pthread_mutex_lock(&server->mutex);
+    while (server->num_idle_scanners == 0) {
+        pthread_cond_wait(&server->scanner_freed, &server->mutex);
+    }
+    struct dimension_scanner* scanner = server->idle_scanners[--server->num_idle_scanners];
+    pthread_mutex_unlock(&server->mutex);
+
+    set_scanner_settings(
+        scanner, options->inexact ? COMPARE_FUZZY : COMPARE_EXACT,
+        options->leeway, options->nearest_neighbor_max_variation
+    );
+    return scanner;
+}
+
+static void give_back_scanner(struct server* server, struct dimension_scanner* scanner)
+{
+    pthread_mutex_lock(&server->mutex);
+    server->idle_scanners[server->num_idle_scanners++] = scanner;
+    pthread_cond_signal(&server->scanner_freed);
+    pthread_mutex_unlock(&server->mutex);
+}
+
+// Reads one line, without its line break. Returns false at the end of the
+// connection, or if the line is too long.
+static bool read_request_line(FILE* in, char line[MAX_REQUEST_LINE_LENGTH])
+{
+    if (fgets(line, MAX_REQUEST_LINE_LENGTH, in) == NULL) {return false;}
+    size_t length = strlen(line);
+    if (length == 0 || line[length - 1] != '\n') {return false;}
+    line[length - 1] = 0;
+    return true;
+}
+
+static bool parse_request_number(const char* string, int* number)
+{
+    char* end;
+    long parsed = strtol(string, &end, 10);
+    if (end == string || *end != 0 || parsed < 0 || parsed > INT_MAX) {return false;}
+    *number = (int) parsed;
+    return true;
+}
+
+// Exits if there isn't enough memory.
+static unsigned char* read_whole_file(FILE* file, size_t* size)
+{
+    *size = 0;
+    size_t capacity = 1 << 20;
+    unsigned char* data = (unsigned char*) malloc(capacity * sizeof(unsigned char));
+    while (data != NULL) {
+        *size += fread(data + *size, 1, capacity - *size, file);
+        if (*size < capacity) {break;}
+        capacity *= 2;
+        unsigned char* grown = (unsigned char*) realloc(data, capacity * sizeof(unsigned char));
+        if (grown == NULL) {free(data);}
+        data = grown;
+    }
+    if (data == NULL) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        exit(-1);
+    }
+    return data;
+}
+
+// Returns -1 if the path is too long for a socket address.
+static int open_socket(const char* socket_path, struct sockaddr_un* address)
+{
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {return -1;}
+    strcpy(address->sun_path, socket_path);
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+#else
+
+void serve(const char* socket_path, const struct scan_options* defaults)
+{
+    fprintf(stderr, "ERROR: --serve isn't supported on Windows.\n");
+    exit(-1);
+}
+
+int connect_and_scan(const char* socket_path, const struct scan_options* options, size_t num_image_paths, char** image_paths)
+{
+    fprintf(stderr, "ERROR: --connect isn't supported on Windows.\n");
+    exit(-1);
+}
+
+#endif
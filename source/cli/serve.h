@@ -0,0 +1,35 @@
+/*
+    Running as a server on a Unix domain socket (--serve), so that screenshots
+    can be scanned one request at a time without paying for startup – and
+    ImageMagick's in particular – every time, as well as a client for it
+    (--connect).
+
+    Each connection carries any number of requests, one after another. A
+    request is a few lines of text:
+
+        inexact                             (optional)
+        leeway <0..255>                     (optional)
+        nearest-neighbor-variation <0...>   (optional)
+        path <path>
+
+    …where the last line can also be "blob <size>", followed by that many
+    bytes of image file. Options that aren't given fall back to what the
+    server was started with. Each request gets a line of JSON in reply, the
+    same as a line of --batch output (with a path of "-" for blobs).
+*/
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct scan_options {
+    bool inexact;
+    int leeway;
+    int nearest_neighbor_max_variation;
+};
+
+void serve(const char* socket_path, const struct scan_options* defaults);
+int connect_and_scan(const char* socket_path, const struct scan_options* options, size_t num_image_paths, char** image_paths);
+
+#endif
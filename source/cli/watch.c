@@ -0,0 +1,179 @@
+#include "cli/watch.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifndef WIN64
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifndef WIN64
+
+// Room for a good few events at once, each with a name of any length.
+#define EVENT_BUFFER_SIZE (16 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+struct directory_watch {
+    const char* directory;
+    int descriptor;
+    // Events are read in bulk, and handed out one at a time.
+    char events[EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    size_t events_size;
+    size_t next_event;
+};
+
+static char* join_path(const char* directory, const char* name);
+static int compare_paths(const void* path_1, const void* path_2);
+
+// Returns NULL if the directory can't be watched.
+struct directory_watch* start_watching_directory(const char* directory)
+{
+    struct directory_watch* watch = (struct directory_watch*) calloc(1, sizeof(struct directory_watch));
+    if (watch == NULL) {return NULL;}
+    watch->directory = directory;
+    watch->descriptor = inotify_init1(IN_CLOEXEC);
+    if (
+        watch->descriptor < 0 ||
+        inotify_add_watch(watch->descriptor, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0
+    ) {
+        if (watch->descriptor >= 0) {close(watch->descriptor);}
+        free(watch);
+        return NULL;
+    }
+    return watch;
+}
+
+/*
+    Waits for the next file to be added to the directory, and returns its
+    path, for the caller to free. Hidden files are passed over: that's how
+    many programs name files they're still writing, before renaming them
+    into place. Returns NULL if the directory can't be watched any longer
+    (it's been deleted, say) or there isn't enough memory.
+*/
+char* next_added_file(struct directory_watch* watch)
+{
+    while (true) {
+        if (watch->next_event >= watch->events_size) {
+            ssize_t size = read(watch->descriptor, watch->events, sizeof(watch->events));
+            if (size < 0 && errno == EINTR) {continue;}
+            if (size <= 0) {return NULL;}
+            watch->events_size = (size_t) size;
+            watch->next_event = 0;
+        }
+        const struct inotify_event* event = (const struct inotify_event*) (watch->events + watch->next_event);
+        watch->next_event += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_IGNORED) {return NULL;}
+        // Events that overflowed the queue are lost – there's no telling
+        // which files they were for.
+        if (event->len == 0 || event->name[0] == '.' || (event->mask & IN_ISDIR)) {continue;}
+        return join_path(watch->directory, event->name);
+    }
+}
+
+void stop_watching_directory(struct directory_watch* watch)
+{
+    if (watch == NULL) {return;}
+    close(watch->descriptor);
+    free(watch);
+}
+
+/*
+    The paths of the (non-hidden) files in the directory, sorted by name.
+    Returns NULL if it can't be read, or there isn't enough memory.
+*/
+char** list_directory_files(const char* directory, size_t* num_paths)
+{
+    DIR* listing = opendir(directory);
+    if (listing == NULL) {return NULL;}
+
+    char** paths = NULL;
+    size_t capacity = 0;
+    *num_paths = 0;
+    bool failed = false;
+    struct dirent* entry;
+    while (!failed && (entry = readdir(listing)) != NULL) {
+        if (entry->d_name[0] == '.') {continue;}
+        char* path = join_path(directory, entry->d_name);
+        struct stat status;
+        if (path != NULL && (stat(path, &status) != 0 || !S_ISREG(status.st_mode))) {
+            free(path);
+            continue;
+        }
+        if (path != NULL && *num_paths == capacity) {
+            capacity = capacity > 0 ? 2 * capacity : 64;
+            char** grown_paths = (char**) realloc(paths, capacity * sizeof(char*));
+            if (grown_paths == NULL) {
+                free(path);
+                path = NULL;
+            } else {
+                paths = grown_paths;
+            }
+        }
+        if (path == NULL) {
+            failed = true;
+        } else {
+            paths[(*num_paths)++] = path;
+        }
+    }
+    closedir(listing);
+
+    if (failed) {
+        free_paths(paths, *num_paths);
+        return NULL;
+    }
+    if (paths == NULL) {paths = (char**) malloc(sizeof(char*));}
+    qsort(paths, *num_paths, sizeof(char*), compare_paths);
+    return paths;
+}
+
+static char* join_path(const char* directory, const char* name)
+{
+    size_t directory_length = strlen(directory);
+    bool has_separator = directory_length > 0 && directory[directory_length - 1] == '/';
+    size_t size = directory_length + 1 + strlen(name) + 1;
+    char* path = (char*) malloc(size * sizeof(char));
+    if (path != NULL) {snprintf(path, size, has_separator ? "%s%s" : "%s/%s", directory, name);}
+    return path;
+}
+
+static int compare_paths(const void* path_1, const void* path_2)
+{
+    return strcmp(*(char* const*) path_1, *(char* const*) path_2);
+}
+
+#else
+
+struct directory_watch* start_watching_directory(const char* directory)
+{
+    fprintf(stderr, "ERROR: --watch isn't supported on Windows.\n");
+    exit(-1);
+}
+
+char* next_added_file(struct directory_watch* watch) {return NULL;}
+void stop_watching_directory(struct directory_watch* watch) {}
+char** list_directory_files(const char* directory, size_t* num_paths) {return NULL;}
+
+#endif
+
+// Whether both paths lead to the same file. False if either doesn't exist.
+bool same_file(const char* path_1, const char* path_2)
+{
+    struct stat status_1;
+    struct stat status_2;
+    return
+        stat(path_1, &status_1) == 0 && stat(path_2, &status_2) == 0 &&
+        status_1.st_dev == status_2.st_dev && status_1.st_ino == status_2.st_ino;
+}
+
+void free_paths(char** paths, size_t num_paths)
+{
+    if (paths == NULL) {return;}
+    for (size_t i = 0; i < num_paths; i++) {free(paths[i]);}
+    free(paths);
+}
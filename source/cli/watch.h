@@ -0,0 +1,22 @@
+/*
+    Watching a directory for screenshots as they're added to it (--watch),
+    using inotify. A file counts as added once whatever's writing it has
+    closed it, or once it's been moved into the directory – so screenshots
+    are never picked up half-written.
+*/
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct directory_watch;
+
+struct directory_watch* start_watching_directory(const char* directory);
+char* next_added_file(struct directory_watch* watch);
+void stop_watching_directory(struct directory_watch* watch);
+char** list_directory_files(const char* directory, size_t* num_paths);
+void free_paths(char** paths, size_t num_paths);
+bool same_file(const char* path_1, const char* path_2);
+
+#endif
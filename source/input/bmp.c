@@ -0,0 +1,170 @@
+#include "input/bmp.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "input/reader.h"
+
+// The file header, a BITMAPINFOHEADER, and the color masks that follow it
+// when there are any. Newer headers are longer, but start out the same,
+// with the masks in the same place.
+#define BMP_HEADER_SIZE 66
+#define BMP_INFO_HEADER_SIZE 40
+
+#define BMP_RGB 0
+#define BMP_BITFIELDS 3
+#define BMP_ALPHA_BITFIELDS 6
+
+struct bmp_state {
+    FILE* file;
+    size_t pixels_offset;
+    // Rows are padded to a multiple of 4 bytes, and usually stored bottom
+    // to top.
+    size_t row_stride;
+    size_t bytes_per_pixel;
+    bool bottom_up;
+    // If every row is in the reader's file_data, where the first one
+    // starts. Otherwise, rows are read into row.
+    const unsigned char* pixels;
+    unsigned char* row;
+    bool frame_started;
+};
+
+static bool next_bmp_frame(struct image_reader* reader);
+static int read_bmp_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels);
+static void close_bmp_image(struct image_reader* reader);
+static const unsigned char* find_bmp_row(struct image_reader* reader, struct bmp_state* state, size_t y);
+static inline uint32_t read_le32(const unsigned char* bytes);
+static inline uint16_t read_le16(const unsigned char* bytes);
+
+bool is_bmp_signature(const unsigned char signature[2])
+{
+    return signature[0] == 'B' && signature[1] == 'M';
+}
+
+int open_bmp_image(FILE* file, struct image_reader* reader)
+{
+    unsigned char header[BMP_HEADER_SIZE] = {0};
+    size_t header_size = fread(header, 1, sizeof(header), file);
+    if (header_size < 14 + BMP_INFO_HEADER_SIZE || read_le32(header + 14) < BMP_INFO_HEADER_SIZE) {
+        return READER_NOT_THIS_FORMAT;
+    }
+
+    size_t pixels_offset = read_le32(header + 10);
+    int32_t width = (int32_t) read_le32(header + 18);
+    int32_t height = (int32_t) read_le32(header + 22);
+    uint16_t bits_per_pixel = read_le16(header + 28);
+    uint32_t compression = read_le32(header + 30);
+    bool bgr = (bits_per_pixel == 24 || bits_per_pixel == 32) && compression == BMP_RGB;
+    // Bit fields that put each channel in a byte of its own, the same as
+    // without them, are common enough from screenshot tools.
+    bool bgr_bit_fields =
+        bits_per_pixel == 32 && (compression == BMP_BITFIELDS || compression == BMP_ALPHA_BITFIELDS) &&
+        header_size == BMP_HEADER_SIZE &&
+        read_le32(header + 54) == 0x00FF0000 && read_le32(header + 58) == 0x0000FF00 && read_le32(header + 62) == 0x000000FF;
+    if (!(bgr || bgr_bit_fields) || width <= 0 || height == 0 || height == INT32_MIN) {
+        return READER_NOT_THIS_FORMAT;
+    }
+
+    struct bmp_state* state = (struct bmp_state*) calloc(1, sizeof(struct bmp_state));
+    if (state == NULL) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+        return READER_FAILED;
+    }
+    state->file = file;
+    state->pixels_offset = pixels_offset;
+    state->bytes_per_pixel = bits_per_pixel / 8;
+    state->row_stride = ((size_t) width * bits_per_pixel + 31) / 32 * 4;
+    state->bottom_up = height > 0;
+    reader->width = (size_t) width;
+    reader->height = height > 0 ? (size_t) height : (size_t) -(int64_t) height;
+
+    if (
+        reader->file_data != NULL && pixels_offset <= reader->file_size &&
+        reader->height <= (reader->file_size - pixels_offset) / state->row_stride
+    ) {
+        state->pixels = reader->file_data + pixels_offset;
+    } else {
+        state->row = (unsigned char*) malloc(state->row_stride);
+        if (state->row == NULL) {
+            free(state);
+            snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+            return READER_FAILED;
+        }
+    }
+
+    reader->next_frame = next_bmp_frame;
+    reader->read_rows = read_bmp_rows;
+    reader->close = close_bmp_image;
+    reader->state = state;
+    return READER_OK;
+}
+
+// BMPs only ever have the one frame.
+static bool next_bmp_frame(struct image_reader* reader)
+{
+    struct bmp_state* state = (struct bmp_state*) reader->state;
+    if (state->frame_started) {return false;}
+    state->frame_started = true;
+    return true;
+}
+
+static int read_bmp_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels)
+{
+    struct bmp_state* state = (struct bmp_state*) reader->state;
+    size_t width = reader->width;
+    size_t bytes_per_pixel = state->bytes_per_pixel;
+    for (size_t y = 0; y < num_rows; y++) {
+        const unsigned char* row = find_bmp_row(reader, state, first_row + y);
+        if (row == NULL) {
+            snprintf(reader->error_description, READER_ERROR_SIZE, "BMP image ends unexpectedly.");
+            return 1;
+        }
+        // Stored as BGR, with a byte to spare at 32 bits.
+        unsigned char* out = pixels + 3 * width * y;
+        for (size_t x = 0; x < width; x++) {
+            out[0] = row[2];
+            out[1] = row[1];
+            out[2] = row[0];
+            row += bytes_per_pixel;
+            out += 3;
+        }
+    }
+    return 0;
+}
+
+static void close_bmp_image(struct image_reader* reader)
+{
+    struct bmp_state* state = (struct bmp_state*) reader->state;
+    fclose(state->file);
+    free(state->row);
+    free(state);
+}
+
+// Returns NULL if the file ends first.
+static const unsigned char* find_bmp_row(struct image_reader* reader, struct bmp_state* state, size_t y)
+{
+    size_t stored_row = state->bottom_up ? reader->height - 1 - y : y;
+    if (state->pixels != NULL) {return state->pixels + state->row_stride * stored_row;}
+
+    size_t width_size = reader->width * state->bytes_per_pixel;
+    if (
+        fseek(state->file, (long) (state->pixels_offset + state->row_stride * stored_row), SEEK_SET) != 0 ||
+        fread(state->row, width_size, 1, state->file) != 1
+    ) {
+        return NULL;
+    }
+    return state->row;
+}
+
+static inline uint32_t read_le32(const unsigned char* bytes)
+{
+    return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+static inline uint16_t read_le16(const unsigned char* bytes)
+{
+    return (uint16_t) (bytes[0] | (bytes[1] << 8));
+}
@@ -0,0 +1,16 @@
+/*
+    Native decoding of uncompressed 24- and 32-bit BMPs, which is what
+    screenshots saved as BMP nearly always are. Anything else – palettes,
+    RLE, 16-bit – is left to ImageMagick.
+*/
+#ifndef BMP_H
+#define BMP_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "input/reader.h"
+
+bool is_bmp_signature(const unsigned char signature[2]);
+int open_bmp_image(FILE* file, struct image_reader* reader);
+
+#endif
@@ -0,0 +1,289 @@
+#include "input/magick.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <pthread.h>
+#ifdef IMAGEMAGICK_7
+#include <MagickWand/MagickWand.h>
+#endif
+#ifdef IMAGEMAGICK_6
+#include <wand/MagickWand.h>
+#endif
+#include "input/reader.h"
+
+// How many frames are decoded at a time, reading from a file. ImageMagick
+// has to go through every frame before the first one it's asked for, so
+// reading them one by one would take as long as the square of the number of
+// frames; this divides that by so much, keeping only a few in memory.
+#define FRAMES_PER_READ 16
+// How much longer than the path reading a few frames' can be: room for
+// "[<frame index>,<frame index>,...]".
+#define FRAME_SUFFIX_SIZE (FRAMES_PER_READ * 24)
+
+struct magick_state {
+    // The frames decoded last – or, when reading from memory, every frame.
+    MagickWand* wand;
+    // Reading from a file, frames are only decoded once their rows are read,
+    // FRAMES_PER_READ at a time, so that a long animation never has to be in
+    // memory all at once. Until then, all that's known of them is what pinging the
+    // file tells – their sizes. NULL when the wand holds every frame.
+    MagickWand* pinged;
+    char* path;
+    size_t path_length;
+    // If the file's in memory, frames are read from there rather than from
+    // the path – which still says which frame to read, and hints at the
+    // format.
+    const unsigned char* blob;
+    size_t blob_size;
+    // The index of the current frame, and whether the wand's on it yet.
+    ssize_t frame;
+    bool frame_decoded;
+    // Which frames the wand holds: so many, frame_stride apart.
+    ssize_t first_decoded_frame;
+    size_t num_decoded_frames;
+};
+
+static bool next_magick_frame(struct image_reader* reader);
+static int read_magick_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels);
+static int decode_magick_frame(struct image_reader* reader, struct magick_state* state);
+static void close_magick_image(struct image_reader* reader);
+static struct magick_state* create_magick_state(struct image_reader* reader);
+static void destroy_magick_state(struct magick_state* state);
+static void start_magick(void);
+static void describe_wand_exception(struct image_reader* reader, MagickWand* wand);
+
+// Starting ImageMagick up takes a good while, so it's only done once the
+// first image that needs it shows up – which may be never.
+static pthread_once_t magick_started = PTHREAD_ONCE_INIT;
+static bool magick_running = false;
+
+int open_magick_image(const char* path, struct image_reader* reader)
+{
+    pthread_once(&magick_started, start_magick);
+
+    struct magick_state* state = create_magick_state(reader);
+    if (state == NULL) {return READER_FAILED;}
+    // A path that picks its own frames (e.g. "animation.gif[3]") is left
+    // for ImageMagick to read as it is.
+    size_t path_length = strlen(path);
+    bool picks_frames = path_length > 0 && path[path_length - 1] == ']';
+    if (picks_frames) {
+        if (MagickReadImage(state->wand, path) == MagickFalse) {
+            describe_wand_exception(reader, state->wand);
+            destroy_magick_state(state);
+            return READER_FAILED;
+        }
+        MagickResetIterator(state->wand);
+    } else {
+        state->pinged = NewMagickWand();
+        state->path = (char*) malloc(path_length + FRAME_SUFFIX_SIZE);
+        if (state->path == NULL) {
+            snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+            destroy_magick_state(state);
+            return READER_FAILED;
+        }
+        memcpy(state->path, path, path_length + 1);
+        state->path_length = path_length;
+        // Formats that can't be read from memory (ImageMagick would write
+        // them out to a temporary file first) are read from the path after
+        // all.
+        if (reader->file_data != NULL) {
+            MagickSetFilename(state->pinged, path);
+            if (MagickPingImageBlob(state->pinged, reader->file_data, reader->file_size) != MagickFalse) {
+                state->blob = reader->file_data;
+                state->blob_size = reader->file_size;
+            } else {
+                ClearMagickWand(state->pinged);
+            }
+        }
+        if (state->blob == NULL && MagickPingImage(state->pinged, path) == MagickFalse) {
+            describe_wand_exception(reader, state->pinged);
+            destroy_magick_state(state);
+            return READER_FAILED;
+        }
+        MagickResetIterator(state->pinged);
+    }
+
+    reader->next_frame = next_magick_frame;
+    reader->read_rows = read_magick_rows;
+    reader->close = close_magick_image;
+    reader->state = state;
+    return READER_OK;
+}
+
+int open_magick_image_blob(const void* data, size_t size, struct image_reader* reader)
+{
+    pthread_once(&magick_started, start_magick);
+
+    struct magick_state* state = create_magick_state(reader);
+    if (state == NULL) {return READER_FAILED;}
+    if (MagickReadImageBlob(state->wand, data, size) == MagickFalse) {
+        describe_wand_exception(reader, state->wand);
+        destroy_magick_state(state);
+        return READER_FAILED;
+    }
+    MagickResetIterator(state->wand);
+
+    reader->next_frame = next_magick_frame;
+    reader->read_rows = read_magick_rows;
+    reader->close = close_magick_image;
+    reader->state = state;
+    return READER_OK;
+}
+
+// Returns nonzero and fills in error_description if the image can't be written.
+int write_magick_image(const char* path, const unsigned char* pixels, size_t width, size_t height, char error_description[READER_ERROR_SIZE])
+{
+    pthread_once(&magick_started, start_magick);
+
+    MagickWand* wand = NewMagickWand();
+    int result = 0;
+    if (
+        MagickConstituteImage(wand, width, height, "RGB", CharPixel, pixels) == MagickFalse ||
+        MagickWriteImage(wand, path) == MagickFalse
+    ) {
+        ExceptionType severity;
+        char* description = MagickGetException(wand, &severity);
+        snprintf(error_description, READER_ERROR_SIZE, "%s", description);
+        MagickRelinquishMemory(description);
+        result = 1;
+    }
+    DestroyMagickWand(wand);
+    return result;
+}
+
+// Only to be called once no other threads are using ImageMagick, and none
+// ever will again: after MagickWandTerminus, it can't be started back up.
+void finish_magick(void)
+{
+    if (magick_running) {
+        MagickWandTerminus();
+        magick_running = false;
+    }
+}
+
+static bool next_magick_frame(struct image_reader* reader)
+{
+    struct magick_state* state = (struct magick_state*) reader->state;
+    if (state->pinged == NULL) {
+        if (MagickNextImage(state->wand) == MagickFalse) {return false;}
+        reader->width = MagickGetImageWidth(state->wand);
+        reader->height = MagickGetImageHeight(state->wand);
+        return true;
+    }
+
+    if (MagickNextImage(state->pinged) == MagickFalse) {return false;}
+    state->frame++;
+    state->frame_decoded = false;
+    reader->width = MagickGetImageWidth(state->pinged);
+    reader->height = MagickGetImageHeight(state->pinged);
+    return true;
+}
+
+static int read_magick_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels)
+{
+    struct magick_state* state = (struct magick_state*) reader->state;
+    if (state->pinged != NULL && !state->frame_decoded && decode_magick_frame(reader, state)) {return 1;}
+    if (MagickExportImagePixels(state->wand, 0, first_row, reader->width, num_rows, "RGB", CharPixel, pixels) == MagickFalse) {
+        describe_wand_exception(reader, state->wand);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+    Moves the wand on to the current frame – reading it from the file, along
+    with the next few that are going to be scanned, unless it was read along
+    with the ones before.
+*/
+static int decode_magick_frame(struct image_reader* reader, struct magick_state* state)
+{
+    ssize_t offset = state->frame - state->first_decoded_frame;
+    bool already_decoded =
+        offset >= 0 && (size_t) offset % frame_stride == 0 &&
+        (size_t) offset / frame_stride < state->num_decoded_frames;
+    if (!already_decoded) {
+        ClearMagickWand(state->wand);
+        state->num_decoded_frames = 0;
+        size_t num_frames = FRAMES_PER_READ;
+        size_t frames_left = max_frames - reader->num_frames + 1;
+        if (max_frames > 0 && frames_left < num_frames) {num_frames = frames_left;}
+        // The frames are listed one by one (e.g. "[30,35,40]"), so that the
+        // ones frame_stride skips over aren't decoded.
+        char* suffix = state->path + state->path_length;
+        size_t length = 0;
+        for (size_t i = 0; i < num_frames; i++) {
+            ssize_t frame = state->frame + (ssize_t) (i * frame_stride);
+            length += snprintf(suffix + length, FRAME_SUFFIX_SIZE - length, "%c%zd", i == 0 ? '[' : ',', frame);
+        }
+        snprintf(suffix + length, FRAME_SUFFIX_SIZE - length, "]");
+        bool decoded;
+        if (state->blob != NULL) {
+            MagickSetFilename(state->wand, state->path);
+            decoded = MagickReadImageBlob(state->wand, state->blob, state->blob_size) != MagickFalse;
+        } else {
+            decoded = MagickReadImage(state->wand, state->path) != MagickFalse;
+        }
+        state->path[state->path_length] = 0;
+        if (!decoded) {
+            describe_wand_exception(reader, state->wand);
+            return 1;
+        }
+        state->first_decoded_frame = state->frame;
+        state->num_decoded_frames = MagickGetNumberImages(state->wand);
+        offset = 0;
+    }
+    if (MagickSetIteratorIndex(state->wand, offset / (ssize_t) frame_stride) == MagickFalse) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Frame %zd couldn't be decoded.", state->frame);
+        return 1;
+    }
+    if (MagickGetImageWidth(state->wand) != reader->width || MagickGetImageHeight(state->wand) != reader->height) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Frame %zd changed size after being pinged.", state->frame);
+        return 1;
+    }
+    state->frame_decoded = true;
+    return 0;
+}
+
+static void close_magick_image(struct image_reader* reader)
+{
+    destroy_magick_state((struct magick_state*) reader->state);
+}
+
+static struct magick_state* create_magick_state(struct image_reader* reader)
+{
+    struct magick_state* state = (struct magick_state*) calloc(1, sizeof(struct magick_state));
+    if (state == NULL) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+        return NULL;
+    }
+    state->wand = NewMagickWand();
+    state->frame = -1;
+    return state;
+}
+
+static void destroy_magick_state(struct magick_state* state)
+{
+    DestroyMagickWand(state->wand);
+    if (state->pinged != NULL) {DestroyMagickWand(state->pinged);}
+    free(state->path);
+    free(state);
+}
+
+static void start_magick(void)
+{
+    MagickWandGenesis();
+    magick_running = true;
+}
+
+static void describe_wand_exception(struct image_reader* reader, MagickWand* wand)
+{
+    ExceptionType severity;
+    char* description = MagickGetException(wand, &severity);
+    snprintf(reader->error_description, READER_ERROR_SIZE, "%s", description);
+    MagickRelinquishMemory(description);
+}
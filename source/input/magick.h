@@ -0,0 +1,16 @@
+/*
+    The fallback reader (and writer) for every format that isn't handled
+    natively.
+*/
+#ifndef MAGICK_H
+#define MAGICK_H
+
+#include <stddef.h>
+#include "input/reader.h"
+
+int open_magick_image(const char* path, struct image_reader* reader);
+int open_magick_image_blob(const void* data, size_t size, struct image_reader* reader);
+int write_magick_image(const char* path, const unsigned char* pixels, size_t width, size_t height, char error_description[READER_ERROR_SIZE]);
+void finish_magick(void);
+
+#endif
@@ -0,0 +1,70 @@
+#include "input/mapping.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#ifndef WIN64
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+    Maps the whole file at path for reading, asking for it to be read in
+    ahead of being touched. Returns false (leaving the mapping empty) if it
+    isn't a regular file, is empty, or can't be mapped – in which case it
+    should just be read instead.
+*/
+bool map_file(const char* path, struct file_mapping* mapping)
+{
+    mapping->data = NULL;
+    mapping->size = 0;
+#ifdef WIN64
+    return false;
+#else
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor == -1) {return false;}
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode) || status.st_size <= 0) {
+        close(descriptor);
+        return false;
+    }
+    void* data = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // The mapping stays valid after the descriptor's closed.
+    close(descriptor);
+    if (data == MAP_FAILED) {return false;}
+
+    // Decoders mostly go straight through the file, but the scan splits an
+    // uncompressed image into bands that are all gone through at once – so
+    // rather than sequential access, the whole file's asked for up front.
+    madvise(data, (size_t) status.st_size, MADV_WILLNEED);
+    mapping->data = (const unsigned char*) data;
+    mapping->size = (size_t) status.st_size;
+    return true;
+#endif
+}
+
+void unmap_file(struct file_mapping* mapping)
+{
+#ifndef WIN64
+    if (mapping->data != NULL) {munmap((void*) mapping->data, mapping->size);}
+#endif
+    mapping->data = NULL;
+    mapping->size = 0;
+}
+
+/*
+    Lets the system know that the file at path is about to be read, so that
+    it can start fetching it in the background – e.g. the next screenshot
+    while the current one's being scanned. Whether or not it does, nothing
+    changes but how long reading the file takes.
+*/
+void prefetch_file(const char* path)
+{
+#if !defined(WIN64) && defined(POSIX_FADV_WILLNEED)
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor == -1) {return;}
+    posix_fadvise(descriptor, 0, 0, POSIX_FADV_WILLNEED);
+    close(descriptor);
+#endif
+}
@@ -0,0 +1,24 @@
+/*
+    Mapping image files into memory, so that decoders can read them as
+    blobs – and uncompressed ones can be scanned right where they lie –
+    rather than going through a read call (and, on network filesystems, a
+    round trip) every few kilobytes. Only on systems with mmap; elsewhere,
+    nothing's ever mapped and files are read as usual.
+*/
+#ifndef MAPPING_H
+#define MAPPING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct file_mapping {
+    // NULL when nothing's mapped.
+    const unsigned char* data;
+    size_t size;
+};
+
+bool map_file(const char* path, struct file_mapping* mapping);
+void unmap_file(struct file_mapping* mapping);
+void prefetch_file(const char* path);
+
+#endif
@@ -0,0 +1,200 @@
+#include "input/png.h"
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#include "input/reader.h"
+
+struct png_state {
+    FILE* file;
+    png_structp png;
+    png_infop info;
+    bool frame_started;
+    // For images with a palette, which are read as indices and looked up
+    // here rather than by libpng, so that they can be handed over as
+    // indices too: each index's color (black past the end of the palette,
+    // as with libpng), the first index with the same color, and a row of
+    // indices to look up.
+    unsigned char colors[256][3];
+    unsigned char first_indices[256];
+    bool has_duplicate_colors;
+    unsigned char* index_row;
+};
+
+static bool next_png_frame(struct image_reader* reader);
+static int read_png_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels);
+static void close_png_image(struct image_reader* reader);
+static void index_png_palette(struct png_state* state);
+static void handle_png_error(png_structp png, png_const_charp message);
+static void handle_png_warning(png_structp png, png_const_charp message);
+
+bool is_png_signature(const unsigned char signature[8])
+{
+    return png_sig_cmp(signature, 0, 8) == 0;
+}
+
+/*
+    Sets libpng up to hand over every row as 8-bit RGB, the same way
+    ImageMagick exports pixels: palettes and grayscale are expanded, 16-bit
+    channels are scaled down, and alpha is dropped without compositing.
+    Images with a palette can be read as its indices instead.
+
+    Interlaced images can't be read a row at a time, so those are left to
+    ImageMagick.
+*/
+int open_png_image(FILE* file, struct image_reader* reader)
+{
+    struct png_state* state = (struct png_state*) calloc(1, sizeof(struct png_state));
+    if (state == NULL) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+        return READER_FAILED;
+    }
+    state->file = file;
+    state->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, reader, handle_png_error, handle_png_warning);
+    if (state->png != NULL) {state->info = png_create_info_struct(state->png);}
+    if (state->png == NULL || state->info == NULL) {
+        png_destroy_read_struct(&state->png, &state->info, NULL);
+        free(state);
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+        return READER_FAILED;
+    }
+
+    if (setjmp(png_jmpbuf(state->png))) {
+        png_destroy_read_struct(&state->png, &state->info, NULL);
+        free(state);
+        return READER_FAILED;
+    }
+
+    png_init_io(state->png, file);
+    png_read_info(state->png, state->info);
+    if (png_get_interlace_type(state->png, state->info) != PNG_INTERLACE_NONE) {
+        png_destroy_read_struct(&state->png, &state->info, NULL);
+        free(state);
+        return READER_NOT_THIS_FORMAT;
+    }
+
+    png_byte color_type = png_get_color_type(state->png, state->info);
+    reader->has_palette = color_type == PNG_COLOR_TYPE_PALETTE;
+    // Both of these expand palettes along with everything else.
+    if (!reader->has_palette) {
+        png_set_palette_to_rgb(state->png);
+        png_set_expand_gray_1_2_4_to_8(state->png);
+    }
+    png_set_packing(state->png);
+#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
+    png_set_scale_16(state->png);
+#else
+    png_set_strip_16(state->png);
+#endif
+    png_set_strip_alpha(state->png);
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        png_set_gray_to_rgb(state->png);
+    }
+    png_read_update_info(state->png, state->info);
+
+    reader->width = png_get_image_width(state->png, state->info);
+    reader->height = png_get_image_height(state->png, state->info);
+    size_t pixel_size = reader->has_palette ? 1 : 3;
+    if (reader->has_palette) {
+        index_png_palette(state);
+        state->index_row = (unsigned char*) malloc(reader->width * sizeof(unsigned char));
+        if (state->index_row == NULL) {
+            png_destroy_read_struct(&state->png, &state->info, NULL);
+            free(state);
+            snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+            return READER_FAILED;
+        }
+    }
+    if (png_get_rowbytes(state->png, state->info) != pixel_size * reader->width) {
+        png_destroy_read_struct(&state->png, &state->info, NULL);
+        free(state->index_row);
+        free(state);
+        return READER_NOT_THIS_FORMAT;
+    }
+
+    reader->next_frame = next_png_frame;
+    reader->read_rows = read_png_rows;
+    reader->close = close_png_image;
+    reader->state = state;
+    return READER_OK;
+}
+
+// PNGs only ever have the one frame.
+static bool next_png_frame(struct image_reader* reader)
+{
+    struct png_state* state = (struct png_state*) reader->state;
+    if (state->frame_started) {return false;}
+    state->frame_started = true;
+    return true;
+}
+
+static int read_png_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels)
+{
+    struct png_state* state = (struct png_state*) reader->state;
+    if (setjmp(png_jmpbuf(state->png))) {return 1;}
+    size_t row_size = reader->pixel_size * reader->width;
+    for (size_t i = 0; i < num_rows; i++) {
+        unsigned char* row = pixels + row_size * i;
+        if (!reader->has_palette) {
+            png_read_row(state->png, row, NULL);
+        } else if (reader->pixel_size == 1) {
+            png_read_row(state->png, row, NULL);
+            if (state->has_duplicate_colors) {
+                for (size_t x = 0; x < reader->width; x++) {row[x] = state->first_indices[row[x]];}
+            }
+        } else {
+            png_read_row(state->png, state->index_row, NULL);
+            for (size_t x = 0; x < reader->width; x++) {memcpy(row + 3 * x, state->colors[state->index_row[x]], 3);}
+        }
+    }
+    return 0;
+}
+
+static void close_png_image(struct image_reader* reader)
+{
+    struct png_state* state = (struct png_state*) reader->state;
+    png_destroy_read_struct(&state->png, &state->info, NULL);
+    fclose(state->file);
+    free(state->index_row);
+    free(state);
+}
+
+static void index_png_palette(struct png_state* state)
+{
+    png_colorp palette = NULL;
+    int num_colors = 0;
+    png_get_PLTE(state->png, state->info, &palette, &num_colors);
+    memset(state->colors, 0, sizeof(state->colors));
+    for (int i = 0; i < num_colors && i < 256; i++) {
+        state->colors[i][0] = palette[i].red;
+        state->colors[i][1] = palette[i].green;
+        state->colors[i][2] = palette[i].blue;
+    }
+    state->has_duplicate_colors = false;
+    for (int i = 0; i < 256; i++) {
+        int first_index = 0;
+        while (memcmp(state->colors[first_index], state->colors[i], 3) != 0) {first_index++;}
+        state->first_indices[i] = (unsigned char) first_index;
+        // Indices past the end of the palette (which only a broken image
+        // would have) all come out black too, so short of a full palette,
+        // there are always duplicates.
+        state->has_duplicate_colors = state->has_duplicate_colors || first_index != i;
+    }
+}
+
+static void handle_png_error(png_structp png, png_const_charp message)
+{
+    struct image_reader* reader = (struct image_reader*) png_get_error_ptr(png);
+    snprintf(reader->error_description, READER_ERROR_SIZE, "PNG error: %s", message);
+    png_longjmp(png, 1);
+}
+
+static void handle_png_warning(png_structp png, png_const_charp message)
+{
+    // Warnings are about things like unknown chunks or bad gamma values –
+    // none of which matter for the pixels themselves.
+}
@@ -0,0 +1,14 @@
+/*
+    Native PNG decoding through libpng, a row at a time.
+*/
+#ifndef INPUT_PNG_H
+#define INPUT_PNG_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "input/reader.h"
+
+bool is_png_signature(const unsigned char signature[8]);
+int open_png_image(FILE* file, struct image_reader* reader);
+
+#endif
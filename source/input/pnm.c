@@ -0,0 +1,276 @@
+#include "input/pnm.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "input/reader.h"
+
+struct pnm_state {
+    FILE* file;
+    // Of the current frame.
+    size_t channels;
+    unsigned long max_value;
+    size_t bytes_per_sample;
+    size_t rows_read;
+    // Whether the first frame's header (read when opening) is still
+    // waiting to be moved on to.
+    bool header_pending;
+    // Enough for one row of the file, if it can't be read straight into
+    // the caller's buffer.
+    unsigned char* row;
+    size_t row_capacity;
+};
+
+static bool next_pnm_frame(struct image_reader* reader);
+static int read_pnm_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels);
+static void close_pnm_image(struct image_reader* reader);
+static int read_pnm_header(struct image_reader* reader, struct pnm_state* state);
+static int read_pam_header(struct image_reader* reader, struct pnm_state* state);
+static bool read_pnm_number(FILE* file, unsigned long* number);
+static int skip_pnm_whitespace(FILE* file);
+static inline unsigned char scale_pnm_sample(const unsigned char* sample, const struct pnm_state* state);
+
+bool is_pnm_signature(const unsigned char signature[2])
+{
+    return signature[0] == 'P' && (signature[1] == '5' || signature[1] == '6' || signature[1] == '7');
+}
+
+int open_pnm_image(FILE* file, struct image_reader* reader)
+{
+    struct pnm_state* state = (struct pnm_state*) calloc(1, sizeof(struct pnm_state));
+    if (state == NULL) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+        return READER_FAILED;
+    }
+    state->file = file;
+    if (read_pnm_header(reader, state)) {
+        free(state->row);
+        free(state);
+        return READER_FAILED;
+    }
+    state->header_pending = true;
+
+    reader->next_frame = next_pnm_frame;
+    reader->read_rows = read_pnm_rows;
+    reader->close = close_pnm_image;
+    reader->state = state;
+    return READER_OK;
+}
+
+static bool next_pnm_frame(struct image_reader* reader)
+{
+    struct pnm_state* state = (struct pnm_state*) reader->state;
+    if (state->header_pending) {
+        state->header_pending = false;
+        return true;
+    }
+
+    // Skip past whatever's left of the current frame – by seeking if
+    // possible, or by reading through it if it's a pipe.
+    size_t row_size = reader->width * state->channels * state->bytes_per_sample;
+    size_t rows_left = reader->height - state->rows_read;
+    if (rows_left > 0 && fseek(state->file, (long) (row_size * rows_left), SEEK_CUR) != 0) {
+        for (; rows_left > 0; rows_left--) {
+            if (fread(state->row, row_size, 1, state->file) != 1) {return false;}
+        }
+    }
+    state->rows_read = reader->height;
+
+    if (skip_pnm_whitespace(state->file) == EOF) {return false;}
+    return read_pnm_header(reader, state) == 0;
+}
+
+static int read_pnm_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels)
+{
+    struct pnm_state* state = (struct pnm_state*) reader->state;
+    size_t width = reader->width;
+    size_t row_size = width * state->channels * state->bytes_per_sample;
+
+    // The common case: already exactly what's wanted.
+    if (state->channels == 3 && state->max_value == 255) {
+        if (fread(pixels, row_size, num_rows, state->file) != num_rows) {
+            snprintf(reader->error_description, READER_ERROR_SIZE, "Netpbm image ends unexpectedly.");
+            return 1;
+        }
+        state->rows_read += num_rows;
+        return 0;
+    }
+
+    for (size_t y = 0; y < num_rows; y++) {
+        if (fread(state->row, row_size, 1, state->file) != 1) {
+            snprintf(reader->error_description, READER_ERROR_SIZE, "Netpbm image ends unexpectedly.");
+            return 1;
+        }
+        unsigned char* out = pixels + 3 * width * y;
+        for (size_t x = 0; x < width; x++) {
+            const unsigned char* pixel = state->row + x * state->channels * state->bytes_per_sample;
+            if (state->channels < 3) {
+                // Grayscale, possibly with alpha.
+                out[0] = out[1] = out[2] = scale_pnm_sample(pixel, state);
+            } else {
+                out[0] = scale_pnm_sample(pixel, state);
+                out[1] = scale_pnm_sample(pixel + state->bytes_per_sample, state);
+                out[2] = scale_pnm_sample(pixel + 2 * state->bytes_per_sample, state);
+            }
+            out += 3;
+        }
+        state->rows_read++;
+    }
+    return 0;
+}
+
+static void close_pnm_image(struct image_reader* reader)
+{
+    struct pnm_state* state = (struct pnm_state*) reader->state;
+    fclose(state->file);
+    free(state->row);
+    free(state);
+}
+
+/*
+    Reads the header of the next frame, which the file should be positioned
+    at the start of, and fills in the frame's dimensions and layout.
+    Returns nonzero if it isn't a valid header.
+*/
+static int read_pnm_header(struct image_reader* reader, struct pnm_state* state)
+{
+    char magic[2];
+    if (fread(magic, 1, 2, state->file) != 2 || magic[0] != 'P') {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Not a Netpbm image.");
+        return 1;
+    }
+
+    unsigned long width = 0;
+    unsigned long height = 0;
+    if (magic[1] == '5' || magic[1] == '6') {
+        state->channels = magic[1] == '5' ? 1 : 3;
+        if (
+            !read_pnm_number(state->file, &width) || !read_pnm_number(state->file, &height) ||
+            !read_pnm_number(state->file, &state->max_value)
+        ) {
+            snprintf(reader->error_description, READER_ERROR_SIZE, "Invalid Netpbm header.");
+            return 1;
+        }
+        // Exactly one whitespace character separates the header from the
+        // pixels.
+        fgetc(state->file);
+    } else if (magic[1] == '7') {
+        if (read_pam_header(reader, state)) {return 1;}
+        width = (unsigned long) reader->width;
+        height = (unsigned long) reader->height;
+    } else {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Unsupported Netpbm format: P%c.", magic[1]);
+        return 1;
+    }
+
+    if (width == 0 || height == 0 || state->max_value == 0 || state->max_value > 65535) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Invalid Netpbm header.");
+        return 1;
+    }
+    reader->width = width;
+    reader->height = height;
+    state->bytes_per_sample = state->max_value < 256 ? 1 : 2;
+    state->rows_read = 0;
+
+    size_t row_size = reader->width * state->channels * state->bytes_per_sample;
+    // 8-bit RGB is stored exactly as it's read, so if the file's in memory,
+    // the frame can be scanned right where it is – so long as all of it's
+    // there.
+    reader->frame_pixels = NULL;
+    if (reader->file_data != NULL && state->channels == 3 && state->max_value == 255) {
+        long offset = ftell(state->file);
+        if (
+            offset >= 0 && (size_t) offset <= reader->file_size &&
+            reader->height <= (reader->file_size - (size_t) offset) / row_size
+        ) {
+            reader->frame_pixels = reader->file_data + offset;
+        }
+    }
+
+    if (row_size > state->row_capacity) {
+        unsigned char* row = (unsigned char*) realloc(state->row, row_size);
+        if (row == NULL) {
+            snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+            return 1;
+        }
+        state->row = row;
+        state->row_capacity = row_size;
+    }
+    return 0;
+}
+
+/*
+    PAM headers are a series of "KEY value" lines ending in "ENDHDR".
+    Of the tuple types, only the grayscale and RGB ones (with or without
+    alpha) make sense here, and those are told apart by their depth anyway.
+*/
+static int read_pam_header(struct image_reader* reader, struct pnm_state* state)
+{
+    unsigned long width = 0;
+    unsigned long height = 0;
+    unsigned long depth = 0;
+    state->max_value = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), state->file) != NULL) {
+        char key[16] = {0};
+        unsigned long value;
+        if (line[0] == '#' || sscanf(line, "%15s", key) != 1) {continue;}
+        if (strcmp(key, "ENDHDR") == 0) {
+            if (depth < 1 || depth > 4) {
+                snprintf(reader->error_description, READER_ERROR_SIZE, "Unsupported PAM depth: %lu.", depth);
+                return 1;
+            }
+            reader->width = width;
+            reader->height = height;
+            state->channels = depth;
+            return 0;
+        }
+        if (sscanf(line, "%*s %lu", &value) != 1) {continue;}
+        if (strcmp(key, "WIDTH") == 0) {width = value;}
+        else if (strcmp(key, "HEIGHT") == 0) {height = value;}
+        else if (strcmp(key, "DEPTH") == 0) {depth = value;}
+        else if (strcmp(key, "MAXVAL") == 0) {state->max_value = value;}
+    }
+    snprintf(reader->error_description, READER_ERROR_SIZE, "Invalid PAM header.");
+    return 1;
+}
+
+static bool read_pnm_number(FILE* file, unsigned long* number)
+{
+    if (!isdigit(skip_pnm_whitespace(file))) {return false;}
+    int c = fgetc(file);
+    *number = 0;
+    while (isdigit(c)) {
+        *number = *number * 10 + (c - '0');
+        c = fgetc(file);
+    }
+    ungetc(c, file);
+    return true;
+}
+
+// Skips whitespace and comments, returning the next character (which is
+// left in place) or EOF.
+static int skip_pnm_whitespace(FILE* file)
+{
+    int c = fgetc(file);
+    while (c != EOF) {
+        if (c == '#') {
+            while (c != EOF && c != '\n') {c = fgetc(file);}
+        } else if (!isspace(c)) {
+            break;
+        }
+        c = fgetc(file);
+    }
+    if (c != EOF) {ungetc(c, file);}
+    return c;
+}
+
+static inline unsigned char scale_pnm_sample(const unsigned char* sample, const struct pnm_state* state)
+{
+    unsigned long value = state->bytes_per_sample == 1 ? sample[0] : (sample[0] << 8) | sample[1];
+    if (state->max_value == 255) {return (unsigned char) value;}
+    return (unsigned char) ((value * 255 + state->max_value / 2) / state->max_value);
+}
@@ -0,0 +1,16 @@
+/*
+    Native decoding of binary Netpbm images: PGM (P5), PPM (P6), and PAM
+    (P7). Any number of images concatenated into one file are read as
+    frames, which makes this handy for raw frame streams too.
+*/
+#ifndef PNM_H
+#define PNM_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "input/reader.h"
+
+bool is_pnm_signature(const unsigned char signature[2]);
+int open_pnm_image(FILE* file, struct image_reader* reader);
+
+#endif
@@ -0,0 +1,78 @@
+#include "input/raw.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "input/reader.h"
+
+struct raw_state {
+    FILE* file;
+    size_t width;
+    size_t height;
+    size_t rows_read;
+    bool started;
+};
+
+static bool next_raw_frame(struct image_reader* reader);
+static int read_raw_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels);
+static void close_raw_image(struct image_reader* reader);
+
+int open_raw_image(FILE* file, size_t width, size_t height, struct image_reader* reader)
+{
+    if (width == 0 || height == 0) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Raw frames need a size.");
+        return READER_FAILED;
+    }
+    struct raw_state* state = (struct raw_state*) calloc(1, sizeof(struct raw_state));
+    if (state == NULL) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+        return READER_FAILED;
+    }
+    state->file = file;
+    state->width = width;
+    state->height = height;
+
+    reader->next_frame = next_raw_frame;
+    reader->read_rows = read_raw_rows;
+    reader->close = close_raw_image;
+    reader->state = state;
+    return READER_OK;
+}
+
+static bool next_raw_frame(struct image_reader* reader)
+{
+    struct raw_state* state = (struct raw_state*) reader->state;
+    size_t row_size = 3 * state->width;
+    if (state->started && !skip_file_bytes(state->file, row_size * (state->height - state->rows_read))) {
+        return false;
+    }
+    state->started = true;
+    state->rows_read = 0;
+
+    // The stream simply ending between frames is how it's meant to end.
+    int c = fgetc(state->file);
+    if (c == EOF) {return false;}
+    ungetc(c, state->file);
+    reader->width = state->width;
+    reader->height = state->height;
+    return true;
+}
+
+static int read_raw_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels)
+{
+    struct raw_state* state = (struct raw_state*) reader->state;
+    if (fread(pixels, 3 * state->width, num_rows, state->file) != num_rows) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Raw frame ends unexpectedly.");
+        return 1;
+    }
+    state->rows_read += num_rows;
+    return 0;
+}
+
+static void close_raw_image(struct image_reader* reader)
+{
+    struct raw_state* state = (struct raw_state*) reader->state;
+    fclose(state->file);
+    free(state);
+}
@@ -0,0 +1,14 @@
+/*
+    Headerless 8-bit RGB frames of a size that's known up front, one right
+    after another – what ffmpeg pipes out with "-f rawvideo -pix_fmt rgb24".
+*/
+#ifndef RAW_H
+#define RAW_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "input/reader.h"
+
+int open_raw_image(FILE* file, size_t width, size_t height, struct image_reader* reader);
+
+#endif
@@ -0,0 +1,328 @@
+#include "input/reader.h"
+
+#include <stdbool.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN64
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include "input/bmp.h"
+#include "input/magick.h"
+#include "input/mapping.h"
+#include "input/png.h"
+#include "input/pnm.h"
+#include "input/raw.h"
+#include "input/y4m.h"
+#include "stats/stats.h"
+
+// For skimming long animations: how many frames of each image to read at
+// most (0 meaning every one), and to only read every so-manyth frame.
+size_t max_frames = 0;
+size_t frame_stride = 1;
+
+static int open_native_image(FILE* file, struct image_reader* reader);
+static FILE* open_memory_file(const void* data, size_t size);
+static unsigned char* read_whole_file(FILE* file, size_t* size);
+
+/*
+    Opens the image at path, picking a decoder based on the first few bytes
+    of the file. Returns NULL and fills in error_description if the image
+    can't be opened. Before the first frame can be read, next_frame has to
+    be called.
+
+    The file is mapped into memory if it can be, and decoded from there –
+    ImageMagick included, as a blob – so that it's only ever opened the
+    once, and read in as few requests as the system cares to make.
+*/
+struct image_reader* open_image(const char* path, char error_description[READER_ERROR_SIZE])
+{
+    struct image_reader* reader = (struct image_reader*) calloc(1, sizeof(struct image_reader));
+    if (reader == NULL) {
+        snprintf(error_description, READER_ERROR_SIZE, "Out of memory.");
+        return NULL;
+    }
+    reader->pixel_size = 3;
+
+    enter_stats_phase(STATS_DECODE);
+    int result = READER_NOT_THIS_FORMAT;
+    FILE* file;
+    if (map_file(path, &reader->mapping)) {
+        reader->file_data = reader->mapping.data;
+        reader->file_size = reader->mapping.size;
+        file = open_memory_file(reader->file_data, reader->file_size);
+    } else {
+        file = fopen(path, "rb");
+        // Telling the format means reading ahead and going back, which a
+        // pipe can't do – so one is read into memory whole, and decoded
+        // from there like a mapped file.
+        if (file != NULL && fseek(file, 0, SEEK_CUR) != 0) {
+            reader->file_buffer = read_whole_file(file, &reader->file_size);
+            fclose(file);
+            file = NULL;
+            if (reader->file_buffer == NULL) {
+                snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+                result = READER_FAILED;
+            } else {
+                reader->file_data = reader->file_buffer;
+                file = open_memory_file(reader->file_data, reader->file_size);
+            }
+        }
+    }
+    // A path that can't be opened may still mean something to ImageMagick
+    // (e.g. "animation.gif[3]"), so it gets a say in that case too.
+    if (file != NULL) {
+        result = open_native_image(file, reader);
+        if (result != READER_OK) {fclose(file);}
+    }
+    if (result == READER_NOT_THIS_FORMAT) {
+        result = open_magick_image(path, reader);
+    }
+    leave_stats_phase();
+
+    if (result != READER_OK) {
+        snprintf(error_description, READER_ERROR_SIZE, "%s", reader->error_description);
+        unmap_file(&reader->mapping);
+        free(reader->file_buffer);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+/*
+    The same as open_image, but for an image file held in memory, which has
+    to stay around until the image is closed.
+*/
+struct image_reader* open_image_blob(const void* data, size_t size, char error_description[READER_ERROR_SIZE])
+{
+    struct image_reader* reader = (struct image_reader*) calloc(1, sizeof(struct image_reader));
+    if (reader == NULL) {
+        snprintf(error_description, READER_ERROR_SIZE, "Out of memory.");
+        return NULL;
+    }
+    reader->pixel_size = 3;
+
+    int result = READER_NOT_THIS_FORMAT;
+    reader->file_data = (const unsigned char*) data;
+    reader->file_size = size;
+    FILE* file = open_memory_file(data, size);
+    if (file != NULL) {
+        result = open_native_image(file, reader);
+        if (result != READER_OK) {fclose(file);}
+    }
+    if (result == READER_NOT_THIS_FORMAT) {
+        result = open_magick_image_blob(data, size, reader);
+    }
+
+    if (result != READER_OK) {
+        snprintf(error_description, READER_ERROR_SIZE, "%s", reader->error_description);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+/*
+    Opens a stream of frames in the given format – from standard input if
+    the path is "-", or from a FIFO or any other file otherwise. Unlike
+    open_image, nothing's read ahead to tell the format, since a stream
+    can't be rewound. The width and height are only used for raw frames,
+    which don't say what size they are.
+*/
+struct image_reader* open_image_stream(
+    const char* path, enum stream_format format, size_t width, size_t height,
+    char error_description[READER_ERROR_SIZE]
+)
+{
+    struct image_reader* reader = (struct image_reader*) calloc(1, sizeof(struct image_reader));
+    if (reader == NULL) {
+        snprintf(error_description, READER_ERROR_SIZE, "Out of memory.");
+        return NULL;
+    }
+    reader->pixel_size = 3;
+
+    FILE* file;
+    if (strcmp(path, "-") == 0) {
+#ifdef WIN64
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        file = stdin;
+    } else {
+        file = fopen(path, "rb");
+    }
+    if (file == NULL) {
+        snprintf(error_description, READER_ERROR_SIZE, "%s", strerror(errno));
+        free(reader);
+        return NULL;
+    }
+
+    int result;
+    switch (format) {
+        case STREAM_Y4M: result = open_y4m_image(file, reader); break;
+        case STREAM_RGB24: result = open_raw_image(file, width, height, reader); break;
+        default: result = open_pnm_image(file, reader);
+    }
+    if (result != READER_OK) {
+        snprintf(error_description, READER_ERROR_SIZE, "%s", reader->error_description);
+        fclose(file);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+/*
+    Moves on to the next frame, returning false if there are no more frames
+    (or if the next one couldn't be read, in which case error_description is
+    filled in). Frames skipped due to frame_stride are moved past without
+    being decoded.
+*/
+bool next_frame(struct image_reader* reader)
+{
+    reader->error_description[0] = 0;
+    if (max_frames > 0 && reader->num_frames >= max_frames) {return false;}
+    enter_stats_phase(STATS_DECODE);
+    bool has_frame = true;
+    for (size_t i = reader->num_frames > 0 ? frame_stride : 1; i > 0 && has_frame; i--) {
+        has_frame = reader->next_frame(reader);
+    }
+    leave_stats_phase();
+    if (has_frame) {
+        reader->num_frames++;
+        reader->pixel_size = 3;
+        reader->next_row = 0;
+    }
+    return has_frame;
+}
+
+/*
+    Reads num_rows rows of the current frame as 8-bit RGB (or palette
+    indices – see use_palette_indices), starting at first_row. Returns
+    nonzero if they couldn't be read. Rows have to be read in order, with
+    none skipped, since most formats can't seek within a frame: first_row
+    has to be the row right after the last one read.
+*/
+int read_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels)
+{
+    if (num_rows == 0) {return 0;}
+    if (first_row != reader->next_row) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Rows read out of order.");
+        return 1;
+    }
+    enter_stats_phase(STATS_DECODE);
+    int error = reader->read_rows(reader, first_row, num_rows, pixels);
+    leave_stats_phase();
+    if (!error) {
+        reader->next_row += num_rows;
+        count_stats(STATS_BYTES_DECODED, reader->pixel_size * reader->width * num_rows);
+    }
+    return error;
+}
+
+/*
+    Switches the current frame over to being read as palette indices, one
+    byte a pixel, if it has a palette – and returns whether it does. Colors
+    that are in the palette more than once all go by the first index they're
+    at, so that two pixels have the same index exactly when they're the same
+    color. Has to be called before any of the frame's rows are read.
+*/
+bool use_palette_indices(struct image_reader* reader)
+{
+    if (!reader->has_palette) {return false;}
+    reader->pixel_size = 1;
+    return true;
+}
+
+/*
+    For formats to skip the rest of a frame: by seeking if possible, or by
+    reading through it if it's a pipe. Returns false if the file ends first.
+*/
+bool skip_file_bytes(FILE* file, size_t size)
+{
+    if (size == 0 || fseek(file, (long) size, SEEK_CUR) == 0) {return true;}
+    unsigned char buffer[4096];
+    while (size > 0) {
+        size_t chunk_size = size < sizeof(buffer) ? size : sizeof(buffer);
+        if (fread(buffer, 1, chunk_size, file) != chunk_size) {return false;}
+        size -= chunk_size;
+    }
+    return true;
+}
+
+void close_image(struct image_reader* reader)
+{
+    if (reader == NULL) {return;}
+    reader->close(reader);
+    unmap_file(&reader->mapping);
+    free(reader->file_buffer);
+    free(reader);
+}
+
+/*
+    Picks a native decoder based on the first few bytes of the file, which
+    is left where it was. Returns READER_NOT_THIS_FORMAT if there's none.
+*/
+static int open_native_image(FILE* file, struct image_reader* reader)
+{
+    unsigned char signature[8] = {0};
+    size_t signature_size = fread(signature, 1, sizeof(signature), file);
+    rewind(file);
+    if (signature_size == sizeof(signature) && is_png_signature(signature)) {
+        return open_png_image(file, reader);
+    } else if (signature_size >= 2 && is_pnm_signature(signature)) {
+        return open_pnm_image(file, reader);
+    } else if (signature_size >= 2 && is_bmp_signature(signature)) {
+        return open_bmp_image(file, reader);
+    } else if (signature_size == sizeof(signature) && is_y4m_signature(signature)) {
+        return open_y4m_image(file, reader);
+    }
+    return READER_NOT_THIS_FORMAT;
+}
+
+/*
+    The native formats read from a FILE, which fmemopen can make of memory.
+    Windows doesn't have it, so there, blobs all go to ImageMagick – but
+    then, nothing's mapped there either.
+*/
+static FILE* open_memory_file(const void* data, size_t size)
+{
+#ifdef WIN64
+    return NULL;
+#else
+    return fmemopen((void*) data, size, "rb");
+#endif
+}
+
+/*
+    Reads what's left of a file into memory, which the caller has to free.
+    Returns NULL if there isn't enough memory.
+*/
+static unsigned char* read_whole_file(FILE* file, size_t* size)
+{
+    *size = 0;
+    size_t capacity = 1 << 20;
+    unsigned char* data = (unsigned char*) malloc(capacity * sizeof(unsigned char));
+    while (data != NULL) {
+        *size += fread(data + *size, 1, capacity - *size, file);
+        if (*size < capacity) {break;}
+        capacity *= 2;
+        unsigned char* grown = (unsigned char*) realloc(data, capacity * sizeof(unsigned char));
+        if (grown == NULL) {free(data);}
+        data = grown;
+    }
+    return data;
+}
+
+/*
+    Call once done with every image, to shut down ImageMagick if it was used
+    – only at the very end, since it can't be started up again after, and
+    not while any other thread could still be reading an image.
+*/
+void finish_image_readers(void)
+{
+    finish_magick();
+}
@@ -0,0 +1,92 @@
+/*
+    Reading the pixels of an image file, one frame and a few rows at a time,
+    as 8-bit RGB – or, for PNGs with a palette, as its indices if asked to.
+    Files are mapped into memory where possible and decoded from there.
+    PNG, binary PPM/PGM/PAM, uncompressed BMP and Y4M files are decoded
+    natively, straight into the caller's buffer – or, for frames that are
+    stored just as they'd be decoded, not at all; anything else goes through
+    ImageMagick, which is only started up once such a file shows up.
+    Streams of frames (e.g. piped from ffmpeg) are read natively only.
+*/
+#ifndef READER_H
+#define READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "input/mapping.h"
+
+#define READER_ERROR_SIZE 256
+
+// What each format's open function returns. A format that recognizes a
+// file but can't handle it returns READER_NOT_THIS_FORMAT so that it falls
+// through to ImageMagick.
+#define READER_OK 0
+#define READER_FAILED 1
+#define READER_NOT_THIS_FORMAT 2
+
+enum stream_format {
+    // Concatenated PAM, PPM or PGM images.
+    STREAM_NETPBM,
+    STREAM_Y4M,
+    // Headerless RGB24 frames of a given size.
+    STREAM_RGB24
+};
+
+struct image_reader {
+    // The current frame's dimensions. Only valid after next_frame.
+    size_t width;
+    size_t height;
+    // What went wrong, whenever a function below fails.
+    char error_description[READER_ERROR_SIZE];
+    // How many frames next_frame has moved on to.
+    size_t num_frames;
+    // The whole file, if it's in memory – mapped, or handed over as a blob.
+    // NULL otherwise.
+    const unsigned char* file_data;
+    size_t file_size;
+    // If the current frame is in file_data as 8-bit RGB rows, one right
+    // after another, where it starts – so that it can be scanned right
+    // there instead of being read. Set by formats; NULL otherwise.
+    const unsigned char* frame_pixels;
+    // Whether the current frame can be read as palette indices instead
+    // (see use_palette_indices). Set by formats.
+    bool has_palette;
+    // How many bytes read_rows hands over for each pixel: 3, or 1 once
+    // use_palette_indices has been called. Formats go by it.
+    size_t pixel_size;
+
+    // The row read_rows has to go on from (see there).
+    size_t next_row;
+
+    // Filled in by each format. Rows have to be read in order within
+    // a frame, but whatever's left of one is skipped by next_frame.
+    bool (*next_frame)(struct image_reader* reader);
+    int (*read_rows)(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels);
+    void (*close)(struct image_reader* reader);
+    void* state;
+
+    // What open_image mapped, to be unmapped on closing.
+    struct file_mapping mapping;
+    // What open_image read into memory itself, for a file it couldn't map
+    // or rewind (such as a pipe), to be freed on closing. NULL otherwise.
+    unsigned char* file_buffer;
+};
+
+extern size_t max_frames;
+extern size_t frame_stride;
+
+struct image_reader* open_image(const char* path, char error_description[READER_ERROR_SIZE]);
+struct image_reader* open_image_blob(const void* data, size_t size, char error_description[READER_ERROR_SIZE]);
+struct image_reader* open_image_stream(
+    const char* path, enum stream_format format, size_t width, size_t height,
+    char error_description[READER_ERROR_SIZE]
+);
+bool next_frame(struct image_reader* reader);
+int read_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels);
+bool use_palette_indices(struct image_reader* reader);
+bool skip_file_bytes(FILE* file, size_t size);
+void close_image(struct image_reader* reader);
+void finish_image_readers(void);
+
+#endif
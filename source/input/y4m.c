@@ -0,0 +1,204 @@
+#include "input/y4m.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "input/reader.h"
+
+// Long enough for any stream or frame header that's seen in practice.
+#define MAX_Y4M_HEADER_SIZE 1024
+
+struct y4m_state {
+    FILE* file;
+    // How many times narrower and shorter the chroma planes are than the
+    // luma plane, as a shift – or no chroma at all, for grayscale.
+    bool has_chroma;
+    unsigned int chroma_shift_x;
+    unsigned int chroma_shift_y;
+    size_t chroma_width;
+    size_t chroma_height;
+    // Planar, so the whole frame has to be read before any row of it can be
+    // converted.
+    unsigned char* frame;
+    size_t frame_size;
+    bool frame_read;
+    bool started;
+};
+
+static bool next_y4m_frame(struct image_reader* reader);
+static int read_y4m_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels);
+static void close_y4m_image(struct image_reader* reader);
+static int read_y4m_stream_header(struct image_reader* reader, struct y4m_state* state);
+static bool read_y4m_line(FILE* file, char line[MAX_Y4M_HEADER_SIZE]);
+static inline unsigned char clamp_y4m_sample(int value);
+
+bool is_y4m_signature(const unsigned char signature[8])
+{
+    return memcmp(signature, "YUV4MPEG", 8) == 0;
+}
+
+int open_y4m_image(FILE* file, struct image_reader* reader)
+{
+    struct y4m_state* state = (struct y4m_state*) calloc(1, sizeof(struct y4m_state));
+    if (state == NULL) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+        return READER_FAILED;
+    }
+    state->file = file;
+    if (read_y4m_stream_header(reader, state)) {
+        free(state->frame);
+        free(state);
+        return READER_FAILED;
+    }
+
+    reader->next_frame = next_y4m_frame;
+    reader->read_rows = read_y4m_rows;
+    reader->close = close_y4m_image;
+    reader->state = state;
+    return READER_OK;
+}
+
+static bool next_y4m_frame(struct image_reader* reader)
+{
+    struct y4m_state* state = (struct y4m_state*) reader->state;
+    if (state->started && !state->frame_read && !skip_file_bytes(state->file, state->frame_size)) {
+        return false;
+    }
+    state->started = true;
+    state->frame_read = false;
+
+    // The stream simply ending between frames is how it's meant to end.
+    char line[MAX_Y4M_HEADER_SIZE];
+    if (!read_y4m_line(state->file, line)) {return false;}
+    if (strncmp(line, "FRAME", 5) != 0) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Invalid Y4M frame header.");
+        return false;
+    }
+    return true;
+}
+
+static int read_y4m_rows(struct image_reader* reader, size_t first_row, size_t num_rows, unsigned char* pixels)
+{
+    struct y4m_state* state = (struct y4m_state*) reader->state;
+    if (!state->frame_read) {
+        if (fread(state->frame, 1, state->frame_size, state->file) != state->frame_size) {
+            snprintf(reader->error_description, READER_ERROR_SIZE, "Y4M frame ends unexpectedly.");
+            return 1;
+        }
+        state->frame_read = true;
+    }
+
+    size_t width = reader->width;
+    const unsigned char* luma = state->frame;
+    const unsigned char* blue_chroma = luma + width * reader->height;
+    const unsigned char* red_chroma = blue_chroma + state->chroma_width * state->chroma_height;
+    for (size_t y = first_row; y < first_row + num_rows; y++) {
+        const unsigned char* luma_row = luma + width * y;
+        size_t chroma_offset = state->chroma_width * (y >> state->chroma_shift_y);
+        unsigned char* out = pixels + 3 * width * (y - first_row);
+        for (size_t x = 0; x < width; x++) {
+            int c = 298 * (luma_row[x] - 16);
+            int d = 0;
+            int e = 0;
+            if (state->has_chroma) {
+                d = blue_chroma[chroma_offset + (x >> state->chroma_shift_x)] - 128;
+                e = red_chroma[chroma_offset + (x >> state->chroma_shift_x)] - 128;
+            }
+            out[0] = clamp_y4m_sample((c + 409 * e + 128) >> 8);
+            out[1] = clamp_y4m_sample((c - 100 * d - 208 * e + 128) >> 8);
+            out[2] = clamp_y4m_sample((c + 516 * d + 128) >> 8);
+            out += 3;
+        }
+    }
+    return 0;
+}
+
+static void close_y4m_image(struct image_reader* reader)
+{
+    struct y4m_state* state = (struct y4m_state*) reader->state;
+    fclose(state->file);
+    free(state->frame);
+    free(state);
+}
+
+/*
+    "YUV4MPEG2" followed by space-separated parameters, each a letter and a
+    value. Only the size (W, H) and the colorspace (C) matter here.
+*/
+static int read_y4m_stream_header(struct image_reader* reader, struct y4m_state* state)
+{
+    char line[MAX_Y4M_HEADER_SIZE];
+    if (!read_y4m_line(state->file, line) || strncmp(line, "YUV4MPEG2", 9) != 0) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Not a Y4M stream.");
+        return 1;
+    }
+
+    unsigned long width = 0;
+    unsigned long height = 0;
+    char colorspace[32] = "420";
+    for (char* parameter = strtok(line + 9, " "); parameter != NULL; parameter = strtok(NULL, " ")) {
+        switch (parameter[0]) {
+            case 'W': width = strtoul(parameter + 1, NULL, 10); break;
+            case 'H': height = strtoul(parameter + 1, NULL, 10); break;
+            case 'C': snprintf(colorspace, sizeof(colorspace), "%s", parameter + 1); break;
+        }
+    }
+    if (width == 0 || height == 0) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Invalid Y4M header.");
+        return 1;
+    }
+
+    state->has_chroma = true;
+    size_t num_extra_planes = 0;
+    // The 4:2:0 variants only differ in where the chroma samples sit, which
+    // doesn't matter when they're just scaled up; the ones with more than 8
+    // bits per sample ("420p10" and so on) aren't supported.
+    if (
+        strcmp(colorspace, "420") == 0 || strcmp(colorspace, "420jpeg") == 0 ||
+        strcmp(colorspace, "420mpeg2") == 0 || strcmp(colorspace, "420paldv") == 0
+    ) {
+        state->chroma_shift_x = 1;
+        state->chroma_shift_y = 1;
+    } else if (strcmp(colorspace, "422") == 0) {
+        state->chroma_shift_x = 1;
+    } else if (strcmp(colorspace, "411") == 0) {
+        state->chroma_shift_x = 2;
+    } else if (strcmp(colorspace, "444alpha") == 0) {
+        num_extra_planes = 1;
+    } else if (strcmp(colorspace, "mono") == 0) {
+        state->has_chroma = false;
+    } else if (strcmp(colorspace, "444") != 0) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Unsupported Y4M colorspace: %s.", colorspace);
+        return 1;
+    }
+
+    reader->width = width;
+    reader->height = height;
+    size_t luma_size = (size_t) width * height;
+    if (state->has_chroma) {
+        state->chroma_width = (width + (1 << state->chroma_shift_x) - 1) >> state->chroma_shift_x;
+        state->chroma_height = (height + (1 << state->chroma_shift_y) - 1) >> state->chroma_shift_y;
+    }
+    state->frame_size = luma_size * (1 + num_extra_planes) + 2 * state->chroma_width * state->chroma_height;
+    state->frame = (unsigned char*) malloc(state->frame_size);
+    if (state->frame == NULL) {
+        snprintf(reader->error_description, READER_ERROR_SIZE, "Out of memory.");
+        return 1;
+    }
+    return 0;
+}
+
+// Reads a line, without the newline. Returns false at the end of the file.
+static bool read_y4m_line(FILE* file, char line[MAX_Y4M_HEADER_SIZE])
+{
+    if (fgets(line, MAX_Y4M_HEADER_SIZE, file) == NULL) {return false;}
+    line[strcspn(line, "\n")] = 0;
+    return true;
+}
+
+static inline unsigned char clamp_y4m_sample(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : (unsigned char) value;
+}
@@ -0,0 +1,16 @@
+/*
+    Native decoding of YUV4MPEG2 (Y4M) streams – what ffmpeg pipes out with
+    "-f yuv4mpegpipe" – converted to RGB as BT.601 limited range. Only 8-bit
+    streams are supported, with any of the usual chroma subsamplings.
+*/
+#ifndef Y4M_H
+#define Y4M_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "input/reader.h"
+
+bool is_y4m_signature(const unsigned char signature[8]);
+int open_y4m_image(FILE* file, struct image_reader* reader);
+
+#endif
@@ -0,0 +1,279 @@
+#include "library/pittari.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "algorithm/contrast.h"
+#include "algorithm/contrast_set.h"
+#include "algorithm/dimensions.h"
+#include "algorithm/pool.h"
+#include "algorithm/simd.h"
+
+struct pittari {
+    struct pittari_options options;
+    // Created along with the first frame, and kept for as long as the frames
+    // added after finishing stay the same size.
+    struct contrasts* contrasts;
+    struct worker_pool* pool;
+    // Frames that can't be scanned right where they are get converted into
+    // this first.
+    unsigned char* pixels;
+    size_t pixels_size;
+    size_t num_frames;
+};
+
+static pthread_once_t simd_kernels_selected = PTHREAD_ONCE_INIT;
+
+static bool valid_options(const struct pittari_options* options);
+static int prepare_contrasts(struct pittari* context, size_t width, size_t height);
+static size_t bytes_per_pixel(enum pittari_pixel_format format);
+static void convert_to_rgb(
+    const unsigned char* pixels, size_t width, size_t height, size_t stride,
+    enum pittari_pixel_format format, unsigned char* rgb
+);
+
+void pittari_default_options(struct pittari_options* options)
+{
+    options->leeway = 0;
+    options->nearest_neighbor_max_variation = 1;
+    options->num_threads = 1;
+    options->progressive = 0;
+}
+
+/*
+    Creates a context into *context. options can be NULL for the defaults,
+    and aren't needed after this returns.
+*/
+int pittari_create(const struct pittari_options* options, struct pittari** context)
+{
+    *context = NULL;
+    struct pittari_options default_options;
+    if (options == NULL) {
+        pittari_default_options(&default_options);
+        options = &default_options;
+    }
+    if (!valid_options(options)) {return PITTARI_INVALID_ARGUMENT;}
+    pthread_once(&simd_kernels_selected, select_simd_kernels);
+
+    struct pittari* new_context = (struct pittari*) calloc(1, sizeof(struct pittari));
+    if (new_context == NULL) {return PITTARI_OUT_OF_MEMORY;}
+    new_context->options = *options;
+    if (options->num_threads != 1) {
+        // Without the threads, frames are just scanned on the calling
+        // thread alone.
+        new_context->pool = create_worker_pool(options->num_threads ? (size_t) options->num_threads : count_cpu_cores());
+    }
+    *context = new_context;
+    return PITTARI_OK;
+}
+
+void pittari_destroy(struct pittari* context)
+{
+    if (context == NULL) {return;}
+    destroy_contrasts(context->contrasts);
+    destroy_worker_pool(context->pool);
+    free(context->pixels);
+    free(context);
+}
+
+/*
+    Scans a frame of width × height pixels, where each row starts stride
+    bytes after the one before it (or, if stride is 0, right after it). The
+    frame is left as it is, and isn't needed after this returns.
+*/
+int pittari_add_frame(
+    struct pittari* context, const unsigned char* pixels,
+    size_t width, size_t height, size_t stride, enum pittari_pixel_format format
+)
+{
+    size_t pixel_size = bytes_per_pixel(format);
+    if (pixel_size == 0 || pixels == NULL || width == 0 || height == 0) {return PITTARI_INVALID_ARGUMENT;}
+    if (stride == 0) {stride = pixel_size * width;}
+    if (stride < pixel_size * width) {return PITTARI_INVALID_ARGUMENT;}
+
+    if (context->num_frames == 0) {
+        int error = prepare_contrasts(context, width, height);
+        if (error) {return error;}
+    } else if (width != context->contrasts->columns->size || height != context->contrasts->rows->size) {
+        return PITTARI_WRONG_SIZE;
+    }
+    context->num_frames++;
+    // Once every column and row has been marked, no frame can change
+    // anything anymore.
+    if (contrasts_saturated(context->contrasts)) {return PITTARI_OK;}
+
+    unsigned char* rgb = (unsigned char*) pixels;
+    if (pixel_size != 3 || stride != 3 * width) {
+        size_t rgb_size = 3 * width * height;
+        if (rgb_size > context->pixels_size) {
+            free(context->pixels);
+            context->pixels_size = 0;
+            context->pixels = (unsigned char*) malloc(rgb_size * sizeof(unsigned char));
+            if (context->pixels == NULL) {
+                context->num_frames--;
+                return PITTARI_OUT_OF_MEMORY;
+            }
+            context->pixels_size = rgb_size;
+        }
+        convert_to_rgb(pixels, width, height, stride, format, context->pixels);
+        rgb = context->pixels;
+    }
+    // Scanning only ever reads the pixels, so they really are left as they
+    // are.
+    update_contrasts_from_whole_image(context->contrasts, rgb);
+    return PITTARI_OK;
+}
+
+/*
+    Whether the frames so far have settled everything, so that adding any
+    more would be a waste of time.
+*/
+int pittari_saturated(const struct pittari* context)
+{
+    return context->num_frames > 0 && contrasts_saturated(context->contrasts);
+}
+
+/*
+    Determines the original resolution of the frames added since the context
+    was created or last finished (or reset), and starts over.
+*/
+int pittari_finish(struct pittari* context, struct pittari_result* result)
+{
+    if (context->num_frames == 0) {return PITTARI_NO_FRAMES;}
+    struct contrasts* contrasts = context->contrasts;
+    int max_variation = contrasts->nearest_neighbor_max_variation;
+    double width_confidence;
+    double height_confidence;
+    size_t determined_width = determine_dimension(contrasts->columns, max_variation, &width_confidence);
+    size_t determined_height = determine_dimension(contrasts->rows, max_variation, &height_confidence);
+    if (determined_width == 0 || determined_height == 0) {return PITTARI_OUT_OF_MEMORY;}
+
+    result->scaled_width = contrasts->columns->size;
+    result->scaled_height = contrasts->rows->size;
+    result->determined_width = determined_width;
+    result->determined_height = determined_height;
+    result->width_confidence = width_confidence;
+    result->height_confidence = height_confidence;
+    result->num_frames = context->num_frames;
+    context->num_frames = 0;
+    return PITTARI_OK;
+}
+
+// Forgets any frames added since the context was created or last finished.
+void pittari_reset(struct pittari* context)
+{
+    context->num_frames = 0;
+}
+
+/*
+    For a single frame: creates a context, adds the frame, finishes it, and
+    destroys it again.
+*/
+int pittari_determine(
+    const struct pittari_options* options, const unsigned char* pixels,
+    size_t width, size_t height, size_t stride, enum pittari_pixel_format format,
+    struct pittari_result* result
+)
+{
+    struct pittari* context;
+    int error = pittari_create(options, &context);
+    if (error) {return error;}
+    error = pittari_add_frame(context, pixels, width, height, stride, format);
+    if (!error) {error = pittari_finish(context, result);}
+    pittari_destroy(context);
+    return error;
+}
+
+const char* pittari_error_description(int error)
+{
+    switch (error) {
+        case PITTARI_OK: return "No error.";
+        case PITTARI_INVALID_ARGUMENT: return "Invalid argument.";
+        case PITTARI_WRONG_SIZE: return "Frames not of the same resolution.";
+        case PITTARI_OUT_OF_MEMORY: return "Out of memory.";
+        case PITTARI_NO_FRAMES: return "No frames.";
+        default: return "Unknown error.";
+    }
+}
+
+static bool valid_options(const struct pittari_options* options)
+{
+    return
+        options->leeway >= 0 && options->leeway <= 255 &&
+        options->nearest_neighbor_max_variation >= 0 &&
+        options->num_threads >= 0;
+}
+
+/*
+    Gets the context's contrasts ready for a new series of frames: reused if
+    they're already the right size, and recreated otherwise.
+*/
+static int prepare_contrasts(struct pittari* context, size_t width, size_t height)
+{
+    struct contrasts* contrasts = context->contrasts;
+    if (contrasts != NULL && contrasts->frame_width == width && contrasts->frame_height == height) {
+        reset_contrasts(contrasts);
+        return PITTARI_OK;
+    }
+
+    destroy_contrasts(contrasts);
+    context->contrasts = contrasts = create_contrasts(width, height);
+    if (contrasts == NULL) {return PITTARI_OUT_OF_MEMORY;}
+    // create_contrasts takes the command line's settings, which have
+    // nothing to do with this context.
+    contrasts->pool = context->pool;
+    contrasts->comparison = context->options.leeway > 0 ? COMPARE_FUZZY : COMPARE_EXACT;
+    contrasts->leeway = (unsigned char) context->options.leeway;
+    contrasts->nearest_neighbor_max_variation = context->options.nearest_neighbor_max_variation;
+    contrasts->progressive = context->options.progressive != 0;
+    contrasts->region.width = 0;
+    contrasts->trim_borders = false;
+    return PITTARI_OK;
+}
+
+// 0 for formats that don't exist.
+static size_t bytes_per_pixel(enum pittari_pixel_format format)
+{
+    switch (format) {
+        case PITTARI_RGB8:
+        case PITTARI_BGR8:
+            return 3;
+        case PITTARI_RGBA8:
+        case PITTARI_BGRA8:
+        case PITTARI_ARGB8:
+        case PITTARI_ABGR8:
+            return 4;
+        case PITTARI_GRAY8:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Packs the pixels into rgb as 3 bytes each, with no padding between rows.
+static void convert_to_rgb(
+    const unsigned char* pixels, size_t width, size_t height, size_t stride,
+    enum pittari_pixel_format format, unsigned char* rgb
+)
+{
+    size_t pixel_size = bytes_per_pixel(format);
+    // Where the 3 color channels start within each pixel.
+    size_t first_channel = format == PITTARI_ARGB8 || format == PITTARI_ABGR8 ? 1 : 0;
+    for (size_t y = 0; y < height; y++) {
+        const unsigned char* row = pixels + stride * y;
+        unsigned char* rgb_row = rgb + 3 * width * y;
+        if (pixel_size == 3) {
+            memcpy(rgb_row, row, 3 * width);
+        } else if (pixel_size == 1) {
+            for (size_t x = 0; x < width; x++) {
+                rgb_row[3 * x] = rgb_row[3 * x + 1] = rgb_row[3 * x + 2] = row[x];
+            }
+        } else {
+            for (size_t x = 0; x < width; x++) {
+                memcpy(rgb_row + 3 * x, row + 4 * x + first_channel, 3);
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/*
+    libpittari: determining the original resolution of nearest-neighbor
+    scaled frames that are already in memory, without going through image
+    files.
+
+    Everything goes through a context, which holds its own options and
+    whatever it's found so far. Frames are added to it one at a time (as
+    many as there are – more frames can only make the result more accurate),
+    and finishing it gives the result and readies it for the next series of
+    frames. Contexts don't share any state, so any number of them can be used
+    at once on different threads – though each one only from one thread at a
+    time. Nothing here prints anything or exits the program: functions that
+    can fail return one of the PITTARI_* codes below instead.
+*/
+#ifndef PITTARI_H
+#define PITTARI_H
+
+#include <stddef.h>
+
+#define PITTARI_OK 0
+#define PITTARI_INVALID_ARGUMENT 1
+// A frame's size differs from that of the frames before it.
+#define PITTARI_WRONG_SIZE 2
+#define PITTARI_OUT_OF_MEMORY 3
+// Finishing a context that hasn't been given any frames.
+#define PITTARI_NO_FRAMES 4
+
+// How each pixel is laid out in memory, one byte per channel. Alpha is
+// ignored, and since every channel is compared the same way, so is the order
+// of the others – that's what makes the 3-byte formats quickest, as frames
+// in those (with no padding between rows) are scanned right where they are.
+enum pittari_pixel_format {
+    PITTARI_RGB8,
+    PITTARI_BGR8,
+    PITTARI_RGBA8,
+    PITTARI_BGRA8,
+    PITTARI_ARGB8,
+    PITTARI_ABGR8,
+    PITTARI_GRAY8
+};
+
+struct pittari_options {
+    // How much any one channel of two pixels can differ by for them to still
+    // count as the same, from 0 to 255. The same as --inexact --leeway, but
+    // 0 by default, which is the same as leaving out --inexact.
+    int leeway;
+    // The same as --nearest-neighbor-variation. 1 by default.
+    int nearest_neighbor_max_variation;
+    // How many threads to scan each frame with, counting the one adding it.
+    // 0 means one per CPU core. 1 by default.
+    int num_threads;
+    // If nonzero, frames are scanned progressively, like with --sample –
+    // unless leeway is above 0, in which case they're scanned in full. 0 by
+    // default.
+    int progressive;
+};
+
+struct pittari_result {
+    size_t scaled_width;
+    size_t scaled_height;
+    size_t determined_width;
+    size_t determined_height;
+    // How sure the result is of each dimension, from 0 to 1. 1 means that
+    // every column/row where a new original pixel starts was found; below
+    // that, it's how much better the frames fit the determined dimension
+    // than any other, going by where nearest neighbor scaling would have
+    // put them.
+    double width_confidence;
+    double height_confidence;
+    size_t num_frames;
+};
+
+struct pittari;
+
+void pittari_default_options(struct pittari_options* options);
+int pittari_create(const struct pittari_options* options, struct pittari** context);
+void pittari_destroy(struct pittari* context);
+int pittari_add_frame(
+    struct pittari* context, const unsigned char* pixels,
+    size_t width, size_t height, size_t stride, enum pittari_pixel_format format
+);
+int pittari_saturated(const struct pittari* context);
+int pittari_finish(struct pittari* context, struct pittari_result* result);
+void pittari_reset(struct pittari* context);
+int pittari_determine(
+    const struct pittari_options* options, const unsigned char* pixels,
+    size_t width, size_t height, size_t stride, enum pittari_pixel_format format,
+    struct pittari_result* result
+);
+const char* pittari_error_description(int error);
+
+#endif
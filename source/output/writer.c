@@ -0,0 +1,104 @@
+#include "output/writer.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <png.h>
+#include "input/magick.h"
+#include "input/reader.h"
+
+static bool has_extension(const char* path, const char* extension);
+static int write_ppm(const char* path, const unsigned char* pixels, size_t width, size_t height, char error_description[READER_ERROR_SIZE]);
+static int write_png(const char* path, const unsigned char* pixels, size_t width, size_t height, char error_description[READER_ERROR_SIZE]);
+
+// Returns nonzero and fills in error_description if the image can't be written.
+int write_image_file(const char* path, const unsigned char* pixels, size_t width, size_t height, char error_description[READER_ERROR_SIZE])
+{
+    if (has_extension(path, ".png")) {
+        return write_png(path, pixels, width, height, error_description);
+    }
+    if (has_extension(path, ".ppm") || has_extension(path, ".pnm")) {
+        return write_ppm(path, pixels, width, height, error_description);
+    }
+    return write_magick_image(path, pixels, width, height, error_description);
+}
+
+/*
+    Creates the directory if it doesn't exist yet. Returns false if it
+    can't be created.
+*/
+bool create_output_directory(const char* directory)
+{
+#ifdef WIN64
+    int result = mkdir(directory);
+#else
+    int result = mkdir(directory, 0777);
+#endif
+    return result == 0 || errno == EEXIST;
+}
+
+/*
+    Where in directory to write the screenshot at image_path: under the
+    same name, as a PNG. The path is allocated, and NULL if there isn't
+    enough memory.
+*/
+char* output_file_path(const char* directory, const char* image_path)
+{
+    const char* name = image_path;
+    for (const char* c = image_path; *c; c++) {
+        if (*c == '/' || *c == '\\') {name = c + 1;}
+    }
+    const char* extension = strrchr(name, '.');
+    size_t name_length = extension != NULL && extension != name ? (size_t) (extension - name) : strlen(name);
+
+    size_t directory_length = strlen(directory);
+    char* path = (char*) malloc(directory_length + name_length + sizeof("/.png"));
+    if (path == NULL) {return NULL;}
+    sprintf(path, "%s/%.*s.png", directory, (int) name_length, name);
+    return path;
+}
+
+static bool has_extension(const char* path, const char* extension)
+{
+    size_t path_length = strlen(path);
+    size_t extension_length = strlen(extension);
+    return path_length >= extension_length && strcasecmp(path + path_length - extension_length, extension) == 0;
+}
+
+static int write_ppm(const char* path, const unsigned char* pixels, size_t width, size_t height, char error_description[READER_ERROR_SIZE])
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        snprintf(error_description, READER_ERROR_SIZE, "%s", strerror(errno));
+        return 1;
+    }
+    fprintf(file, "P6\n%zu %zu\n255\n", width, height);
+    bool written = fwrite(pixels, 3, width * height, file) == width * height;
+    if (fclose(file) != 0) {written = false;}
+    if (!written) {
+        snprintf(error_description, READER_ERROR_SIZE, "Could not write all of the image.");
+        return 1;
+    }
+    return 0;
+}
+
+static int write_png(const char* path, const unsigned char* pixels, size_t width, size_t height, char error_description[READER_ERROR_SIZE])
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = (png_uint_32) width;
+    image.height = (png_uint_32) height;
+    image.format = PNG_FORMAT_RGB;
+    if (!png_image_write_to_file(&image, path, 0, pixels, 0, NULL)) {
+        snprintf(error_description, READER_ERROR_SIZE, "%s", image.message);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,17 @@
+/*
+    Writing 8-bit RGB pixels out to an image file, in a format picked by the
+    path's extension. PNG and binary PPM files are encoded natively; anything
+    else goes through ImageMagick.
+*/
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "input/reader.h"
+
+int write_image_file(const char* path, const unsigned char* pixels, size_t width, size_t height, char error_description[READER_ERROR_SIZE]);
+bool create_output_directory(const char* directory);
+char* output_file_path(const char* directory, const char* image_path);
+
+#endif
@@ -0,0 +1,125 @@
+#include "stats/stats.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+// Deeper than phases ever actually nest. Any beyond this are charged to
+// the one they're in.
+#define MAX_PHASE_DEPTH 8
+
+// Set by --stats.
+bool collect_stats = false;
+
+// The phases a thread is in, innermost last, and when time was last
+// charged to them.
+struct phase_stack {
+    enum stats_phase phases[MAX_PHASE_DEPTH];
+    size_t depth;
+    uint64_t last_wall;
+    uint64_t last_cpu;
+};
+
+// Added to from any thread, hence atomically.
+static struct run_stats stats;
+static pthread_t run_thread;
+static uint64_t run_start_wall;
+static uint64_t run_start_cpu;
+static __thread struct phase_stack phase_stack;
+
+static void charge_current_phase(void);
+static uint64_t read_clock(clockid_t clock);
+
+// Starts measuring a new run on this thread, from zero.
+void start_run_stats(void)
+{
+    if (!collect_stats) {return;}
+    memset(&stats, 0, sizeof(stats));
+    run_thread = pthread_self();
+    phase_stack.depth = 0;
+    run_start_wall = read_clock(CLOCK_MONOTONIC);
+    run_start_cpu = read_clock(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+// Copies what's been measured of the run so far into run_stats.
+void finish_run_stats(struct run_stats* run_stats)
+{
+    memset(run_stats, 0, sizeof(struct run_stats));
+    if (!collect_stats) {return;}
+    charge_current_phase();
+    for (size_t i = 0; i < NUM_STATS_PHASES; i++) {
+        run_stats->phases[i].wall_nanoseconds = __atomic_load_n(&stats.phases[i].wall_nanoseconds, __ATOMIC_RELAXED);
+        run_stats->phases[i].cpu_nanoseconds = __atomic_load_n(&stats.phases[i].cpu_nanoseconds, __ATOMIC_RELAXED);
+    }
+    for (size_t i = 0; i < NUM_STATS_COUNTERS; i++) {
+        run_stats->counters[i] = __atomic_load_n(&stats.counters[i], __ATOMIC_RELAXED);
+    }
+    run_stats->total.wall_nanoseconds = read_clock(CLOCK_MONOTONIC) - run_start_wall;
+    run_stats->total.cpu_nanoseconds = read_clock(CLOCK_PROCESS_CPUTIME_ID) - run_start_cpu;
+    run_stats->thinnest_column = stats.thinnest_column;
+    run_stats->thickest_column = stats.thickest_column;
+    run_stats->thinnest_row = stats.thinnest_row;
+    run_stats->thickest_row = stats.thickest_row;
+}
+
+// Every enter_stats_phase needs a leave_stats_phase on the same thread.
+void enter_stats_phase(enum stats_phase phase)
+{
+    if (!collect_stats) {return;}
+    charge_current_phase();
+    if (phase_stack.depth < MAX_PHASE_DEPTH) {phase_stack.phases[phase_stack.depth] = phase;}
+    phase_stack.depth++;
+}
+
+void leave_stats_phase(void)
+{
+    if (!collect_stats || phase_stack.depth == 0) {return;}
+    charge_current_phase();
+    phase_stack.depth--;
+}
+
+void count_stats(enum stats_counter counter, uint64_t amount)
+{
+    if (!collect_stats) {return;}
+    __atomic_fetch_add(&stats.counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+// Only ever called from the thread doing the run.
+void record_run_widths(bool rows, size_t thinnest, size_t thickest)
+{
+    if (!collect_stats) {return;}
+    if (rows) {
+        stats.thinnest_row = thinnest;
+        stats.thickest_row = thickest;
+    } else {
+        stats.thinnest_column = thinnest;
+        stats.thickest_column = thickest;
+    }
+}
+
+// Charges the time since it was last charged to the phase this thread is
+// in, if any.
+static void charge_current_phase(void)
+{
+    bool on_run_thread = pthread_equal(pthread_self(), run_thread);
+    uint64_t wall = on_run_thread ? read_clock(CLOCK_MONOTONIC) : 0;
+    uint64_t cpu = read_clock(CLOCK_THREAD_CPUTIME_ID);
+    if (phase_stack.depth > 0) {
+        size_t depth = phase_stack.depth < MAX_PHASE_DEPTH ? phase_stack.depth : MAX_PHASE_DEPTH;
+        struct phase_times* times = &stats.phases[phase_stack.phases[depth - 1]];
+        if (on_run_thread) {__atomic_fetch_add(&times->wall_nanoseconds, wall - phase_stack.last_wall, __ATOMIC_RELAXED);}
+        __atomic_fetch_add(&times->cpu_nanoseconds, cpu - phase_stack.last_cpu, __ATOMIC_RELAXED);
+    }
+    phase_stack.last_wall = wall;
+    phase_stack.last_cpu = cpu;
+}
+
+static uint64_t read_clock(clockid_t clock)
+{
+    struct timespec time;
+    if (clock_gettime(clock, &time) != 0) {return 0;}
+    return (uint64_t) time.tv_sec * 1000000000 + (uint64_t) time.tv_nsec;
+}
@@ -0,0 +1,79 @@
+/*
+    Counters and timers for --stats: where the time in a run goes, and how
+    much work each part of it does. Nothing's measured unless collect_stats
+    is set, and even then only a few times per frame or strip – never per
+    pixel – so it's cheap enough to leave on.
+
+    Time is charged to whichever phase a thread is in, with phases nesting
+    (decoding while writing output, say). Wall time only counts on the
+    thread that started the run, so that the phases add up to no more than
+    the run itself; CPU time counts on every thread – decoders reading
+    ahead, scan workers – so it can add up to more.
+*/
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum stats_phase {
+    // Opening images and reading frames out of them – or, when they're
+    // decoded in the background, waiting for them.
+    STATS_DECODE,
+    // Comparing pixels.
+    STATS_SCAN,
+    // Working out the dimensions from the contrasts.
+    STATS_DETERMINE,
+    // Writing screenshots back out (--output).
+    STATS_OUTPUT,
+    NUM_STATS_PHASES
+};
+
+enum stats_counter {
+    // Bytes of RGB read out of decoders. Frames scanned right where they
+    // are in memory aren't decoded at all, so they don't count.
+    STATS_BYTES_DECODED,
+    STATS_FRAMES,
+    // Pixels compared to the one left of or above them.
+    STATS_PIXELS_COMPARED,
+    // Summed over frames: how many columns/rows were decided already when
+    // the frame came along, and so were never compared in it.
+    STATS_COLUMNS_SKIPPED,
+    STATS_ROWS_SKIPPED,
+    // Rows that were the same as in the frame before, and so were passed
+    // over without comparing any of their pixels.
+    STATS_ROWS_UNCHANGED,
+    NUM_STATS_COUNTERS
+};
+
+struct phase_times {
+    uint64_t wall_nanoseconds;
+    uint64_t cpu_nanoseconds;
+};
+
+struct run_stats {
+    struct phase_times phases[NUM_STATS_PHASES];
+    // From start_run_stats to finish_run_stats, with CPU time counted over
+    // the whole process.
+    struct phase_times total;
+    uint64_t counters[NUM_STATS_COUNTERS];
+    // The thinnest and thickest runs of columns/rows between contrasts, as
+    // of the last time the dimensions were determined. 0 if they haven't
+    // been.
+    size_t thinnest_column;
+    size_t thickest_column;
+    size_t thinnest_row;
+    size_t thickest_row;
+};
+
+extern bool collect_stats;
+
+void start_run_stats(void);
+void finish_run_stats(struct run_stats* stats);
+void enter_stats_phase(enum stats_phase phase);
+void leave_stats_phase(void);
+void count_stats(enum stats_counter counter, uint64_t amount);
+void record_run_widths(bool rows, size_t thinnest, size_t thickest);
+
+#endif